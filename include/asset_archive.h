@@ -0,0 +1,82 @@
+/**
+ * @file asset_archive.h
+ *
+ * @breif Bundled UI files served from a memory-mapped archive on app://
+ */
+#ifndef CEF_TESTS_CEFCLIENT_ASSET_ARCHIVE_H_
+#define CEF_TESTS_CEFCLIENT_ASSET_ARCHIVE_H_
+#pragma once
+
+#include <string>
+
+#include <include/cef_base.h>
+#include <include/cef_request.h>
+#include <include/cef_resource_handler.h>
+
+#include "asset_archive_format.h"
+
+// Read-only view of an archive written by the pack_assets tool. The file is
+// mapped once; lookups binary search the sorted index and responses are
+// read straight from the mapped pages. Safe to use from any thread once
+// opened.
+//
+// Requests on app://<any host>/<path> are answered with the entry <path>,
+// or <path>index.html for directories. Responses carry a strong ETag and
+// immutable cache headers, and honor If-None-Match and single byte Range
+// requests. They are never content-coded: the network stack does not
+// decode what a CefResourceHandler returns, and app:// requests send no
+// Accept-Encoding anyway.
+class AssetArchive : public virtual CefBase {
+public:
+    // Scheme served, registered as a standard scheme in
+    // ClientApp::RegisterCustomSchemes.
+    static const char kScheme[];
+
+    // A file of the archive.
+    struct File {
+        const unsigned char* data;
+        size_t size;
+        uint64 hash;
+    };
+
+    AssetArchive();
+    virtual ~AssetArchive();
+
+    // Map the archive at |path|. Returns false if the file cannot be mapped
+    // or is not a valid archive.
+    bool Open(const std::string& path);
+    void Close();
+    bool IsOpen() const { return base_ != NULL; }
+
+    // Find the file |name|. Compressed variants of older archives are
+    // skipped.
+    bool Find(const std::string& name, File& file) const;
+
+    // Handler answering |request|, NULL if it is not an app:// request. A
+    // missing file is answered with 404.
+    CefRefPtr<CefResourceHandler> CreateResourceHandler(
+        CefRefPtr<CefRequest> request);
+
+private:
+    // Index of the first entry named |name|, entry_count if none.
+    uint32 LowerBound(const std::string& name) const;
+    int CompareName(const asset_archive::Entry& entry,
+                    const std::string& name) const;
+
+    unsigned char* base_;
+    size_t size_;
+    const asset_archive::Header* header_;
+    const asset_archive::Entry* entries_;
+    const char* names_;
+#if defined(OS_WIN)
+    void* mapping_;
+#endif
+
+    IMPLEMENT_REFCOUNTING(AssetArchive);
+
+    // Not copyable.
+    AssetArchive(const AssetArchive&);
+    AssetArchive& operator=(const AssetArchive&);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_ASSET_ARCHIVE_H_
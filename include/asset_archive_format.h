@@ -0,0 +1,73 @@
+/**
+ * @file asset_archive_format.h
+ *
+ * @breif On-disk layout of the asset archives read by AssetArchive
+ *
+ * Shared with the pack_assets tool, so it must not depend on CEF. All
+ * numbers are little-endian.
+ *
+ *   Header
+ *   file data, each file 16-byte aligned
+ *   Entry[entry_count], sorted by name bytes, then by encoding
+ *   names, the UTF-8 paths of the entries without a leading '/'
+ */
+#ifndef CEF_TESTS_CEFCLIENT_ASSET_ARCHIVE_FORMAT_H_
+#define CEF_TESTS_CEFCLIENT_ASSET_ARCHIVE_FORMAT_H_
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace asset_archive {
+
+const char kMagic[8] = { 'C', 'E', 'F', 'A', 'S', 'S', 'E', 'T' };
+const uint32_t kVersion = 1;
+const uint64_t kDataAlignment = 16;
+
+// Content coding of an entry. Precompressed variants of a file share its
+// name and are stored next to it. pack_assets no longer writes them and
+// AssetArchive never serves them, they are only known so that archives
+// holding them still open.
+enum Encoding {
+    ENCODING_IDENTITY = 0,
+    ENCODING_GZIP,
+    ENCODING_BROTLI,
+    ENCODING_COUNT,
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_count;
+    uint64_t index_offset;
+    uint64_t names_offset;
+    uint64_t names_size;
+};
+
+struct Entry {
+    // Name bytes at names_offset + name_offset.
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint64_t data_offset;
+    uint64_t data_size;
+    // Hash of the data, used as the ETag.
+    uint64_t hash;
+    uint32_t encoding;
+    uint32_t reserved;
+};
+
+// 64-bit FNV-1a of |size| bytes.
+inline uint64_t Hash(const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+}  // namespace asset_archive
+
+#endif  // CEF_TESTS_CEFCLIENT_ASSET_ARCHIVE_FORMAT_H_
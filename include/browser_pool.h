@@ -0,0 +1,176 @@
+/**
+ * @file browser_pool.h
+ *
+ * @breif Pool of pre-warmed blank browsers handed out on demand
+ */
+#ifndef CEF_TESTS_CEFCLIENT_BROWSER_POOL_H_
+#define CEF_TESTS_CEFCLIENT_BROWSER_POOL_H_
+#pragma once
+
+#include <deque>
+#include <unordered_map>
+
+#include <include/cef_base.h>
+#include <include/cef_browser.h>
+
+#include "client_handler_impl.h"
+#include "latency_counter.h"
+
+struct BrowserPoolStats {
+    // Browsers ready to be handed out, and on their way there.
+    int ready;
+    int warming;
+    // Acquire calls that got a ready browser, and those that got none.
+    uint64 hits;
+    uint64 misses;
+    // Time spent in Acquire.
+    Latency acquire;
+    // Time from Release until the browser is ready again.
+    Latency release;
+    // Time from creation until a new browser is ready.
+    Latency warm_up;
+};
+
+// Keeps a number of offscreen browsers loaded with about:blank so that
+// opening a view does not wait for browser creation and the render process
+// launch. Each browser gets its own ClientHandlerImpl. A browser is ready
+// once its blank page loaded and a round trip through the |platform| bridge
+// of client_renderer.cpp succeeded, so the render process and the V8 context
+// exist. Ready browsers are kept hidden, handed out browsers are shown.
+// Missing browsers are created again in the background, returned ones are
+// navigated back to about:blank and reused, with their history and message
+// delegates reset. Browsers that are not created or do not get ready within
+// a timeout, or whose render process died before they were handed out, are
+// replaced.
+class BrowserPool : public ClientHandlerImpl::BrowserObserver,
+                    public ClientHandlerImpl::MessageDelegate
+{
+public:
+    // Interface implemented to create the clients of the pooled browsers,
+    // e.g. to install handlers on them.
+    class ClientFactory : public virtual CefBase {
+    public:
+        // Called on the UI thread.
+        virtual CefRefPtr<ClientHandlerImpl> CreateClient() =0;
+    };
+
+    // Pool of |size| browsers created with |window_info| and |settings|.
+    // Clients are plain ClientHandlerImpl objects if |factory| is NULL.
+    BrowserPool(const CefWindowInfo& window_info,
+                const CefBrowserSettings& settings,
+                int size,
+                CefRefPtr<ClientFactory> factory = NULL);
+    virtual ~BrowserPool();
+
+    // Start creating the browsers, once CEF is initialized.
+    void Start() { PostRefill(); }
+
+    // Number of browsers to keep ready. Extra ready browsers are closed.
+    void SetSize(int size);
+    int size() const { return size_; }
+
+    // Client of a ready browser, NULL if none is ready yet. Never waits,
+    // a replacement is created in the background. Safe to call from any
+    // thread.
+    CefRefPtr<ClientHandlerImpl> Acquire();
+    // Give back a client got from Acquire. Its browser is navigated to
+    // about:blank and reused, or closed if the pool is full. Safe to call
+    // from any thread.
+    void Release(CefRefPtr<ClientHandlerImpl> client);
+
+    // Close all pooled browsers and stop refilling. Browsers handed out are
+    // closed on Release.
+    void Shutdown();
+
+    // Safe to call from any thread.
+    BrowserPoolStats GetStats();
+
+    // ClientHandlerImpl::BrowserObserver methods
+    virtual void OnAfterCreated(CefRefPtr<CefBrowser> browser) OVERRIDE;
+    virtual void OnLoadEnd(CefRefPtr<CefBrowser> browser,
+                           CefRefPtr<CefFrame> frame,
+                           int httpStatusCode) OVERRIDE;
+    virtual void OnBeforeClose(CefRefPtr<CefBrowser> browser) OVERRIDE;
+    virtual void OnRenderProcessTerminated(
+        CefRefPtr<CefBrowser> browser,
+        CefRequestHandler::TerminationStatus status) OVERRIDE;
+
+    // ClientHandlerImpl::MessageDelegate methods
+    virtual bool OnProcessMessageReceived(
+        CefRefPtr<CefBrowser> browser,
+        CefProcessId source_process,
+        CefRefPtr<CefProcessMessage> message) OVERRIDE;
+
+private:
+    enum State {
+        // Waiting for OnAfterCreated.
+        STATE_CREATING,
+        // Loading about:blank, or waiting for the bridge round trip.
+        STATE_WARMING,
+        STATE_READY,
+        // Handed out by Acquire.
+        STATE_ACQUIRED,
+        STATE_CLOSING,
+    };
+
+    struct Entry {
+        Entry()
+            : state(STATE_CREATING), since(0), generation(0), recycled(false) {}
+
+        CefRefPtr<ClientHandlerImpl> client;
+        State state;
+        // Time the entry entered its state, in microseconds.
+        int64 since;
+        // Tells the creation timeouts of successive entries apart.
+        int generation;
+        // True if warming up after Release rather than after creation.
+        bool recycled;
+        // Message delegates of the client as created, restored on Release.
+        ClientHandlerImpl::MessageDelegateSet delegates;
+    };
+    typedef std::unordered_map<int, Entry> EntryMap;
+
+    // Create or close browsers until |size_| are ready or on their way. UI
+    // thread only.
+    void Refill();
+    void PostRefill();
+    void DoRelease(CefRefPtr<ClientHandlerImpl> client);
+    void DoShutdown();
+    // Stop waiting for the browser of the entry |generation| if it is still
+    // being created.
+    void OnCreateTimeout(int generation);
+    // Close browser |browser_id| if it is still warming up since |since|.
+    void OnWarmUpTimeout(int browser_id, int64 since);
+    // Close the pooled browser |browser_id| unless it is handed out. A
+    // replacement is created once it closed.
+    void Discard(int browser_id);
+    // Number of browsers that are ready or will be without a Release.
+    int SupplyLocked() const;
+
+    const CefWindowInfo window_info_;
+    const CefBrowserSettings settings_;
+    CefRefPtr<ClientFactory> factory_;
+    int size_;
+    bool shutdown_;
+    bool refill_pending_;
+    int generation_;
+
+    // Entries whose browser is not created yet. Those given up on are
+    // STATE_CLOSING, their browser is closed should it show up after all.
+    std::deque<Entry> creating_;
+    // Pooled browsers by browser id.
+    EntryMap entries_;
+    // Ids of the ready browsers, the longest waiting first.
+    std::deque<int> ready_;
+
+    uint64 hits_;
+    uint64 misses_;
+    LatencyCounter acquire_latency_;
+    LatencyCounter release_latency_;
+    LatencyCounter warm_up_latency_;
+
+    IMPLEMENT_REFCOUNTING(BrowserPool);
+    IMPLEMENT_LOCKING(BrowserPool);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_BROWSER_POOL_H_
@@ -0,0 +1,119 @@
+/**
+ * @file browser_state.h
+ *
+ * @breif Per-browser navigation and loading state of a client
+ */
+#ifndef CEF_TESTS_CEFCLIENT_BROWSER_STATE_H_
+#define CEF_TESTS_CEFCLIENT_BROWSER_STATE_H_
+#pragma once
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <include/cef_base.h>
+#include <include/cef_browser.h>
+
+#include "navigation_state.h"
+
+// State of one browser, updated from the CEF callbacks on the UI thread.
+struct BrowserState {
+    BrowserState()
+        : is_popup(false),
+          is_loading(false),
+          can_go_back(false),
+          can_go_forward(false),
+          is_crashed(false),
+          is_paused(false),
+          hist_links_pos(-1),
+          history_cleared(false),
+          resize_width(0),
+          resize_height(0),
+          resize_generation(0) {}
+
+    CefRefPtr<CefBrowser> browser;
+    bool is_popup;
+    bool is_loading;
+    bool can_go_back;
+    bool can_go_forward;
+    bool is_crashed;
+    // True while rendering is paused with PauseRendering
+    bool is_paused;
+    CefString title;
+    // Main frame URLs loaded so far, and the current one
+    std::vector<CefString> hist_links;
+    int hist_links_pos;
+    // Set by ClearHistory. The browser keeps the entries from before, back
+    // and forward are limited to |hist_links| so they are not reachable.
+    bool history_cleared;
+    // URL of the back or forward navigation the renderer is about to start
+    CefString history_navigation;
+    // Last size requested with Resize, applied when |resize_generation| has
+    // not changed for a while
+    int resize_width;
+    int resize_height;
+    int resize_generation;
+    // Copy of the fields above for readers on other threads
+    CefRefPtr<NavigationStateCell> nav_state;
+};
+
+// Browser states by browser identifier. States are stored contiguously and
+// looked up through a hash index, so Find, Insert and Remove are O(1);
+// Remove moves the last state into the freed slot. Pointers returned by
+// Find and Insert are valid until the next Insert or Remove.
+class BrowserStateTable {
+public:
+    typedef std::vector<BrowserState>::iterator iterator;
+    typedef std::vector<BrowserState>::const_iterator const_iterator;
+
+    BrowserState* Find(int browser_id) {
+        std::unordered_map<int, size_t>::const_iterator it =
+            index_.find(browser_id);
+        return it != index_.end() ? &states_[it->second] : NULL;
+    }
+    const BrowserState* Find(int browser_id) const {
+        return const_cast<BrowserStateTable*>(this)->Find(browser_id);
+    }
+
+    // State of |browser|, added with default values if not there yet.
+    BrowserState* Insert(CefRefPtr<CefBrowser> browser) {
+        const int browser_id = browser->GetIdentifier();
+        std::pair<std::unordered_map<int, size_t>::iterator, bool> result =
+            index_.insert(std::make_pair(browser_id, states_.size()));
+        if (result.second) {
+            states_.push_back(BrowserState());
+            states_.back().browser = browser;
+            states_.back().is_popup = browser->IsPopup();
+            states_.back().nav_state = new NavigationStateCell();
+        }
+        return &states_[result.first->second];
+    }
+
+    // Returns false if |browser_id| is unknown.
+    bool Remove(int browser_id) {
+        std::unordered_map<int, size_t>::iterator it = index_.find(browser_id);
+        if (it == index_.end())
+            return false;
+        const size_t slot = it->second;
+        index_.erase(it);
+        if (slot != states_.size() - 1) {
+            states_[slot] = std::move(states_.back());
+            index_[states_[slot].browser->GetIdentifier()] = slot;
+        }
+        states_.pop_back();
+        return true;
+    }
+
+    size_t size() const { return states_.size(); }
+    bool empty() const { return states_.empty(); }
+    iterator begin() { return states_.begin(); }
+    iterator end() { return states_.end(); }
+    const_iterator begin() const { return states_.begin(); }
+    const_iterator end() const { return states_.end(); }
+
+private:
+    std::vector<BrowserState> states_;
+    std::unordered_map<int, size_t> index_;
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_BROWSER_STATE_H_
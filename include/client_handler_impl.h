@@ -6,14 +6,21 @@
 #define CEF_TESTS_CEFCLIENT_CLIENT_HANDLER_H_
 #pragma once
 
-#include <list>
+#include <atomic>
 #include <map>
 #include <set>
 #include <string>
+#include <unordered_map>
 
 #include <include/wrapper/cef_message_router.h>
 
+#include "asset_archive.h"
+#include "browser_state.h"
 #include "client_handler.h"
+#include "navigation_admission.h"
+#include "platform_call.h"
+#include "response_cache.h"
+#include "url_filter.h"
 #include "util.h"
 
 // ClientHandler implementation.
@@ -37,6 +44,22 @@ public:
         virtual ~RenderHandler() {}
         // To inform browser close
         virtual void OnBeforeClose(CefRefPtr<CefBrowser> browser) =0;
+        // To inform the view settled at |width| x |height| after Resize
+        virtual void OnResize(CefRefPtr<CefBrowser> browser,
+                              int width, int height) {}
+        // To inform the browser was hidden/shown with Pause/ResumeRendering
+        virtual void OnPauseRendering(CefRefPtr<CefBrowser> browser) {}
+        virtual void OnResumeRendering(CefRefPtr<CefBrowser> browser) {}
+    };
+
+    // Interface implemented to create the RenderHandler of each offscreen
+    // browser, so that one client can host many of them.
+    class RenderHandlerFactory : public virtual CefBase {
+    public:
+        // Called on the UI thread before the first render callback of
+        // |browser|. Return NULL to use the handler of SetOSRHandler.
+        virtual CefRefPtr<RenderHandler> CreateRenderHandler(
+            CefRefPtr<CefBrowser> browser) =0;
     };
 
     typedef std::set<CefMessageRouterBrowserSide::Handler*> MessageHandlerSet;
@@ -53,6 +76,20 @@ public:
     };
     typedef std::set<CefRefPtr<MessageDelegate> > MessageDelegateSet;
 
+    // Interface implemented to follow the life of the browsers of a client
+    // from outside, e.g. by BrowserPool. Called on the UI thread after the
+    // client itself handled the event.
+    class BrowserObserver : public virtual CefBase {
+    public:
+        virtual void OnAfterCreated(CefRefPtr<CefBrowser> browser) {}
+        virtual void OnLoadEnd(CefRefPtr<CefBrowser> browser,
+                               CefRefPtr<CefFrame> frame,
+                               int httpStatusCode) {}
+        virtual void OnBeforeClose(CefRefPtr<CefBrowser> browser) {}
+        virtual void OnRenderProcessTerminated(CefRefPtr<CefBrowser> browser,
+                                               TerminationStatus status) {}
+    };
+
     ClientHandlerImpl();
     virtual ~ClientHandlerImpl();
 
@@ -239,34 +276,136 @@ public:
                               const std::vector<CefString>& accept_types,
                               CefRefPtr<CefFileDialogCallback> callback) OVERRIDE;
 
-    /// Interfaces for outter wrapper
-    bool IsLoading() const { return m_bIsLoading; }
-    bool CanGoBack() const { return m_bCanGoBack; }
-    bool CanGoForward() const { return m_bCanGoForward; }
-    bool IsCrashed() const { return m_bIsCrashed; }
+    /// Interfaces for outter wrapper, acting on the main browser
+    // The state getters read the latest snapshot, without a lock.
+    bool IsLoading() const { return GetNavigationState().is_loading; }
+    bool CanGoBack() const { return GetNavigationState().can_go_back; }
+    bool CanGoForward() const { return GetNavigationState().can_go_forward; }
+    bool IsCrashed() const { return GetNavigationState().is_crashed; }
+    bool IsPaused() const { return GetNavigationState().is_paused; }
     void GoBack();
     void GoForward();
     void GoToHistoryOffset(int offset);
     void Stop();
     void Reload(bool ignore_cache);
-    void Resize(int width, int height);
-    void PauseRendering();
-    void ResumeRendering();
+    void Resize(int width, int height) {
+        Resize(m_BrowserId, width, height);
+    }
+    void PauseRendering() { PauseRendering(m_BrowserId); }
+    void ResumeRendering() { ResumeRendering(m_BrowserId); }
     void Focus();
     void Unfocus();
     void SetZoomLevel(double zoom_level);
     double GetZoomLevel();
-    CefString title() const { return m_Title; }
+    CefString title() const { return GetNavigationState().GetTitle(); }
+
+    // Consistent snapshot of the main browser state. Safe to call from any
+    // thread, never blocks.
+    NavigationState GetNavigationState() const {
+        NavigationState state;
+        m_MainNavState->Read(state);
+        return state;
+    }
+    // Number of changes of the main browser state so far, e.g. a new main
+    // browser. Pollers skip GetNavigationState while it stays the same.
+    uint32 GetNavigationSequence() const { return m_MainNavState->sequence(); }
+    // Snapshot cell of the browser |browser_id|, NULL if unknown. Readers
+    // on other threads may keep it and read it without a lock, also after
+    // the browser closed.
+    CefRefPtr<NavigationStateCell> GetNavigationStateCell(int browser_id);
+    // Consistent snapshot of the browser |browser_id|, with a browser_id of
+    // 0 if unknown. The lock is only held to find its cell, the state is
+    // copied without it.
+    NavigationState GetNavigationState(int browser_id);
+
+    // State of any browser of this client, false or empty for unknown ids.
+    // Read from the snapshot like the getters of the main browser.
+    bool IsLoading(int browser_id) {
+        return GetNavigationState(browser_id).is_loading;
+    }
+    bool CanGoBack(int browser_id) {
+        return GetNavigationState(browser_id).can_go_back;
+    }
+    bool CanGoForward(int browser_id) {
+        return GetNavigationState(browser_id).can_go_forward;
+    }
+    bool IsCrashed(int browser_id) {
+        return GetNavigationState(browser_id).is_crashed;
+    }
+    bool IsPaused(int browser_id) {
+        return GetNavigationState(browser_id).is_paused;
+    }
+    CefString title(int browser_id) {
+        return GetNavigationState(browser_id).GetTitle();
+    }
+
+    // Act on any browser of this client, e.g. the pooled or popup ones.
+    // Ignored for unknown ids. Safe to call from any thread.
+    void Resize(int browser_id, int width, int height);
+    void PauseRendering(int browser_id);
+    void ResumeRendering(int browser_id);
+    // Forget the pages |browser_id| went through, e.g. before a pooled
+    // browser is handed out again. UI thread only.
+    void ClearHistory(int browser_id);
 
     void SetMainHwnd(CefWindowHandle hwnd);
     CefWindowHandle GetMainHwnd() { return m_MainHwnd; }
+    // Handler of the browsers without one of their own, e.g. the main browser
+    // when no factory is set. Released once the last browser closed.
     void SetOSRHandler(CefRefPtr<RenderHandler> handler) {
         m_OSRHandler = handler;
     }
     CefRefPtr<RenderHandler> GetOSRHandler() { return m_OSRHandler; }
+    // Give every offscreen browser its own handler created by |factory|.
+    // Handlers are released in OnBeforeClose of their browser.
+    void SetRenderHandlerFactory(CefRefPtr<RenderHandlerFactory> factory) {
+        m_RenderHandlerFactory = factory;
+    }
+    // Handler registered for the browser |browser_id|, NULL if none. UI
+    // thread only.
+    CefRefPtr<RenderHandler> GetOSRHandler(int browser_id) const;
 
-    CefRefPtr<CefBrowser> GetBrowser() { return m_Browser; }
+    // Serve app:// requests from |archive|. Set before creating browsers.
+    void SetAssetArchive(CefRefPtr<AssetArchive> archive) {
+        m_AssetArchive = archive;
+    }
+    // Cancel navigations and requests whose URL |filter| blocks. The filter
+    // may be reloaded at any time; set it before creating browsers.
+    void SetUrlFilter(CefRefPtr<UrlFilter> filter) { m_UrlFilter = filter; }
+    // Answer cacheable http(s) requests through |cache|, which may be shared
+    // by several clients. Set before creating browsers.
+    void SetResponseCache(CefRefPtr<ResponseCache> cache) {
+        m_ResponseCache = cache;
+    }
+    // Limit the browsers loading at the same time with |admission|, which
+    // may be shared by several clients. Main frame navigations beyond the
+    // limit are cancelled and started again once admitted; GoBack, Reload
+    // and the like are queued as they are. Back and forward navigations
+    // started elsewhere, e.g. by history.back(), are always let through, as
+    // starting them again would add new history entries. Set before creating
+    // browsers.
+    void SetNavigationAdmission(CefRefPtr<NavigationAdmission> admission) {
+        m_Admission = admission;
+    }
+
+    // Answer platform.call(name, ...) from the pages with |handler|, run on
+    // |thread|; give handlers that block e.g. TID_FILE.
+    void AddCallHandler(const std::string& name,
+                        CefRefPtr<PlatformCallHandler> handler,
+                        CefThreadId thread = TID_UI) {
+        m_Calls->AddHandler(name, handler, thread);
+    }
+    void RemoveCallHandler(const std::string& name) {
+        m_Calls->RemoveHandler(name);
+    }
+
+    CefRefPtr<CefBrowser> GetBrowser() { return GetBrowser(m_BrowserId); }
     int GetBrowserId() { return m_BrowserId; }
+    // Browser |browser_id| of this client, NULL if unknown.
+    CefRefPtr<CefBrowser> GetBrowser(int browser_id);
+    // Number of browsers of this client, and of all clients of the process.
+    int GetBrowserCount();
+    static int GetTotalBrowserCount() { return m_BrowserCount.load(); }
 
     // Request that all existing browser windows close.
     void CloseAllBrowsers(bool force_close);
@@ -303,14 +442,23 @@ public:
     void CreateMessageDelegate() {
         message_delegates_.insert(new MDT);
     }
+    void AddMessageDelegate(CefRefPtr<MessageDelegate> delegate) {
+        message_delegates_.insert(delegate);
+    }
+    const MessageDelegateSet& GetMessageDelegates() const {
+        return message_delegates_;
+    }
+    // Replace all message delegates, e.g. to drop those added by the last
+    // user of a pooled browser. UI thread only.
+    void SetMessageDelegates(const MessageDelegateSet& delegates) {
+        message_delegates_ = delegates;
+    }
 
-protected:
-    void SetLoading(bool isLoading) { m_bIsLoading = isLoading; }
-    void SetNavState(bool canGoBack, bool canGoForward) {
-        m_bCanGoBack = canGoBack;
-        m_bCanGoForward = canGoForward;
+    void SetBrowserObserver(CefRefPtr<BrowserObserver> observer) {
+        m_BrowserObserver = observer;
     }
 
+protected:
     // Create all CefMessageRouterBrowserSide::Handler objects. They will be
     // deleted when the ClientHandler is destroyed.
     static void CreateMessageHandlers(MessageHandlerSet& handlers);
@@ -322,35 +470,78 @@ protected:
     // use the default temp directory.
     std::string GetDownloadPath(const std::string& file_name);
 
-    // The child browser window
-    CefRefPtr<CefBrowser> m_Browser;
-
-    // List of any popup browser windows. Only accessed on the CEF UI thread.
-    typedef std::list<CefRefPtr<CefBrowser> > BrowserList;
-    BrowserList m_PopupBrowsers;
+    // Publish the fields of |state| to its snapshot cell, and to the main
+    // one for the main browser. Called with the object lock held.
+    void PublishNavigationState(const BrowserState& state);
+
+    // Queue |navigation| of the main browser if |m_Admission| has no slot
+    // for it. Returns true if queued, the caller navigates otherwise.
+    bool DeferNavigation(CefRefPtr<CefTask> navigation);
+
+    // Pass |message| to the message delegates until one handles it.
+    bool DeliverToDelegates(CefRefPtr<CefBrowser> browser,
+                            CefProcessId source_process,
+                            CefRefPtr<CefProcessMessage> message);
+
+    // Apply the last requested size of |browser_id| once Resize calls
+    // stopped for a while.
+    void OnResizeSettled(int browser_id, int generation);
+
+    // Whether |url| is the navigation of |frame_id| let through by
+    // OnBeforeBrowse, forgotten once taken. Its response is not cached:
+    // CefURLRequest follows redirects, so a redirected document would be
+    // stored and served under the URL first asked for.
+    bool TakePendingNavigation(int browser_id, int64 frame_id,
+                               const std::string& url);
+    // Whether the main frame navigation of |browser_id| to |url| moves in
+    // the history: announced as such by the renderer, or to the entry right
+    // before or after the current one.
+    bool IsHistoryNavigation(int browser_id, const CefString& url);
+
+    // Handler of |browser|, created with the factory on first use. Falls
+    // back to |m_OSRHandler|.
+    CefRefPtr<RenderHandler> FindOSRHandler(CefRefPtr<CefBrowser> browser);
+
+    // State of every browser of this client, popups included, by browser
+    // id. Written on the CEF UI thread with the object lock held.
+    BrowserStateTable m_BrowserStates;
+    // Snapshot of the main browser state, empty while there is none
+    const CefRefPtr<NavigationStateCell> m_MainNavState;
 
     // The main frame window handle
     CefWindowHandle m_MainHwnd;
 
-    // The child browser id
+    // Id of the main child browser, 0 if there is none
     int m_BrowserId;
 
     // True if the main browser window is currently closing.
     bool m_bIsClosing;
 
-    // Loading state
-    bool m_bIsLoading;
-    bool m_bCanGoBack;
-    bool m_bCanGoForward;
-
-    bool m_bIsCrashed;
-    CefString m_Title;
-
-    std::vector<CefString> m_HistLinks;
-    int m_HistLinksPos;
-
     CefRefPtr<RenderHandler> m_OSRHandler;
 
+    // Handlers of the offscreen browsers by browser id. Only accessed on the
+    // CEF UI thread.
+    typedef std::unordered_map<int, CefRefPtr<RenderHandler> > RenderHandlerMap;
+    RenderHandlerMap m_OSRHandlers;
+    CefRefPtr<RenderHandlerFactory> m_RenderHandlerFactory;
+
+    // Bundled files served on app://
+    CefRefPtr<AssetArchive> m_AssetArchive;
+    // Block list checked in OnBeforeBrowse and GetResourceHandler.
+    CefRefPtr<UrlFilter> m_UrlFilter;
+    // Local cache of GET responses, see SetResponseCache.
+    CefRefPtr<ResponseCache> m_ResponseCache;
+    // URL of the navigation last let through by OnBeforeBrowse, by browser
+    // and frame id, until its request reaches GetResourceHandler. Guarded
+    // by the object lock.
+    typedef std::unordered_map<int, std::unordered_map<int64, std::string> >
+        PendingNavigationMap;
+    PendingNavigationMap m_PendingNavigations;
+    // Cap on concurrent page loads, see SetNavigationAdmission.
+    CefRefPtr<NavigationAdmission> m_Admission;
+    // Handlers of platform.call, see AddCallHandler.
+    CefRefPtr<PlatformCallRegistry> m_Calls;
+
     // Support for downloading files.
     std::string m_LastDownloadFile;
 
@@ -374,9 +565,11 @@ protected:
     // process
     MessageDelegateSet message_delegates_;
 
-    // Number of currently existing browser windows. The application will exit
-    // when the number of windows reaches 0.
-    static int m_BrowserCount;
+    CefRefPtr<BrowserObserver> m_BrowserObserver;
+
+    // Number of currently existing browser windows of all clients. The
+    // application will exit when the number of windows reaches 0.
+    static std::atomic<int> m_BrowserCount;
 
     // Include the default reference counting implementation.
     IMPLEMENT_REFCOUNTING(ClientHandlerImpl);
@@ -6,7 +6,6 @@
 #define CEF_TESTS_CEFCLIENT_CLIENT_RENDERER_H_
 #pragma once
 
-#include <map>
 #include <string>
 
 #include <include/cef_base.h>
@@ -20,18 +19,25 @@ namespace client_renderer {
 extern const char kFocusedNodeChangedMessage[];
 extern const char kTestMessage[];
 extern const char kPlatformMessage[];
-
-typedef std::map<std::pair<std::string, int>,
-                 std::pair<CefRefPtr<CefV8Context>, CefRefPtr<CefV8Value> > >
-                 CallbackMap;
-extern CallbackMap g_callbacks;
+// Message carrying a batch of platform.emit calls. Its arguments are one
+// list per call, holding the arguments of the call, event name first.
+extern const char kPlatformBatchMessage[];
+// Messages of platform.call: the call, [id, name, [args...]], sent to the
+// browser, its cancellation, [id], and the answer sent back to the
+// renderer, [id, true, [result]] or [id, false, error].
+extern const char kPlatformCallMessage[];
+extern const char kPlatformCancelMessage[];
+extern const char kPlatformResultMessage[];
+// Message sent before a back or forward navigation of the main frame starts,
+// [url]. Such navigations are let through navigation admission.
+extern const char kHistoryNavigationMessage[];
 
 // Create platform message with the specified event
-std::string GenPlatformMsg(std::string event_name);
+std::string GenPlatformMsg(const std::string& event_name);
 // Judge whether or not the specified message is of type platform
-bool IsPlatformMsg(std::string message);
+bool IsPlatformMsg(const std::string& message);
 // Parse event name from message name
-std::string GetEventFromMsg(std::string message);
+std::string GetEventFromMsg(const std::string& message);
 
 // Create the render delegate.
 void CreateRenderDelegates(ClientApp::RenderDelegateSet& delegates);
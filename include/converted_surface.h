@@ -0,0 +1,81 @@
+/**
+ * @file converted_surface.h
+ *
+ * @breif Retained copy of the offscreen view in another pixel format
+ */
+#ifndef CEF_TESTS_CEFCLIENT_CONVERTED_SURFACE_H_
+#define CEF_TESTS_CEFCLIENT_CONVERTED_SURFACE_H_
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include <include/cef_base.h>
+
+#include "offscreen_surface.h"
+
+// Output formats of the offscreen view, converted from its premultiplied BGRA.
+enum PixelFormat {
+    // Straight (non premultiplied) alpha.
+    PIXEL_FORMAT_BGRA_STRAIGHT,
+    // Premultiplied RGBA, e.g. for texture uploads.
+    PIXEL_FORMAT_RGBA,
+    // Straight alpha RGBA, e.g. for PNG encoders.
+    PIXEL_FORMAT_RGBA_STRAIGHT,
+    // 3 bytes per pixel, R, G, B.
+    PIXEL_FORMAT_RGB24,
+    // BT.601 limited range Y, U and V planes, chroma subsampled 2x2.
+    PIXEL_FORMAT_I420,
+    // BT.601 limited range Y plane and interleaved UV plane, chroma
+    // subsampled 2x2.
+    PIXEL_FORMAT_NV12,
+    PIXEL_FORMAT_COUNT
+};
+
+// A pixel buffer in |format()| that keeps its content between frames, so
+// that only the damaged parts of the view are converted. Planes are 64-byte
+// aligned.
+class ConvertedSurface {
+public:
+    explicit ConvertedSurface(PixelFormat format);
+    ~ConvertedSurface();
+
+    // Convert the pixels of |source| covered by |damage|, resizing to the
+    // source first. The whole source is converted after a resize. With
+    // |opaque| every alpha is known to be 255 and unpremultiplying is
+    // skipped.
+    void Update(const OffScreenSurface& source,
+                const std::vector<CefRect>& damage, bool opaque);
+    // Free the storage. The surface becomes empty.
+    void Release();
+
+    bool IsEmpty() const { return data_ == NULL; }
+    PixelFormat format() const { return format_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+    // 1 for the packed formats, 2 for NV12 and 3 for I420.
+    int plane_count() const;
+    const void* plane(int index) const { return data_ + offsets_[index]; }
+    int stride(int index) const { return strides_[index]; }
+
+private:
+    // Make the surface |width| x |height|. Returns true if the storage was
+    // reallocated, in which case the content is undefined.
+    bool Resize(int width, int height);
+    void ConvertRect(const OffScreenSurface& source, const CefRect& rect,
+                     bool opaque);
+    unsigned char* plane(int index) { return data_ + offsets_[index]; }
+
+    PixelFormat format_;
+    int width_;
+    int height_;
+    int strides_[3];
+    size_t offsets_[3];
+    unsigned char* data_;
+
+    // Not copyable.
+    ConvertedSurface(const ConvertedSurface&);
+    ConvertedSurface& operator=(const ConvertedSurface&);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_CONVERTED_SURFACE_H_
@@ -0,0 +1,44 @@
+/**
+ * @file damage_history.h
+ *
+ * @breif Damage of recently published frames, by frame number
+ */
+#ifndef CEF_TESTS_CEFCLIENT_DAMAGE_HISTORY_H_
+#define CEF_TESTS_CEFCLIENT_DAMAGE_HISTORY_H_
+#pragma once
+
+#include <vector>
+
+#include <include/cef_base.h>
+
+// Remembers the damage of the last |kSize| frames, so that a buffer or
+// consumer that is a few frames behind can catch up with a partial copy.
+class DamageHistory {
+public:
+    static const int kSize = 8;
+
+    // Damage of frame |sequence| relative to frame |sequence| - 1.
+    void Record(uint64 sequence, const std::vector<CefRect>& damage) {
+        frames_[sequence % kSize] = damage;
+    }
+
+    // Union of the damage of the frames after |since| up to |until|, which
+    // must be the last recorded frame. Returns false if that history is no
+    // longer known; 0 stands for "never", so it always fails.
+    bool Collect(uint64 since, uint64 until,
+                 std::vector<CefRect>& damage) const {
+        damage.clear();
+        if (since == 0 || since > until || until - since > kSize)
+            return false;
+        for (uint64 seq = since + 1; seq <= until; ++seq) {
+            const std::vector<CefRect>& rects = frames_[seq % kSize];
+            damage.insert(damage.end(), rects.begin(), rects.end());
+        }
+        return true;
+    }
+
+private:
+    std::vector<CefRect> frames_[kSize];
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_DAMAGE_HISTORY_H_
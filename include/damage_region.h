@@ -0,0 +1,66 @@
+/**
+ * @file damage_region.h
+ *
+ * @breif Coalescing of dirty rects into few, large spans
+ */
+#ifndef CEF_TESTS_CEFCLIENT_DAMAGE_REGION_H_
+#define CEF_TESTS_CEFCLIENT_DAMAGE_REGION_H_
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include <include/cef_base.h>
+
+// Accumulates dirty rects and keeps them coalesced: rects are snapped out to
+// a tile grid, overlapping or adjacent rects are merged when their union
+// wastes no more than their overlap, and the whole region falls back to its
+// bounding box once the rects cover most of it or grow too many.
+class DamageRegion {
+public:
+    // Default tiles are one 64-byte cache line of BGRA pixels wide.
+    static const int kDefaultTileWidth = 16;
+    static const int kDefaultTileHeight = 1;
+    static const size_t kDefaultMaxRects = 16;
+
+    DamageRegion();
+
+    // Snap rects outwards to multiples of |tile_width| x |tile_height|, 1 x 1
+    // disables snapping.
+    void SetSnap(int tile_width, int tile_height);
+    // Collapse to the bounding box when the rects cover at least |ratio| of
+    // it, or when there are more than |max_rects| of them. A ratio above 1
+    // only collapses on the rect count.
+    void SetBoundingBoxThreshold(double ratio, size_t max_rects);
+    // Rects are clipped to (0, 0, width, height). Changing the bounds clears
+    // the region.
+    void SetBounds(int width, int height);
+
+    void Add(const CefRect& rect);
+    void Add(const std::vector<CefRect>& rects);
+    void Clear();
+
+    bool IsEmpty() const { return rects_.empty(); }
+    const std::vector<CefRect>& rects() const { return rects_; }
+    // Bounding box of everything added since the last Clear.
+    const CefRect& bounds() const { return bounds_; }
+
+    // Pixels covered by |rects|, overlaps counted once.
+    static int64 CoveredArea(const std::vector<CefRect>& rects);
+
+private:
+    void Insert(CefRect rect);
+    void CollapseIfDense();
+
+    int tile_width_;
+    int tile_height_;
+    double bounding_box_ratio_;
+    size_t max_rects_;
+    int width_;
+    int height_;
+
+    std::vector<CefRect> rects_;
+    CefRect bounds_;
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_DAMAGE_REGION_H_
@@ -0,0 +1,78 @@
+/**
+ * @file frame_clock.h
+ *
+ * @breif Process-wide frame tick shared by all offscreen browsers
+ */
+#ifndef CEF_TESTS_CEFCLIENT_FRAME_CLOCK_H_
+#define CEF_TESTS_CEFCLIENT_FRAME_CLOCK_H_
+#pragma once
+
+#include <vector>
+
+#include <include/cef_base.h>
+
+class FrameScheduler;
+
+// Drives the FrameSchedulers of all offscreen browsers from a single delayed
+// task on the UI thread, so the UI thread wakes up once per frame however
+// many browsers present in it. Ticks are aligned to a fixed grid at the clock
+// rate; a scheduler due within half an interval of a tick runs in that tick.
+//
+// Due schedulers run in priority order. Once the presents of a tick took
+// longer than the frame budget, the remaining schedulers below the highest
+// priority are deferred to the next tick, where they run before the ones
+// that were not deferred. Must only be used on the UI thread.
+class FrameClock : public CefBase {
+public:
+    enum Priority {
+        PRIORITY_BACKGROUND = 0,
+        PRIORITY_VISIBLE = 1,
+    };
+
+    static const int kDefaultFrameRate = 60;
+    static const int64 kDefaultFrameBudget = 8000;
+
+    static CefRefPtr<FrameClock> GetInstance();
+
+    // Tick rate, caps the rate of every scheduler.
+    void SetFrameRate(int fps);
+    // Microseconds of presents per tick before lower priority schedulers
+    // are deferred.
+    void SetFrameBudget(int64 budget_us) { budget_us_ = budget_us; }
+    // Presents deferred because of the budget since startup.
+    uint64 deferred_count() const { return deferred_count_; }
+
+    // Make sure |scheduler| runs in the first tick at or after its due time.
+    void Schedule(FrameScheduler* scheduler);
+    // Forget |scheduler|, once stopped.
+    void Unschedule(FrameScheduler* scheduler);
+
+    static int64 NowMicros();
+
+private:
+    FrameClock();
+
+    // Order of the due schedulers: priority first, then the ones deferred
+    // the most often, so that background browsers are not starved.
+    static bool RunsBefore(const CefRefPtr<FrameScheduler>& a,
+                           const CefRefPtr<FrameScheduler>& b);
+
+    void ScheduleWakeup(int64 due);
+    void OnTick(int generation);
+
+    int64 interval_;
+    int64 budget_us_;
+    // Phase of the tick grid, in microseconds of a monotonic clock.
+    int64 phase_;
+    // Unordered, each scheduler knows its index.
+    std::vector<CefRefPtr<FrameScheduler> > schedulers_;
+    // Bumped for every posted wakeup, stale wakeups are ignored.
+    int generation_;
+    bool wakeup_pending_;
+    int64 wakeup_time_;
+    uint64 deferred_count_;
+
+    IMPLEMENT_REFCOUNTING(FrameClock);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_FRAME_CLOCK_H_
@@ -0,0 +1,115 @@
+/**
+ * @file frame_mailbox.h
+ *
+ * @breif Triple-buffered handoff of offscreen frames to a consumer thread
+ */
+#ifndef CEF_TESTS_CEFCLIENT_FRAME_MAILBOX_H_
+#define CEF_TESTS_CEFCLIENT_FRAME_MAILBOX_H_
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <include/cef_base.h>
+
+#include "damage_history.h"
+#include "offscreen_surface.h"
+
+// A frame handed over to the consumer thread.
+struct OffScreenFrame {
+    OffScreenFrame() : sequence(0), paint_time(0) {}
+
+    OffScreenSurface surface;
+    // Pixels changed since the previous frame the consumer received. Frames
+    // skipped in between are accounted for.
+    std::vector<CefRect> damage;
+    // Number of the frame, starting at 1.
+    uint64 sequence;
+    // Publish time in microseconds of a monotonic clock.
+    int64 paint_time;
+};
+
+// Paint-to-consume latency of the frames handed over so far.
+struct FrameLatencyStats {
+    uint64 published;
+    uint64 consumed;
+    // Frames replaced by a newer one before the consumer got to them.
+    uint64 skipped;
+    int64 last_us;
+    int64 max_us;
+    int64 average_us;
+};
+
+// Hands frames from the UI thread to a dedicated consumer thread through
+// three pooled surfaces. The producer fills the back surface and swaps it
+// with the middle one with a single atomic exchange; the consumer swaps the
+// middle surface with its front one when a newer frame is there, so stale
+// frames are skipped and neither side ever waits for the other.
+class FrameMailbox {
+public:
+    class Consumer {
+    public:
+        virtual ~Consumer() {}
+        // Called on the consumer thread with the newest frame. |frame| must
+        // not be accessed after the call returns.
+        virtual void Consume(const OffScreenFrame& frame) = 0;
+    };
+
+    explicit FrameMailbox(Consumer* consumer);
+    // Stops the consumer thread.
+    ~FrameMailbox();
+
+    // Copy the pixels of |source| that the back surface misses, |damage|
+    // included, and publish it as the newest frame. Producer thread only.
+    void Publish(const OffScreenSurface& source,
+                 const std::vector<CefRect>& damage);
+
+    // Safe to call from any thread.
+    FrameLatencyStats GetLatencyStats() const;
+
+private:
+    static const int kSlotCount = 3;
+    static const int kIndexMask = 0x3;
+    static const int kFreshBit = 0x4;
+
+    void ThreadMain();
+    void Ring();
+
+    Consumer* consumer_;
+    OffScreenFrame slots_[kSlotCount];
+
+    // Producer state.
+    int back_;
+    uint64 slot_sequence_[kSlotCount];
+    uint64 published_;
+    // Slots or consumers lagging further behind get a full frame.
+    DamageHistory history_;
+
+    // Consumer state.
+    int front_;
+
+    // Index of the middle slot, with kFreshBit set until it is consumed.
+    std::atomic<int> middle_;
+    std::atomic<uint64> consumed_sequence_;
+    std::atomic<bool> running_;
+    std::atomic<int> doorbell_;
+
+    std::atomic<uint64> stats_published_;
+    std::atomic<uint64> stats_consumed_;
+    std::atomic<uint64> stats_skipped_;
+    std::atomic<int64> stats_last_us_;
+    std::atomic<int64> stats_max_us_;
+    std::atomic<int64> stats_total_us_;
+
+#if defined(OS_WIN)
+    void* wake_event_;
+#endif
+    std::thread thread_;
+
+    // Not copyable.
+    FrameMailbox(const FrameMailbox&);
+    FrameMailbox& operator=(const FrameMailbox&);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_FRAME_MAILBOX_H_
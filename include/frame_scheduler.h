@@ -0,0 +1,98 @@
+/**
+ * @file frame_scheduler.h
+ *
+ * @breif Adaptive frame pacing for offscreen browsers
+ */
+#ifndef CEF_TESTS_CEFCLIENT_FRAME_SCHEDULER_H_
+#define CEF_TESTS_CEFCLIENT_FRAME_SCHEDULER_H_
+#pragma once
+
+#include <include/cef_base.h>
+
+// Paces the presents of an offscreen browser. All the damage reported within
+// one frame interval is presented by a single OnBeginFrame call. After
+// |idle_threshold| frames without damage the scheduler drops to the idle
+// rate, and damage or input bring it back to the full rate immediately.
+// Ticks come from the process-wide FrameClock, so the schedulers of all
+// browsers present together. Must only be used on the UI thread.
+class FrameScheduler : public CefBase {
+public:
+    class Delegate {
+    public:
+        virtual ~Delegate() {}
+        // Called once per frame interval when damage is pending.
+        virtual void OnBeginFrame() = 0;
+    };
+
+    static const int kDefaultFrameRate = 60;
+    static const int kDefaultIdleFrameRate = 1;
+    static const int kDefaultIdleThreshold = 30;
+
+    explicit FrameScheduler(Delegate* delegate);
+
+    // Target rate while content changes.
+    void SetFrameRate(int fps);
+    int frame_rate() const { return frame_rate_; }
+    // Rate used after |idle_threshold| frames without damage. Zero stops
+    // ticking until the next damage or input.
+    void SetIdleFrameRate(int fps, int idle_threshold);
+
+    // Damage is pending, present it with the next frame.
+    void SetNeedsFrame();
+    // Input was received, expect damage soon and leave the idle rate.
+    void NotifyInput();
+    // Stop ticking until Resume. Damage reported meanwhile is kept and
+    // presented right after Resume.
+    void Pause();
+    void Resume();
+    // Detach the delegate and stop ticking.
+    void Stop();
+
+    // FrameClock::Priority of the presents, visible browsers should use
+    // PRIORITY_VISIBLE so that their presents are never deferred.
+    void SetPriority(int priority) { priority_ = priority; }
+    int priority() const { return priority_; }
+
+    bool IsPaused() const { return paused_; }
+    bool IsIdle() const { return idle_frames_ >= idle_threshold_; }
+    bool IsStopped() const { return delegate_ == NULL; }
+
+private:
+    friend class FrameClock;
+
+    // Microseconds of the current frame interval.
+    int64 GetInterval() const;
+    void ScheduleTick(int64 delay_us);
+
+    // FrameClock interface.
+    bool IsTickPending() const { return tick_pending_; }
+    int64 tick_time() const { return tick_time_; }
+    int deferred_frames() const { return deferred_frames_; }
+    // Run the due tick.
+    void OnTick();
+    // The clock ran out of frame budget, stay due for the next tick.
+    void Defer() { ++deferred_frames_; }
+
+    Delegate* delegate_;
+    int frame_rate_;
+    int idle_frame_rate_;
+    int idle_threshold_;
+
+    int priority_;
+    bool paused_;
+    bool needs_frame_;
+    int idle_frames_;
+    // Ticks deferred by the clock since the last one that ran.
+    int deferred_frames_;
+    bool tick_pending_;
+    // Due time of the pending tick and start of the last frame, both in
+    // microseconds of a monotonic clock.
+    int64 tick_time_;
+    int64 last_frame_time_;
+    // Index in the schedulers of the clock, -1 when not registered there.
+    int clock_index_;
+
+    IMPLEMENT_REFCOUNTING(FrameScheduler);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_FRAME_SCHEDULER_H_
@@ -0,0 +1,36 @@
+/**
+ * @file latency_counter.h
+ *
+ * @breif Count, last, maximum and average of measured latencies
+ */
+#ifndef CEF_TESTS_CEFCLIENT_LATENCY_COUNTER_H_
+#define CEF_TESTS_CEFCLIENT_LATENCY_COUNTER_H_
+#pragma once
+
+#include <include/cef_base.h>
+
+// Latency in microseconds of one kind of operation.
+struct Latency {
+    uint64 count;
+    int64 last_us;
+    int64 max_us;
+    int64 average_us;
+};
+
+// Accumulates latencies for stats. Not thread safe, callers keep it under
+// their own lock.
+class LatencyCounter {
+public:
+    LatencyCounter() : count_(0), last_us_(0), max_us_(0), total_us_(0) {}
+
+    void Add(int64 value);
+    Latency Get() const;
+
+private:
+    uint64 count_;
+    int64 last_us_;
+    int64 max_us_;
+    int64 total_us_;
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_LATENCY_COUNTER_H_
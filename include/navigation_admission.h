@@ -0,0 +1,109 @@
+/**
+ * @file navigation_admission.h
+ *
+ * @breif Caps the number of browsers loading at the same time
+ */
+#ifndef CEF_TESTS_CEFCLIENT_NAVIGATION_ADMISSION_H_
+#define CEF_TESTS_CEFCLIENT_NAVIGATION_ADMISSION_H_
+#pragma once
+
+#include <deque>
+#include <unordered_map>
+
+#include <include/cef_base.h>
+#include <include/cef_task.h>
+
+#include "latency_counter.h"
+#include "navigation_state.h"
+
+struct NavigationAdmissionStats {
+    // Browsers holding a loading slot, and navigations waiting for one.
+    int loading;
+    int queued;
+    // Navigations started at once, and those that had to wait.
+    uint64 admitted;
+    uint64 deferred;
+    // Time from queueing until a slot was given, deferred navigations only.
+    Latency queued_time;
+    // Time from getting a slot until loading stopped.
+    Latency loading_time;
+};
+
+// Admission queue for main frame navigations, shared by any number of
+// ClientHandlerImpl objects. A browser holds a slot from the moment its
+// navigation is admitted until OnLoadingStateChange reports it stopped
+// loading. While all slots are taken further navigations are queued and
+// started as slots free up, those of visible browsers, i.e. not paused,
+// first and otherwise in order. A browser has at most one queued navigation,
+// a newer one replaces it as it would have interrupted it anyway.
+//
+// A slot whose browser does not start loading within a few seconds, e.g.
+// because the navigation was a no-op, is taken back. Safe to call from any
+// thread; queued navigations run on the UI thread.
+class NavigationAdmission : public virtual CefBase {
+public:
+    explicit NavigationAdmission(int max_loading);
+    virtual ~NavigationAdmission();
+
+    // Number of browsers allowed to load at the same time, at least 1.
+    void SetMaxLoading(int max_loading);
+    int max_loading();
+
+    // Whether |browser_id| may navigate now. Gives it a slot if it holds
+    // none and one is free.
+    bool Admit(int browser_id);
+    // Run |navigation| once |browser_id| is given a slot. |state| is read to
+    // tell whether the browser is visible.
+    void Defer(int browser_id, CefRefPtr<NavigationStateCell> state,
+               CefRefPtr<CefTask> navigation);
+    // Drop the queued navigation of |browser_id|, if any.
+    void Cancel(int browser_id);
+
+    // Called by the clients of the browsers.
+    void OnLoadingStateChange(int browser_id, bool is_loading);
+    void OnBrowserClosed(int browser_id);
+
+    NavigationAdmissionStats GetStats();
+
+private:
+    struct Slot {
+        // Time the slot was given, in microseconds.
+        int64 since;
+        bool started;
+        // Tells the start timeouts of successive slots of a browser apart.
+        int generation;
+    };
+    struct Pending {
+        int browser_id;
+        CefRefPtr<NavigationStateCell> state;
+        CefRefPtr<CefTask> navigation;
+        int64 since;
+    };
+    typedef std::deque<Pending> PendingQueue;
+
+    // Give a slot to |browser_id|. Called with the lock held.
+    void Grant(int browser_id, int64 now);
+    void Release(int browser_id);
+    // Start queued navigations while slots are free.
+    void Dispatch();
+    void OnStartTimeout(int browser_id, int generation);
+
+    int max_loading_;
+    int generation_;
+    std::unordered_map<int, Slot> slots_;
+    PendingQueue queue_;
+
+    uint64 admitted_;
+    uint64 deferred_;
+    LatencyCounter queued_time_;
+    LatencyCounter loading_time_;
+
+    IMPLEMENT_REFCOUNTING(NavigationAdmission);
+    IMPLEMENT_LOCKING(NavigationAdmission);
+
+    // Not copyable.
+    NavigationAdmission(const NavigationAdmission&);
+    NavigationAdmission& operator=(const NavigationAdmission&);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_NAVIGATION_ADMISSION_H_
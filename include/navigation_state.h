@@ -0,0 +1,68 @@
+/**
+ * @file navigation_state.h
+ *
+ * @breif Navigation state snapshots readable from any thread without a lock
+ */
+#ifndef CEF_TESTS_CEFCLIENT_NAVIGATION_STATE_H_
+#define CEF_TESTS_CEFCLIENT_NAVIGATION_STATE_H_
+#pragma once
+
+#include <atomic>
+
+#include <include/cef_base.h>
+
+// Plain copy of the navigation and loading state of one browser.
+struct NavigationState {
+    // Longest title kept, in UTF-8 bytes. Longer titles are cut at a
+    // character boundary.
+    static const size_t kMaxTitleLength = 511;
+
+    NavigationState();
+
+    // Number of changes published before this one, starting at 1. 0 if
+    // nothing was published yet.
+    uint32 sequence;
+    // 0 if there is no browser, e.g. after it closed.
+    int browser_id;
+    bool is_loading;
+    bool can_go_back;
+    bool can_go_forward;
+    bool is_crashed;
+    bool is_paused;
+    // NUL-terminated UTF-8.
+    char title[kMaxTitleLength + 1];
+
+    CefString GetTitle() const { return CefString(title); }
+    void SetTitle(const CefString& value);
+};
+
+// Holds the latest NavigationState of a browser. One thread publishes, any
+// number of threads read. Readers copy the state under a sequence lock and
+// retry if a change raced with the copy, so they never block the writer,
+// never take a lock and never see a half written state.
+class NavigationStateCell : public virtual CefBase {
+public:
+    NavigationStateCell();
+
+    // Replace the state, |state.sequence| is ignored. Writer thread only.
+    void Publish(const NavigationState& state);
+
+    // Consistent copy of the latest state. Safe to call from any thread.
+    void Read(NavigationState& state) const;
+
+    // Number of states published so far. Pollers compare it with the
+    // sequence of their last copy to skip work when nothing changed. Safe to
+    // call from any thread.
+    uint32 sequence() const {
+        return lock_.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    // Odd while Publish writes |state_|.
+    std::atomic<uint32> lock_;
+    NavigationState state_;
+
+    IMPLEMENT_REFCOUNTING(NavigationStateCell);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_NAVIGATION_STATE_H_
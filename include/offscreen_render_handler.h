@@ -11,9 +11,19 @@
 #include <include/cef_render_handler.h>
 
 #include "client_handler_impl.h"
-
-
-class OffScreenRenderHandler : public ClientHandlerImpl::RenderHandler
+#include "converted_surface.h"
+#include "damage_region.h"
+#include "frame_mailbox.h"
+#include "frame_scheduler.h"
+#include "offscreen_surface.h"
+#include "shared_frame_ring.h"
+#include "thumbnail_pyramid.h"
+#include "tile_hash_grid.h"
+
+
+class OffScreenRenderHandler : public ClientHandlerImpl::RenderHandler,
+                               public FrameScheduler::Delegate,
+                               public FrameMailbox::Consumer
 {
 public:
     // Wrapper class for the underlying window of this offscreen browser, used
@@ -27,14 +37,30 @@ public:
         virtual void GetScreenPoint(int viewX, int viewY, int& screenX,
                                     int& screenY) = 0;
         virtual void SetCursor(CefCursorHandle cursor) = 0;
+        // Screen the window is on, return false to use the defaults of
+        // the browser.
+        virtual bool GetScreenInfo(CefScreenInfo& screen_info) {
+            return false;
+        }
     };
 
     // Wrapper class for the offscreen renderer, to update and/or render new
-    // pixel buffer of the browser.
+    // pixel buffer of the browser. |surface| is owned by the handler and only
+    // the pixels covered by |damage| changed since the previous call. The
+    // surface must not be accessed after Render returns. Called on the UI
+    // thread, or on the render thread of a threaded renderer.
     class RendererWrapper {
     public:
-        virtual void Render(const std::vector<CefRect>& dirty_rects,
-                            const void* buffer, int width, int height) = 0;
+        virtual void Render(const OffScreenSurface& surface,
+                            const std::vector<CefRect>& damage) = 0;
+    };
+
+    // Presents of the view since the handler was created.
+    struct PresentStats {
+        // Presents that reached the renderer.
+        uint64 presented;
+        // Presents dropped because the damage repainted identical pixels.
+        uint64 suppressed;
     };
 
     // Create a new OffScreenRenderHandler instance.
@@ -45,6 +71,10 @@ public:
 
     // ClientHandler::RenderHandler methods
     virtual void OnBeforeClose(CefRefPtr<CefBrowser> browser) OVERRIDE;
+    virtual void OnResize(CefRefPtr<CefBrowser> browser,
+                          int width, int height) OVERRIDE;
+    virtual void OnPauseRendering(CefRefPtr<CefBrowser> browser) OVERRIDE;
+    virtual void OnResumeRendering(CefRefPtr<CefBrowser> browser) OVERRIDE;
 
     // CefRenderHandler methods
     virtual bool GetRootScreenRect(CefRefPtr<CefBrowser> browser,
@@ -56,6 +86,8 @@ public:
                                 int viewY,
                                 int& screenX,
                                 int& screenY) OVERRIDE;
+    virtual bool GetScreenInfo(CefRefPtr<CefBrowser> browser,
+                               CefScreenInfo& screen_info) OVERRIDE;
     virtual void OnPopupShow(CefRefPtr<CefBrowser> browser,
                              bool show) OVERRIDE;
     virtual void OnPopupSize(CefRefPtr<CefBrowser> browser,
@@ -69,29 +101,144 @@ public:
     virtual void OnCursorChange(CefRefPtr<CefBrowser> browser,
                                 CefCursorHandle cursor) OVERRIDE;
 
+    // Present the whole view with the next frame, even if redundant paints
+    // are suppressed and the content did not change.
     void Invalidate();
+    // Tell the frame scheduler that input was sent to the browser, so that
+    // the damage it causes is presented at the full frame rate.
+    void NotifyInput();
+
+    // Presents are paced at |fps| while the content changes, and drop to
+    // |idle_fps| after |idle_threshold| frames without damage.
+    void SetFrameRate(int fps);
+    void SetIdleFrameRate(int idle_fps, int idle_threshold);
+    // Presents of visible browsers go first in each tick of the shared
+    // FrameClock; the others may be deferred when the frame budget runs out.
+    // Browsers are visible by default.
+    void SetVisible(bool visible);
+
+    // Dirty rects are snapped to |tile_width| x |tile_height| tiles and
+    // merged, and collapse to their bounding box once they cover at least
+    // |bounding_box_ratio| of it. See DamageRegion.
+    void SetDamageCoalescing(int tile_width, int tile_height,
+                             double bounding_box_ratio);
+
+    // Hash the view per tile and drop presents whose damage left every
+    // tile unchanged; other presents only report the changed tiles.
+    // Disabled by default.
+    void SetRedundantPaintSuppression(bool enabled);
+    PresentStats GetPresentStats() const { return present_stats_; }
+
+    // Pixel buffers are kept while paused as long as they take no more than
+    // |bytes| in total, otherwise they are released and reallocated by the
+    // full repaint on resume. Defaults to 0, i.e. always release.
+    void SetPausedMemoryBudget(size_t bytes) { paused_memory_budget_ = bytes; }
 
     void SetWindow(WindowWrapper* window) { window_ = window; }
-    void SetRenderer(RendererWrapper* renderer) { renderer_ = renderer; }
+    // With |threaded| the renderer is called on a dedicated render thread
+    // that always picks up the newest frame, so a slow renderer never blocks
+    // the CEF UI thread.
+    void SetRenderer(RendererWrapper* renderer, bool threaded=false);
+    // Paint-to-render latency of the threaded renderer.
+    FrameLatencyStats GetFrameLatencyStats() const;
+
+    // Keep a copy of the view in |format|, converted before each Render for
+    // the damaged parts only. Opaque browsers skip the alpha conversion.
+    void SetOutputFormat(PixelFormat format, bool enabled);
+    // The copy of the frame being rendered in |format|, NULL if the format
+    // is not enabled. Only valid from within RendererWrapper::Render.
+    const ConvertedSurface* GetConvertedSurface(PixelFormat format) const;
+
+    // Keep |levels| box-filtered thumbnails of the view at 1/2, 1/4, ...
+    // of its size, updated with each presented frame for the damaged blocks
+    // only. 0 disables them.
+    void SetThumbnailLevels(int levels);
+    // The thumbnails, NULL when disabled. They keep the last frame while
+    // rendering is paused. UI thread only.
+    const ThumbnailPyramid* GetThumbnails() const { return thumbnails_; }
+
+    // Export every presented frame to the shared memory ring |name|, so that
+    // another process can read it with SharedFrameReader. Views larger than
+    // |max_width| x |max_height| are not exported.
+    bool StartFrameExport(const std::string& name, int max_width,
+                          int max_height);
+    void StopFrameExport();
 
 private:
     OffScreenRenderHandler(bool transparent=true);
     virtual ~OffScreenRenderHandler();
 
-    void Render();
+    // FrameScheduler::Delegate methods
+    virtual void OnBeginFrame() OVERRIDE;
+
+    // FrameMailbox::Consumer methods
+    virtual void Consume(const OffScreenFrame& frame) OVERRIDE;
+
+    // Update the enabled output formats and call the renderer.
+    void RenderFrame(const OffScreenSurface& surface,
+                     const std::vector<CefRect>& damage);
+
     void OnDestroyed();
+    // Free the pixel buffers and forget the popup.
+    void ReleaseSurfaces();
+    // Queue |damage| for the next frame.
+    void AddDamage(const std::vector<CefRect>& damage);
+    // Popup rect clipped to the view, empty if no popup is shown.
+    CefRect GetPopupViewRect() const;
+    // Composite the popup over the view surface inside |rect|, which is in
+    // view coordinates and within GetPopupViewRect().
+    void CompositePopup(const CefRect& rect);
+    // Copy the saved view pixels inside |rect| back to the view surface.
+    void RestorePopupUnderlay(const CefRect& rect);
     bool IsOverPopupWidget(int x, int y) const;
     int GetPopupXOffset() const;
     int GetPopupYOffset() const;
     void ApplyPopupOffset(int& x, int& y) const;
 
     bool transparent_;
-    bool popup_painting_;
-    bool render_task_pending_;
+    // True once |popup_surface_| holds pixels of the current popup.
+    bool popup_painted_;
+    bool paused_;
     CefRect popup_rect_;
 
+    // View size set with OnResize, overrides the size of the window wrapper.
+    int view_width_;
+    int view_height_;
+    size_t paused_memory_budget_;
+
+    // Retained copy of the view, only dirty rows are refreshed on paint. It
+    // holds the popup composited on top while one is shown.
+    OffScreenSurface view_surface_;
+    // Pixels of the popup widget, sized from OnPopupSize.
+    OffScreenSurface popup_surface_;
+    // View pixels below |popup_rect_|, used to blend the popup and to restore
+    // the view when the popup moves or hides.
+    OffScreenSurface popup_underlay_;
+
+    // Snap and merge settings for the damage of paints and presents.
+    int damage_tile_width_;
+    int damage_tile_height_;
+    double damage_bounding_box_ratio_;
+    // Damage accumulated since the last present.
+    DamageRegion pending_damage_;
+    bool suppress_redundant_paints_;
+    // Tile hashes as of the last present and the damage that changed them.
+    TileHashGrid tile_hashes_;
+    std::vector<CefRect> changed_damage_;
+    PresentStats present_stats_;
+    CefRefPtr<FrameScheduler> scheduler_;
+
     WindowWrapper* window_;
     RendererWrapper* renderer_;
+    // Hands frames to the render thread of a threaded renderer.
+    FrameMailbox* mailbox_;
+    // Output formats of SetOutputFormat, NULL when disabled. Updated by
+    // whichever thread calls the renderer.
+    ConvertedSurface* converted_surfaces_[PIXEL_FORMAT_COUNT];
+    // Downscaled copies of the view, NULL when disabled.
+    ThumbnailPyramid* thumbnails_;
+    // Shared memory ring of StartFrameExport, NULL when not exporting.
+    SharedFrameWriter* exporter_;
 
     IMPLEMENT_REFCOUNTING(OffScreenRenderHandler);
 };
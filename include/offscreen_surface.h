@@ -0,0 +1,61 @@
+/**
+ * @file offscreen_surface.h
+ *
+ * @breif Retained BGRA pixel surface owned by the offscreen render handler
+ */
+#ifndef CEF_TESTS_CEFCLIENT_OFFSCREEN_SURFACE_H_
+#define CEF_TESTS_CEFCLIENT_OFFSCREEN_SURFACE_H_
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include <include/cef_base.h>
+
+// A BGRA pixel buffer that keeps its content between paints, so that only the
+// damaged parts have to be refreshed. Rows are |stride()| bytes apart and the
+// storage is 64-byte aligned.
+class OffScreenSurface {
+public:
+    OffScreenSurface();
+    ~OffScreenSurface();
+
+    // Make the surface |width| x |height|. Returns true if the storage was
+    // reallocated, in which case the content is undefined.
+    bool Resize(int width, int height);
+    // Free the storage. The surface becomes empty.
+    void Release();
+
+    // Copy the parts of |buffer| covered by |rects| into this surface. The
+    // rects must already be clipped to the surface bounds.
+    void CopyFrom(const void* buffer, int stride,
+                  const std::vector<CefRect>& rects);
+
+    bool IsEmpty() const { return data_ == NULL; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int stride() const { return stride_; }
+    size_t size() const { return static_cast<size_t>(stride_) * height_; }
+    const void* data() const { return data_; }
+    void* data() { return data_; }
+
+    // Address of the pixel at (|x|, |y|).
+    const void* pixel(int x, int y) const {
+        return data_ + static_cast<size_t>(y) * stride_ + x * 4;
+    }
+    void* pixel(int x, int y) {
+        return data_ + static_cast<size_t>(y) * stride_ + x * 4;
+    }
+
+private:
+    int width_;
+    int height_;
+    int stride_;
+    unsigned char* data_;
+
+    // Not copyable.
+    OffScreenSurface(const OffScreenSurface&);
+    OffScreenSurface& operator=(const OffScreenSurface&);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_OFFSCREEN_SURFACE_H_
@@ -0,0 +1,83 @@
+/**
+ * @file pixel_util.h
+ *
+ * @breif Pixel copy kernels used by the offscreen rendering path
+ */
+#ifndef CEF_TESTS_CEFCLIENT_PIXEL_UTIL_H_
+#define CEF_TESTS_CEFCLIENT_PIXEL_UTIL_H_
+#pragma once
+
+#include <stddef.h>
+
+#include <include/cef_base.h>
+
+namespace util {
+
+// Bytes per pixel of the BGRA buffers delivered by CefRenderHandler::OnPaint.
+const int kBytesPerPixel = 4;
+
+// 64-byte aligned pixel storage, NULL on failure. Free with FreeAligned.
+unsigned char* AllocAligned(size_t size);
+void FreeAligned(unsigned char* ptr);
+
+// True if the CPU and the OS support AVX2. The conversion kernels below
+// pick their AVX2 variant at runtime based on this.
+bool HasAVX2();
+
+// Copy |bytes| bytes of one pixel row. Uses SSE2 when available.
+void CopyRow(void* dst, const void* src, size_t bytes);
+
+// Copy |rows| rows of |row_bytes| bytes each between two strided buffers.
+void CopyRows(void* dst, int dst_stride, const void* src, int src_stride,
+              size_t row_bytes, int rows);
+
+// Composite |count| premultiplied BGRA pixels of |src| over |under| with the
+// source-over operator and store the result in |dst|. Uses SSE2 when
+// available.
+void BlendRow(void* dst, const void* src, const void* under, int count);
+
+// BlendRow for |rows| rows of |width| pixels each.
+void BlendRows(void* dst, int dst_stride, const void* src, int src_stride,
+               const void* under, int under_stride, int width, int rows);
+
+// Swap the red and blue channels of |count| pixels, BGRA to RGBA.
+void SwizzleRow(void* dst, const void* src, int count);
+
+// Convert |count| premultiplied BGRA pixels to straight alpha, also swapping
+// red and blue if |swap_rb| is true.
+void UnpremultiplyRow(void* dst, const void* src, int count, bool swap_rb);
+
+// Pack |count| BGRA pixels into 3-byte RGB, dropping the alpha channel.
+void PackRgbRow(void* dst, const void* src, int count);
+
+// BT.601 limited range luma of |count| BGRA pixels, one byte each.
+void ExtractYRow(void* dst, const void* src, int count);
+
+// BT.601 limited range chroma of the 2x2 blocks of the BGRA rows |row0| and
+// |row1|, |count| pixels wide. Each block yields one U and one V byte,
+// stored |step| bytes apart in |dst_u| and |dst_v| (1 for planar, 2 for
+// interleaved output). An odd last pixel pairs with itself.
+void ExtractUVRow(void* dst_u, void* dst_v, int step, const void* row0,
+                  const void* row1, int count);
+
+// Box-filter the BGRA rows |row0| and |row1|, |count| pixels wide, to half
+// width: each 2x2 block becomes the rounded average of its pixels. Writes
+// (count + 1) / 2 pixels, an odd last pixel pairs with itself. Uses SSE2 when
+// available.
+void ReduceRow2x2(void* dst, const void* row0, const void* row1, int count);
+
+// Copy the pixels covered by |rect| from |src| to |dst|. Both buffers are
+// BGRA, addressed with the same coordinates and their own row strides.
+void CopyRect(void* dst, int dst_stride, const void* src, int src_stride,
+              const CefRect& rect);
+
+// Intersection of |a| and |b|, empty if they do not overlap.
+CefRect IntersectRect(const CefRect& a, const CefRect& b);
+
+// Clip |rect| to the (0, 0, width, height) bounds. Returns false if nothing is
+// left after clipping.
+bool ClipRect(CefRect& rect, int width, int height);
+
+}  // namespace util
+
+#endif  // CEF_TESTS_CEFCLIENT_PIXEL_UTIL_H_
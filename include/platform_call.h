@@ -0,0 +1,97 @@
+/**
+ * @file platform_call.h
+ *
+ * @breif Browser side of platform.call, the request/response bridge
+ */
+#ifndef CEF_TESTS_CEFCLIENT_PLATFORM_CALL_H_
+#define CEF_TESTS_CEFCLIENT_PLATFORM_CALL_H_
+#pragma once
+
+#include <map>
+#include <string>
+#include <utility>
+
+#include <include/cef_browser.h>
+#include <include/cef_process_message.h>
+#include <include/cef_task.h>
+#include <include/cef_values.h>
+
+// Handler of the calls of one name, platform.call(name, ...args) in
+// JavaScript.
+class PlatformCallHandler : public virtual CefBase {
+public:
+    // Answer of one call, given exactly once from any thread. Answers to
+    // calls cancelled by the page or by the browser closing are dropped.
+    class Callback : public virtual CefBase {
+    public:
+        // Resolve the promise with the first value of |result|, undefined if
+        // it is empty.
+        virtual void Success(CefRefPtr<CefListValue> result) =0;
+        // Reject the promise with an Error of message |error|.
+        virtual void Failure(const CefString& error) =0;
+        // Whether the answer is no longer expected. Long running handlers
+        // may poll it to stop early.
+        virtual bool IsCancelled() =0;
+    };
+
+    // Called on the thread the handler was added for with the arguments of
+    // the call. May return before |callback| is answered.
+    virtual void OnCall(CefRefPtr<CefBrowser> browser,
+                        const CefString& name,
+                        CefRefPtr<CefListValue> args,
+                        CefRefPtr<Callback> callback) =0;
+};
+
+// Handlers of platform.call by name, and the calls they have not answered
+// yet. Every call runs as a task of its own, so a slow call does not hold
+// back the others; handlers added for another thread than the UI one, e.g.
+// TID_FILE for blocking work, run off the UI thread. Calls are timed out and
+// cancelled on the renderer side.
+class PlatformCallRegistry : public virtual CefBase {
+public:
+    PlatformCallRegistry();
+    virtual ~PlatformCallRegistry();
+
+    // Run the calls of |name| with |handler| on |thread|, replacing any
+    // handler of that name.
+    void AddHandler(const std::string& name,
+                    CefRefPtr<PlatformCallHandler> handler,
+                    CefThreadId thread);
+    void RemoveHandler(const std::string& name);
+
+    // Handle the call messages sent by the renderer. Returns false for other
+    // messages. UI thread.
+    bool OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
+                                  CefRefPtr<CefProcessMessage> message);
+    // Cancel the calls of |browser|. UI thread.
+    void OnBeforeClose(CefRefPtr<CefBrowser> browser);
+
+private:
+    class Callback;
+    friend class Callback;
+
+    struct Registration {
+        Registration() : thread(TID_UI) {}
+        CefRefPtr<PlatformCallHandler> handler;
+        CefThreadId thread;
+    };
+    // Calls not answered yet, by browser id and call id.
+    typedef std::pair<int, int> CallKey;
+    typedef std::map<CallKey, CefRefPtr<Callback> > CallMap;
+
+    // Forget the call |key|. Returns false if it was cancelled or answered.
+    bool Finish(const CallKey& key);
+    void Cancel(const CallKey& key);
+
+    std::map<std::string, Registration> handlers_;
+    CallMap calls_;
+
+    IMPLEMENT_REFCOUNTING(PlatformCallRegistry);
+    IMPLEMENT_LOCKING(PlatformCallRegistry);
+
+    // Not copyable.
+    PlatformCallRegistry(const PlatformCallRegistry&);
+    PlatformCallRegistry& operator=(const PlatformCallRegistry&);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_PLATFORM_CALL_H_
@@ -0,0 +1,259 @@
+/**
+ * @file platform_events.h
+ *
+ * @breif Interned event names and listeners of the platform object
+ */
+#ifndef CEF_TESTS_CEFCLIENT_PLATFORM_EVENTS_H_
+#define CEF_TESTS_CEFCLIENT_PLATFORM_EVENTS_H_
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include <include/cef_base.h>
+#include <include/cef_v8.h>
+
+// Id of an interned event name, dense from 1. Ids are local to the process
+// interning the names; messages between processes still carry names.
+typedef uint32 PlatformEventId;
+const PlatformEventId kNoPlatformEvent = 0;
+
+// Names of the events of platform.bind and platform.emit. Each name is
+// given an id once, together with the name of its platform messages, so
+// that neither has to be built again. Lookups take the characters of a
+// CefString, e.g. the tail of a message name, and do not copy them.
+class PlatformEventTable {
+public:
+    typedef CefString::char_type CharType;
+
+    PlatformEventTable();
+
+    // Id of |name|, given on first use.
+    PlatformEventId Intern(const CefString& name);
+    // Id of |name|, kNoPlatformEvent if it was never interned.
+    PlatformEventId Find(const CharType* name, size_t length) const;
+    PlatformEventId Find(const CefString& name) const {
+        return Find(name.c_str(), name.length());
+    }
+    // Id of the event of the platform message |message_name|,
+    // kNoPlatformEvent for other messages or events never interned.
+    PlatformEventId FindMessage(const CefString& message_name) const;
+
+    // Name of event |id|, and of its platform messages. |id| must be valid.
+    const CefString& GetName(PlatformEventId id) const {
+        return events_[id - 1].name;
+    }
+    const CefString& GetMessageName(PlatformEventId id) const {
+        return events_[id - 1].message_name;
+    }
+
+    size_t size() const { return events_.size(); }
+
+private:
+    struct Event {
+        CefString name;
+        CefString message_name;
+        uint32 hash;
+    };
+
+    static uint32 Hash(const CharType* name, size_t length);
+    // Double the slots, or allocate the first ones.
+    void Grow();
+
+    // Events by id - 1.
+    std::vector<Event> events_;
+    // Open addressing table of ids, kNoPlatformEvent for empty slots. Its
+    // size is a power of two.
+    std::vector<PlatformEventId> slots_;
+};
+
+// Flat open addressing hash map from (event, browser id) to |T|, for the
+// listeners of platform events. Lookups do not allocate and touch one slot
+// array only.
+template <typename T>
+class PlatformBindingMap {
+public:
+    PlatformBindingMap() : size_(0) {}
+
+    // Value of |event| and |browser_id|, NULL if none.
+    T* Find(PlatformEventId event, int browser_id) {
+        if (slots_.empty())
+            return NULL;
+        const uint64 key = MakeKey(event, browser_id);
+        const size_t mask = slots_.size() - 1;
+        for (size_t i = Hash(key) & mask;; i = (i + 1) & mask) {
+            if (!slots_[i].used)
+                return NULL;
+            if (slots_[i].key == key)
+                return &slots_[i].value;
+        }
+    }
+
+    // Value of |event| and |browser_id|, default constructed if new.
+    T& Insert(PlatformEventId event, int browser_id) {
+        if ((size_ + 1) * 4 > slots_.size() * 3)
+            Rehash(slots_.empty() ? 16 : slots_.size() * 2);
+        const uint64 key = MakeKey(event, browser_id);
+        const size_t mask = slots_.size() - 1;
+        size_t i = Hash(key) & mask;
+        for (; slots_[i].used; i = (i + 1) & mask) {
+            if (slots_[i].key == key)
+                return slots_[i].value;
+        }
+        slots_[i].used = true;
+        slots_[i].key = key;
+        size_++;
+        return slots_[i].value;
+    }
+
+    // Returns false if there was no such value.
+    bool Erase(PlatformEventId event, int browser_id) {
+        if (slots_.empty())
+            return false;
+        const uint64 key = MakeKey(event, browser_id);
+        const size_t mask = slots_.size() - 1;
+        size_t i = Hash(key) & mask;
+        for (; slots_[i].used; i = (i + 1) & mask) {
+            if (slots_[i].key == key)
+                break;
+        }
+        if (!slots_[i].used)
+            return false;
+        // Shift back the following values of the probe sequence, so that
+        // lookups need no tombstones.
+        for (size_t j = (i + 1) & mask; slots_[j].used; j = (j + 1) & mask) {
+            const size_t home = Hash(slots_[j].key) & mask;
+            const bool stays = i <= j ? (i < home && home <= j)
+                                      : (i < home || home <= j);
+            if (!stays) {
+                slots_[i] = slots_[j];
+                i = j;
+            }
+        }
+        slots_[i] = Slot();
+        size_--;
+        return true;
+    }
+
+    size_t size() const { return size_; }
+
+private:
+    struct Slot {
+        Slot() : key(0), used(false), value() {}
+        uint64 key;
+        bool used;
+        T value;
+    };
+
+    static uint64 MakeKey(PlatformEventId event, int browser_id) {
+        return (static_cast<uint64>(event) << 32) |
+            static_cast<uint32>(browser_id);
+    }
+    // 64-bit finalizer of MurmurHash3.
+    static size_t Hash(uint64 key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return static_cast<size_t>(key);
+    }
+
+    void Rehash(size_t capacity) {
+        std::vector<Slot> old;
+        old.swap(slots_);
+        slots_.resize(capacity);
+        const size_t mask = capacity - 1;
+        for (size_t i = 0; i < old.size(); ++i) {
+            if (!old[i].used)
+                continue;
+            size_t j = Hash(old[i].key) & mask;
+            while (slots_[j].used)
+                j = (j + 1) & mask;
+            slots_[j] = old[i];
+        }
+    }
+
+    std::vector<Slot> slots_;
+    size_t size_;
+};
+
+// Listeners of the events of platform.bind and platform.once, by event and
+// browser. The listeners of an event are kept in one array, in the order
+// they were added, which is the order they are called in. Each context
+// keeps the keys of its own listeners, so that releasing it touches those
+// only. Renderer thread only.
+class PlatformEventBus {
+public:
+    struct Listener {
+        Listener() : id(0), frame_id(0), once(false), batch(false),
+                     coalesce(false), key(-1) {}
+
+        // Unique in the process, and the frame of |context|, given by Add.
+        int id;
+        int64 frame_id;
+        CefRefPtr<CefV8Context> context;
+        CefRefPtr<CefV8Value> callback;
+        // Removed once called.
+        bool once;
+        // Called once per burst with an array holding the argument list of
+        // each event.
+        bool batch;
+        // Of the events of a burst only the latest is delivered, or the
+        // latest per value of argument |key| when it is set.
+        bool coalesce;
+        int key;
+    };
+    typedef std::vector<Listener> ListenerList;
+
+    PlatformEventBus();
+
+    // Add |listener| after the listeners of |event| of |browser_id|, in the
+    // context of the frame |frame_id|. Returns its id.
+    int Add(PlatformEventId event, int browser_id, int64 frame_id,
+            const Listener& listener);
+    // Remove the listeners of |event| added in |context|, or those with
+    // |callback| only when set. Returns the number removed.
+    int Remove(PlatformEventId event, int browser_id,
+               CefRefPtr<CefV8Context> context,
+               CefRefPtr<CefV8Value> callback);
+    // Returns false if there was no such listener.
+    bool RemoveListener(PlatformEventId event, int browser_id,
+                        int listener_id);
+    // Remove the listeners of |context|, of the frame |frame_id|.
+    void RemoveContext(int64 frame_id, CefRefPtr<CefV8Context> context);
+
+    // Listeners of |event| of |browser_id| in order, NULL if none. Valid
+    // until listeners are added or removed.
+    const ListenerList* Find(PlatformEventId event, int browser_id) {
+        return listeners_.Find(event, browser_id);
+    }
+    const Listener* FindListener(PlatformEventId event, int browser_id,
+                                 int listener_id);
+
+private:
+    struct ListenerKey {
+        PlatformEventId event;
+        int browser_id;
+        int listener_id;
+    };
+    struct ContextListeners {
+        CefRefPtr<CefV8Context> context;
+        std::vector<ListenerKey> keys;
+    };
+
+    // Remove listener |key| from its list, and from the keys of its
+    // context when |index_context|.
+    bool Erase(const ListenerKey& key, bool index_context);
+
+    PlatformBindingMap<ListenerList> listeners_;
+    // Listeners by frame id, a frame has one context at a time.
+    std::unordered_map<int64, ContextListeners> contexts_;
+    int last_id_;
+
+    // Not copyable.
+    PlatformEventBus(const PlatformEventBus&);
+    PlatformEventBus& operator=(const PlatformEventBus&);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_PLATFORM_EVENTS_H_
@@ -0,0 +1,206 @@
+/**
+ * @file response_cache.h
+ *
+ * @breif Local cache of GET responses shared by every browser of the process
+ */
+#ifndef CEF_TESTS_CEFCLIENT_RESPONSE_CACHE_H_
+#define CEF_TESTS_CEFCLIENT_RESPONSE_CACHE_H_
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <include/cef_base.h>
+#include <include/cef_request.h>
+#include <include/cef_resource_handler.h>
+
+// Cache of http(s) GET responses in front of the network, independent of
+// Chromium's per-profile cache so that browsers with different cache paths
+// share it.
+//
+// Bodies are stored once per content under <dir>/data, named by their
+// SHA-256, so the same file served from several URLs takes space once.
+// Response metadata is stored under <dir>/index, keyed by the URL and the
+// values of the request headers named by the response's Vary header. The
+// most recently used bodies are also kept in memory, up to a byte limit.
+// The files on disk are kept within a byte budget as well: beyond it the
+// least recently used URLs are evicted, and body files no entry refers to
+// any more are deleted.
+//
+// Responses are stored when their status is 200 and Cache-Control allows
+// it, neither private nor no-store, and they set no cookie; they are fresh
+// for max-age seconds. A fresh response is served without any network I/O.
+// A stale one carrying an ETag or Last-Modified is revalidated with a
+// conditional request, and served from the cache on 304. Requests with
+// no-cache, no-store, the UR_FLAG_SKIP_CACHE flag, an Authorization or a
+// Cookie header bypass it.
+//
+// The network is reached with CefURLRequest, so this is for the browser
+// process only. It follows redirects and does not tell, so the response
+// to a redirected request is stored under the URL first asked for: callers
+// should pass navigations through, as ClientHandlerImpl does. Index and
+// body files are read and written on the FILE thread.
+class ResponseCache : public virtual CefBase {
+public:
+    struct Stats {
+        // Served from memory or disk without network I/O.
+        uint64 memory_hits;
+        uint64 disk_hits;
+        // Stale entries confirmed by a 304.
+        uint64 revalidated;
+        // Fetched from the network, and of those stored.
+        uint64 misses;
+        uint64 stored;
+        // Not cacheable requests, passed through untouched.
+        uint64 bypassed;
+        // Hits, revalidations included, over hits plus misses.
+        double hit_ratio;
+        // Bodies held in memory.
+        size_t memory_bytes;
+        size_t memory_entries;
+        // Index and body files on disk, the URLs they hold, and the URLs
+        // evicted to stay within the disk budget.
+        uint64 disk_bytes;
+        size_t disk_entries;
+        uint64 evicted;
+    };
+
+    // A cached response. Bodies are shared, never modified once stored.
+    struct Entry {
+        int status;
+        std::string status_text;
+        std::string mime_type;
+        CefRequest::HeaderMap headers;
+        // Request headers the response varies on, with their values.
+        std::vector<std::pair<std::string, std::string> > vary;
+        std::string etag;
+        std::string last_modified;
+        std::string body_name;
+        size_t body_size;
+        // Seconds since the epoch.
+        int64 expires;
+    };
+    typedef std::shared_ptr<const std::string> Body;
+
+    ResponseCache();
+    virtual ~ResponseCache();
+
+    // Use |dir| for the store, created if needed, and keep up to
+    // |memory_limit| bytes of bodies in memory and |disk_limit| bytes of
+    // files on disk. Scans the store first, deleting unreadable and
+    // unreferenced files; the URLs last written longest ago are evicted
+    // first until they are used again. Returns false if the directory
+    // cannot be created. Call before creating handlers.
+    bool Open(const std::string& dir, size_t memory_limit, uint64 disk_limit);
+
+    // Handler answering |request| through the cache, NULL if the request is
+    // not cacheable and should go to the network as usual. IO thread.
+    CefRefPtr<CefResourceHandler> CreateResourceHandler(
+        CefRefPtr<CefRequest> request);
+
+    Stats GetStats();
+
+private:
+    class Handler;
+    friend class Handler;
+
+    enum LookupResult {
+        NOT_FOUND,
+        FOUND,
+        // Not known in memory, the index files must be read.
+        NEEDS_DISK,
+    };
+
+    // Entry stored for |request|, with its body when it is in memory. With
+    // |from_disk| index and body files are read as needed. FILE thread
+    // then.
+    LookupResult Lookup(CefRefPtr<CefRequest> request, bool from_disk,
+                        Entry& entry, Body& body);
+    // Store |entry| with |body| as the response to |request|. FILE thread.
+    void Store(CefRefPtr<CefRequest> request, Entry entry, Body body);
+    // Extend the freshness of the entry of |request|. FILE thread.
+    void Refresh(CefRefPtr<CefRequest> request, int64 expires);
+    void CountHit(bool from_memory);
+    void CountRevalidated();
+    void CountMiss();
+
+    // Entries of one URL. All variants vary on the same headers.
+    struct Variants {
+        std::vector<std::string> vary_names;
+        std::unordered_map<std::string, Entry> entries;
+    };
+    // Body held in memory, in the LRU list.
+    struct MemoryBody {
+        Body body;
+        std::list<std::string>::iterator position;
+    };
+    // URL with an index file, in the disk LRU list.
+    struct StoredURL {
+        std::vector<std::string> body_names;
+        uint64 index_size;
+        std::list<std::string>::iterator position;
+    };
+    // Body file, and the number of entries referring to it.
+    struct StoredBody {
+        StoredBody() : size(0), refs(0) {}
+        uint64 size;
+        int refs;
+    };
+
+    // Index file of |url|, and body file |name|.
+    std::string GetIndexPath(const std::string& url) const;
+    std::string GetBodyPath(const std::string& name) const;
+    bool ReadIndex(const std::string& url, Variants& variants) const;
+    // Read the index file at |path|, with the URL it belongs to.
+    static bool ReadIndexFile(const std::string& path, std::string& url,
+                              Variants& variants);
+    // Write the index file of |url|, |size| bytes long.
+    bool WriteIndex(const std::string& url, const Variants& variants,
+                    uint64& size) const;
+
+    // LRU of bodies in memory, called with the lock held.
+    Body GetMemoryBody(const std::string& name);
+    void AddMemoryBody(const std::string& name, Body body);
+
+    // Accounting of the files on disk, called with the lock held. Paths of
+    // files no longer needed are added to |removed|, to be deleted once the
+    // lock is released.
+    void LoadStore(std::vector<std::string>& removed);
+    // Record the index of |url| with |variants| as the most recently used.
+    void AddStoredURL(const std::string& url, const Variants& variants,
+                      uint64 index_size, std::vector<std::string>& removed);
+    void RemoveStoredURL(const std::string& url,
+                         std::vector<std::string>& removed);
+    void ReleaseBodies(const std::vector<std::string>& names,
+                       std::vector<std::string>& removed);
+    // Evict the least recently used URLs while over |disk_limit_|.
+    void EvictStored(std::vector<std::string>& removed);
+
+    std::string dir_;
+    size_t memory_limit_;
+    size_t memory_bytes_;
+    uint64 disk_limit_;
+    uint64 disk_bytes_;
+    // Entries of the URLs in |stored_| read so far.
+    std::unordered_map<std::string, Variants> index_;
+    std::unordered_map<std::string, MemoryBody> memory_;
+    // Body names, most recently used first.
+    std::list<std::string> lru_;
+    // Every URL and body on disk. URLs, most recently used first.
+    std::unordered_map<std::string, StoredURL> stored_;
+    std::unordered_map<std::string, StoredBody> bodies_;
+    std::list<std::string> disk_lru_;
+    Stats stats_;
+
+    IMPLEMENT_REFCOUNTING(ResponseCache);
+    IMPLEMENT_LOCKING(ResponseCache);
+
+    // Not copyable.
+    ResponseCache(const ResponseCache&);
+    ResponseCache& operator=(const ResponseCache&);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_RESPONSE_CACHE_H_
@@ -0,0 +1,43 @@
+/**
+ * @file sha256.h
+ *
+ * @breif SHA-256 digests, for names that must not collide
+ */
+#ifndef CEF_TESTS_CEFCLIENT_SHA256_H_
+#define CEF_TESTS_CEFCLIENT_SHA256_H_
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+// Incremental SHA-256 (FIPS 180-4).
+class Sha256 {
+public:
+    static const size_t kDigestSize = 32;
+
+    Sha256();
+
+    void Update(const void* data, size_t size);
+    // Digest of the data given so far. The object must not be updated
+    // afterwards.
+    void Finish(unsigned char digest[kDigestSize]);
+
+    // Digest of |size| bytes at |data|, as 64 lower case hex digits.
+    static std::string HexDigest(const void* data, size_t size);
+
+private:
+    void Transform(const unsigned char block[64]);
+
+    uint32_t state_[8];
+    uint64_t length_;
+    unsigned char buffer_[64];
+    size_t buffered_;
+
+    // Not copyable.
+    Sha256(const Sha256&);
+    Sha256& operator=(const Sha256&);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_SHA256_H_
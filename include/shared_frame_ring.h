@@ -0,0 +1,160 @@
+/**
+ * @file shared_frame_ring.h
+ *
+ * @breif Export of offscreen frames to other processes through shared memory
+ */
+#ifndef CEF_TESTS_CEFCLIENT_SHARED_FRAME_RING_H_
+#define CEF_TESTS_CEFCLIENT_SHARED_FRAME_RING_H_
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include <include/cef_base.h>
+
+#include "damage_history.h"
+#include "offscreen_surface.h"
+
+// Frames are published into a named shared-memory ring of |slot_count|
+// slots. Every slot starts with a SharedFrameSlotHeader followed by the BGRA
+// pixels. A slot header is guarded by a sequence lock: it is odd while the
+// writer updates the slot, so a reader that sees the same even value before
+// and after using the pixels knows they were not overwritten meanwhile.
+// Readers map the ring read-only and use the pixels in place.
+
+const unsigned int kSharedFrameMagic = 0x52464543;  // 'CEFR'
+const unsigned int kSharedFrameVersion = 1;
+// Frames with more damage rects report their bounding box instead.
+const int kSharedFrameMaxRects = 16;
+
+struct SharedFrameRect {
+    int32 x;
+    int32 y;
+    int32 width;
+    int32 height;
+};
+
+struct SharedFrameRingHeader {
+    uint32 magic;
+    uint32 version;
+    uint32 slot_count;
+    uint32 slot_size;
+    // Offset of the pixels from the start of a slot.
+    uint32 pixels_offset;
+    uint32 max_width;
+    uint32 max_height;
+    // Bumped on every publish, readers wait on it (a futex on Linux).
+    volatile int32 doorbell;
+    // Number of the newest complete frame, 0 before the first one.
+    volatile uint64 latest_sequence;
+};
+
+struct SharedFrameSlotHeader {
+    volatile uint32 lock;
+    uint32 rect_count;
+    uint64 sequence;
+    // Publish time in microseconds of a monotonic clock.
+    int64 timestamp;
+    int32 width;
+    int32 height;
+    int32 stride;
+    int32 reserved;
+    // Damage relative to frame |sequence| - 1.
+    SharedFrameRect rects[kSharedFrameMaxRects];
+};
+
+// A frame as seen by a SharedFrameReader. |pixels| points into the mapping.
+struct SharedFrame {
+    uint64 sequence;
+    int64 timestamp;
+    int width;
+    int height;
+    int stride;
+    const void* pixels;
+    std::vector<CefRect> damage;
+
+    // Sequence lock value the frame was read with.
+    uint32 lock;
+    uint32 slot;
+};
+
+// Producer side, owned by the offscreen render handler.
+class SharedFrameWriter {
+public:
+    SharedFrameWriter();
+    ~SharedFrameWriter();
+
+    // Create the ring |name| able to hold frames up to |max_width| x
+    // |max_height|.
+    bool Create(const std::string& name, int max_width, int max_height,
+                int slot_count=3);
+    void Close();
+    bool IsOpen() const { return header_ != NULL; }
+
+    // Publish |source| as the next frame, |damage| being what changed since
+    // the previous Publish. Only the pixels the target slot misses are
+    // copied. Returns false if the frame does not fit.
+    //
+    // This is a second copy of the damage after the one of OnPaint into
+    // |source|: the paint buffer is gone by the time frames are published,
+    // and |source| is still needed by the other consumers. The slot being
+    // written was last used |slot_count| frames ago, so the copy covers the
+    // damage of those frames, not a full frame.
+    bool Publish(const OffScreenSurface& source,
+                 const std::vector<CefRect>& damage);
+
+private:
+    SharedFrameSlotHeader* GetSlot(uint32 index);
+
+    SharedFrameRingHeader* header_;
+    size_t mapping_size_;
+    uint64 published_;
+    std::vector<uint64> slot_sequence_;
+    DamageHistory history_;
+#if defined(OS_WIN)
+    void* mapping_;
+#else
+    std::string name_;
+#endif
+
+    // Not copyable.
+    SharedFrameWriter(const SharedFrameWriter&);
+    SharedFrameWriter& operator=(const SharedFrameWriter&);
+};
+
+// Reference consumer, usable from any process.
+class SharedFrameReader {
+public:
+    SharedFrameReader();
+    ~SharedFrameReader();
+
+    // Map the ring |name| read-only.
+    bool Open(const std::string& name);
+    void Close();
+    bool IsOpen() const { return header_ != NULL; }
+
+    // Wait up to |timeout_ms| for a frame newer than |sequence|.
+    bool WaitForFrame(uint64 sequence, int timeout_ms);
+    // Fill |frame| with the newest frame. Returns false if there is none yet
+    // or the writer is busy with it.
+    bool GetLatestFrame(SharedFrame& frame);
+    // True if the pixels of |frame| were not overwritten since it was
+    // obtained. Call after using them.
+    bool IsValid(const SharedFrame& frame) const;
+
+private:
+    const SharedFrameSlotHeader* GetSlot(uint32 index) const;
+
+    const SharedFrameRingHeader* header_;
+    size_t mapping_size_;
+#if defined(OS_WIN)
+    void* mapping_;
+#endif
+
+    // Not copyable.
+    SharedFrameReader(const SharedFrameReader&);
+    SharedFrameReader& operator=(const SharedFrameReader&);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_SHARED_FRAME_RING_H_
@@ -0,0 +1,57 @@
+/**
+ * @file thumbnail_pyramid.h
+ *
+ * @breif Incrementally updated downscaled copies of the offscreen view
+ */
+#ifndef CEF_TESTS_CEFCLIENT_THUMBNAIL_PYRAMID_H_
+#define CEF_TESTS_CEFCLIENT_THUMBNAIL_PYRAMID_H_
+#pragma once
+
+#include <vector>
+
+#include <include/cef_base.h>
+
+#include "offscreen_surface.h"
+
+// A chain of box-filtered BGRA levels at 1/2, 1/4, 1/8, ... of the source
+// size. Each level is reduced from the one above it, and only the 2x2
+// blocks touched by the damage are recomputed, so the cost follows the
+// damage instead of the view size.
+class ThumbnailPyramid {
+public:
+    static const int kDefaultLevels = 3;
+
+    explicit ThumbnailPyramid(int levels=kDefaultLevels);
+    ~ThumbnailPyramid();
+
+    // Bring the levels up to date with |source|, of which only the pixels
+    // covered by |damage| changed since the last update. All levels are
+    // recomputed when the source size changes.
+    void Update(const OffScreenSurface& source,
+                const std::vector<CefRect>& damage);
+    // Free the storage of all levels.
+    void Release();
+
+    int level_count() const { return static_cast<int>(levels_.size()); }
+    // Level |index| is 1 / 2^(index + 1) of the source size. Empty before
+    // the first update.
+    const OffScreenSurface& level(int index) const { return *levels_[index]; }
+    // The smallest level that is at least |width| x |height|, or the
+    // largest one if none is.
+    const OffScreenSurface& GetLevelFor(int width, int height) const;
+
+private:
+    // Reduce |rect| of |source| into |dest|, |rect| is in |source|
+    // coordinates and is widened to whole 2x2 blocks. Returns the updated
+    // rect in |dest| coordinates.
+    static CefRect ReduceRect(const OffScreenSurface& source,
+                              OffScreenSurface& dest, const CefRect& rect);
+
+    std::vector<OffScreenSurface*> levels_;
+
+    // Not copyable.
+    ThumbnailPyramid(const ThumbnailPyramid&);
+    ThumbnailPyramid& operator=(const ThumbnailPyramid&);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_THUMBNAIL_PYRAMID_H_
@@ -0,0 +1,53 @@
+/**
+ * @file tile_hash_grid.h
+ *
+ * @breif Per-tile content hashes of the offscreen view
+ */
+#ifndef CEF_TESTS_CEFCLIENT_TILE_HASH_GRID_H_
+#define CEF_TESTS_CEFCLIENT_TILE_HASH_GRID_H_
+#pragma once
+
+#include <vector>
+
+#include <include/cef_base.h>
+
+#include "offscreen_surface.h"
+
+// Remembers a hash of every tile of a surface, to tell damage that really
+// changed pixels from damage that repainted the same ones. The hash is a
+// four lane xxHash32 style hash, fast and non-cryptographic: a collision,
+// about 1 in 2^32 per changed tile, would drop that change.
+class TileHashGrid {
+public:
+    static const int kDefaultTileSize = 64;
+
+    explicit TileHashGrid(int tile_size=kDefaultTileSize);
+
+    // Rehash the tiles of |surface| touched by |damage| and store in
+    // |changed| the parts of |damage| whose tiles hash differently than
+    // before, i.e. the bounding box of the changed tiles within each rect.
+    // Returns false if nothing changed. A new surface size resets the grid,
+    // so all damage counts as changed.
+    bool Update(const OffScreenSurface& surface,
+                const std::vector<CefRect>& damage,
+                std::vector<CefRect>& changed);
+    // Forget all hashes.
+    void Reset();
+
+private:
+    uint32 HashTile(const OffScreenSurface& surface, int column,
+                    int row) const;
+
+    int tile_size_;
+    int width_;
+    int height_;
+    int columns_;
+    int rows_;
+    std::vector<uint32> hashes_;
+    // Non-zero for tiles with a known hash.
+    std::vector<unsigned char> known_;
+    // Scratch state of the tiles during Update.
+    std::vector<unsigned char> state_;
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_TILE_HASH_GRID_H_
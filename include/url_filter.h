@@ -0,0 +1,79 @@
+/**
+ * @file url_filter.h
+ *
+ * @breif Compiled URL block list checked on every navigation and request
+ */
+#ifndef CEF_TESTS_CEFCLIENT_URL_FILTER_H_
+#define CEF_TESTS_CEFCLIENT_URL_FILTER_H_
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <include/cef_base.h>
+
+// Blocks URLs matching any of a set of rules, written in the usual block
+// list syntax:
+//
+//   ||example.com      the host example.com and all its subdomains
+//   |https://a.com/x   URLs starting with the text after '|'
+//   /ads/*.js          URLs containing the text, '*' matching anything;
+//                      a leading '|' or trailing '|' anchors it to the start
+//                      or end of the URL
+//   ! or # comment     ignored, as are empty lines
+//
+// Matching is case-insensitive. Host rules are compiled into a trie of
+// reversed host names, start-anchored rules into a trie of prefixes, and the
+// literal parts of the other rules into an Aho-Corasick automaton, so one
+// lookup walks the URL a few times whatever the number of rules.
+//
+// Rule sets are immutable once compiled. Load swaps in a new set as a whole;
+// lookups in progress finish on the set they started with.
+class UrlFilter : public virtual CefBase {
+public:
+    struct RuleHits {
+        std::string rule;
+        uint64 hits;
+    };
+
+    UrlFilter();
+    virtual ~UrlFilter();
+
+    // Compile |rules| and make them the current set. Lines that are not
+    // valid rules are skipped. Returns the number of rules compiled. Safe to
+    // call from any thread.
+    size_t Load(const std::vector<std::string>& rules);
+    // Load rules from |path|, one per line. Returns false if the file cannot
+    // be read, the current set is kept then.
+    bool LoadFile(const std::string& path);
+
+    // Index of the first rule of the current set matching |url|, -1 if none.
+    // A match counts as a hit of the rule. Safe to call from any thread.
+    int Match(const std::string& url);
+    bool ShouldBlock(const std::string& url) { return Match(url) >= 0; }
+
+    // Rules of the current set with their hits since it was loaded.
+    std::vector<RuleHits> GetHits();
+
+    // Number of Match calls, and of those that matched, over all sets.
+    uint64 lookups() const { return lookups_.load(std::memory_order_relaxed); }
+    uint64 blocked() const { return blocked_.load(std::memory_order_relaxed); }
+
+private:
+    class RuleSet;
+    CefRefPtr<RuleSet> GetRuleSet();
+
+    CefRefPtr<RuleSet> rules_;
+    std::atomic<uint64> lookups_;
+    std::atomic<uint64> blocked_;
+
+    IMPLEMENT_REFCOUNTING(UrlFilter);
+    IMPLEMENT_LOCKING(UrlFilter);
+
+    // Not copyable.
+    UrlFilter(const UrlFilter&);
+    UrlFilter& operator=(const UrlFilter&);
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_URL_FILTER_H_
@@ -0,0 +1,66 @@
+/**
+ * @file virtual_display_window.h
+ *
+ * @breif Window wrapper of a headless offscreen browser
+ */
+#ifndef CEF_TESTS_CEFCLIENT_VIRTUAL_DISPLAY_WINDOW_H_
+#define CEF_TESTS_CEFCLIENT_VIRTUAL_DISPLAY_WINDOW_H_
+#pragma once
+
+#include "offscreen_render_handler.h"
+
+// A window on a virtual display, for offscreen browsers that have no OS
+// window at all, e.g. on a headless rendering server. The view is placed at
+// a configurable position of a virtual screen and reports the screen's size
+// and device scale factor to the browser. All the rects and points it reports
+// are in device independent pixels. It uses no windowing system. Must only be
+// used on the UI thread.
+class VirtualDisplayWindow : public OffScreenRenderHandler::WindowWrapper {
+public:
+    static const int kDefaultScreenWidth = 1920;
+    static const int kDefaultScreenHeight = 1080;
+
+    // A |width| x |height| view in device independent pixels at the top-left
+    // corner of a default sized screen.
+    VirtualDisplayWindow(int width, int height,
+                         float device_scale_factor=1.0f);
+
+    // View size in device independent pixels.
+    void SetSize(int width, int height);
+    // View position on the virtual screen in device independent pixels.
+    void SetPosition(int x, int y);
+    // Screen size in device independent pixels, also used as the available
+    // work area.
+    void SetScreenSize(int width, int height);
+    void SetDeviceScaleFactor(float device_scale_factor);
+    // A hidden window makes the handler fall back to its own view size.
+    void SetShown(bool shown) { shown_ = shown; }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    float device_scale_factor() const { return device_scale_factor_; }
+    // Last cursor the browser asked for.
+    CefCursorHandle cursor() const { return cursor_; }
+
+    // OffScreenRenderHandler::WindowWrapper methods
+    virtual bool IsShown() OVERRIDE { return shown_; }
+    virtual void GetRootScreenRect(CefRect& rect) OVERRIDE;
+    virtual void GetViewRect(CefRect& rect) OVERRIDE;
+    virtual void GetScreenPoint(int viewX, int viewY, int& screenX,
+                                int& screenY) OVERRIDE;
+    virtual void SetCursor(CefCursorHandle cursor) OVERRIDE;
+    virtual bool GetScreenInfo(CefScreenInfo& screen_info) OVERRIDE;
+
+private:
+    int x_;
+    int y_;
+    int width_;
+    int height_;
+    int screen_width_;
+    int screen_height_;
+    float device_scale_factor_;
+    bool shown_;
+    CefCursorHandle cursor_;
+};
+
+#endif  // CEF_TESTS_CEFCLIENT_VIRTUAL_DISPLAY_WINDOW_H_
@@ -0,0 +1,493 @@
+/**
+ * @file asset_archive.cpp
+ *
+ * @breif Impl of asset_archive.h
+ */
+#include "asset_archive.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(OS_WIN)
+#include <windows.h>
+#define strcasecmp _stricmp
+#define strncasecmp _strnicmp
+#else
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <include/cef_response.h>
+
+const char AssetArchive::kScheme[] = "app";
+
+namespace {
+
+// Entries are content addressed, a changed file gets a new ETag.
+const char kCacheControl[] = "public, max-age=31536000, immutable";
+const char kIndexFile[] = "index.html";
+
+struct MimeType {
+    const char* extension;
+    const char* mime_type;
+};
+
+const MimeType kMimeTypes[] = {
+    { "css", "text/css" },
+    { "gif", "image/gif" },
+    { "htm", "text/html" },
+    { "html", "text/html" },
+    { "ico", "image/x-icon" },
+    { "jpeg", "image/jpeg" },
+    { "jpg", "image/jpeg" },
+    { "js", "application/javascript" },
+    { "json", "application/json" },
+    { "map", "application/json" },
+    { "mjs", "application/javascript" },
+    { "mp4", "video/mp4" },
+    { "png", "image/png" },
+    { "svg", "image/svg+xml" },
+    { "ttf", "font/ttf" },
+    { "txt", "text/plain" },
+    { "wasm", "application/wasm" },
+    { "webm", "video/webm" },
+    { "webp", "image/webp" },
+    { "woff", "font/woff" },
+    { "woff2", "font/woff2" },
+    { "xml", "text/xml" },
+};
+
+std::string GetMimeType(const std::string& name)
+{
+    const size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos && name.find('/', dot) == std::string::npos) {
+        std::string extension = name.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       tolower);
+        for (size_t i = 0; i < sizeof(kMimeTypes) / sizeof(kMimeTypes[0]);
+             ++i) {
+            if (extension == kMimeTypes[i].extension)
+                return kMimeTypes[i].mime_type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+// Archive entry name of an app:// URL, empty if |url| is not one.
+std::string GetEntryName(const std::string& url)
+{
+    const std::string prefix = std::string(AssetArchive::kScheme) + "://";
+    if (url.size() < prefix.size() ||
+        strncasecmp(url.c_str(), prefix.c_str(), prefix.size()) != 0) {
+        return std::string();
+    }
+    const size_t path = url.find('/', prefix.size());
+    std::string name;
+    if (path != std::string::npos) {
+        const size_t end = url.find_first_of("?#", path);
+        const std::string encoded = url.substr(
+            path + 1, end == std::string::npos ? std::string::npos :
+                                                 end - path - 1);
+        for (size_t i = 0; i < encoded.size(); ++i) {
+            if (encoded[i] == '%' && i + 2 < encoded.size() &&
+                isxdigit(encoded[i + 1]) && isxdigit(encoded[i + 2])) {
+                name += static_cast<char>(
+                    strtol(encoded.substr(i + 1, 2).c_str(), NULL, 16));
+                i += 2;
+            } else {
+                name += encoded[i];
+            }
+        }
+    }
+    if (name.empty() || name[name.size() - 1] == '/')
+        name += kIndexFile;
+    return name;
+}
+
+// First value of the header |name|, matched case-insensitively.
+std::string GetHeader(const CefRequest::HeaderMap& headers,
+                      const char* name)
+{
+    CefRequest::HeaderMap::const_iterator it = headers.begin();
+    for (; it != headers.end(); ++it) {
+        const std::string key = it->first;
+        if (strcasecmp(key.c_str(), name) == 0)
+            return it->second;
+    }
+    return std::string();
+}
+
+std::string Trim(const std::string& value)
+{
+    const size_t begin = value.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+        return std::string();
+    const size_t end = value.find_last_not_of(" \t");
+    return value.substr(begin, end - begin + 1);
+}
+
+// Parse a single "bytes=first-last" range of a |size| byte body into
+// [begin, end). Returns false if the header is not a single byte range,
+// sets |satisfiable| to false if the range lies outside the body.
+bool ParseRange(const std::string& value, size_t size, size_t& begin,
+                size_t& end, bool& satisfiable)
+{
+    const std::string unit = "bytes=";
+    if (size == 0 || value.compare(0, unit.size(), unit) != 0 ||
+        value.find(',') != std::string::npos) {
+        return false;
+    }
+    const std::string spec = Trim(value.substr(unit.size()));
+    const size_t dash = spec.find('-');
+    if (dash == std::string::npos)
+        return false;
+    const std::string first = Trim(spec.substr(0, dash));
+    const std::string last = Trim(spec.substr(dash + 1));
+    if (first.empty() && last.empty())
+        return false;
+
+    satisfiable = true;
+    if (first.empty()) {
+        // Suffix range, the last N bytes.
+        const unsigned long long length = strtoull(last.c_str(), NULL, 10);
+        if (length == 0) {
+            satisfiable = false;
+            return true;
+        }
+        begin = length < size ? size - static_cast<size_t>(length) : 0;
+        end = size;
+        return true;
+    }
+    const unsigned long long from = strtoull(first.c_str(), NULL, 10);
+    unsigned long long to = last.empty() ? size - 1 :
+                                           strtoull(last.c_str(), NULL, 10);
+    if (from >= size || to < from) {
+        satisfiable = false;
+        return true;
+    }
+    to = std::min<unsigned long long>(to, size - 1);
+    begin = static_cast<size_t>(from);
+    end = static_cast<size_t>(to) + 1;
+    return true;
+}
+
+std::string FormatETag(uint64 hash)
+{
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%016llx\"",
+             static_cast<unsigned long long>(hash));
+    return etag;
+}
+
+// Answers one request from the mapped archive. Reads copy straight from the
+// mapped pages into the buffer of the network stack.
+class AssetResourceHandler : public CefResourceHandler
+{
+public:
+    AssetResourceHandler(CefRefPtr<AssetArchive> archive,
+                         const std::string& name)
+        : archive_(archive),
+          name_(name),
+          status_(404),
+          data_(NULL),
+          offset_(0),
+          end_(0) {}
+
+    virtual bool ProcessRequest(CefRefPtr<CefRequest> request,
+                                CefRefPtr<CefCallback> callback) OVERRIDE
+    {
+        CefRequest::HeaderMap request_headers;
+        request->GetHeaderMap(request_headers);
+        const std::string method = request->GetMethod();
+        const bool head = method == "HEAD";
+
+        AssetArchive::File file;
+        if (!head && method != "GET") {
+            status_ = 405;
+            headers_.insert(std::make_pair("Allow", "GET, HEAD"));
+        } else if (!archive_->Find(name_, file)) {
+            status_ = 404;
+        } else {
+            Respond(file, request_headers, head);
+        }
+        callback->Continue();
+        return true;
+    }
+
+    virtual void GetResponseHeaders(CefRefPtr<CefResponse> response,
+                                    int64& response_length,
+                                    CefString& redirectUrl) OVERRIDE
+    {
+        response->SetStatus(status_);
+        response->SetStatusText(GetStatusText());
+        response->SetMimeType(mime_type_);
+        response->SetHeaderMap(headers_);
+        response_length = static_cast<int64>(end_ - offset_);
+    }
+
+    virtual bool ReadResponse(void* data_out,
+                              int bytes_to_read,
+                              int& bytes_read,
+                              CefRefPtr<CefCallback> callback) OVERRIDE
+    {
+        bytes_read = 0;
+        if (offset_ >= end_)
+            return false;
+        const size_t count = std::min(end_ - offset_,
+                                      static_cast<size_t>(bytes_to_read));
+        memcpy(data_out, data_ + offset_, count);
+        offset_ += count;
+        bytes_read = static_cast<int>(count);
+        return true;
+    }
+
+    virtual void Cancel() OVERRIDE
+    {
+        offset_ = end_;
+    }
+
+private:
+    void Respond(const AssetArchive::File& file,
+                 const CefRequest::HeaderMap& request_headers, bool head)
+    {
+        const std::string etag = FormatETag(file.hash);
+        mime_type_ = GetMimeType(name_);
+        headers_.insert(std::make_pair("ETag", etag));
+        headers_.insert(std::make_pair("Cache-Control", kCacheControl));
+        headers_.insert(std::make_pair("Accept-Ranges", "bytes"));
+
+        const std::string if_none_match =
+            GetHeader(request_headers, "If-None-Match");
+        if (!if_none_match.empty() &&
+            (if_none_match.find(etag) != std::string::npos ||
+             Trim(if_none_match) == "*")) {
+            status_ = 304;
+            return;
+        }
+
+        status_ = 200;
+        size_t begin = 0;
+        size_t end = file.size;
+        bool satisfiable = true;
+        const std::string range = GetHeader(request_headers, "Range");
+        const std::string if_range = GetHeader(request_headers, "If-Range");
+        if (!range.empty() && (if_range.empty() || if_range == etag) &&
+            ParseRange(range, file.size, begin, end, satisfiable)) {
+            char content_range[64];
+            if (!satisfiable) {
+                status_ = 416;
+                snprintf(content_range, sizeof(content_range), "bytes */%llu",
+                         static_cast<unsigned long long>(file.size));
+                headers_.insert(std::make_pair("Content-Range",
+                                               content_range));
+                return;
+            }
+            status_ = 206;
+            snprintf(content_range, sizeof(content_range),
+                     "bytes %llu-%llu/%llu",
+                     static_cast<unsigned long long>(begin),
+                     static_cast<unsigned long long>(end - 1),
+                     static_cast<unsigned long long>(file.size));
+            headers_.insert(std::make_pair("Content-Range", content_range));
+        }
+        data_ = file.data;
+        offset_ = begin;
+        end_ = head ? begin : end;
+    }
+
+    const char* GetStatusText() const
+    {
+        switch (status_) {
+        case 200: return "OK";
+        case 206: return "Partial Content";
+        case 304: return "Not Modified";
+        case 405: return "Method Not Allowed";
+        case 416: return "Range Not Satisfiable";
+        default: return "Not Found";
+        }
+    }
+
+    // Keeps the mapping alive while the response is read.
+    CefRefPtr<AssetArchive> archive_;
+    const std::string name_;
+    int status_;
+    std::string mime_type_;
+    CefResponse::HeaderMap headers_;
+    const unsigned char* data_;
+    size_t offset_;
+    size_t end_;
+
+    IMPLEMENT_REFCOUNTING(AssetResourceHandler);
+};
+
+}  // namespace
+
+AssetArchive::AssetArchive()
+    : base_(NULL),
+      size_(0),
+      header_(NULL),
+      entries_(NULL),
+      names_(NULL)
+#if defined(OS_WIN)
+      , mapping_(NULL)
+#endif
+{
+}
+
+AssetArchive::~AssetArchive()
+{
+    Close();
+}
+
+bool AssetArchive::Open(const std::string& path)
+{
+    Close();
+#if defined(OS_WIN)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                              NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+        mapping_ = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping_) {
+            base_ = static_cast<unsigned char*>(
+                MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+            size_ = static_cast<size_t>(file_size.QuadPart);
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (base != MAP_FAILED) {
+            base_ = static_cast<unsigned char*>(base);
+            size_ = static_cast<size_t>(st.st_size);
+        }
+    }
+    close(fd);
+#endif
+    if (!base_) {
+        Close();
+        return false;
+    }
+
+    // Check every offset once so lookups can trust the index. The header
+    // is read only once it is known to be mapped.
+    if (size_ < sizeof(asset_archive::Header)) {
+        Close();
+        return false;
+    }
+    header_ = reinterpret_cast<const asset_archive::Header*>(base_);
+    const uint64 entries_size =
+        static_cast<uint64>(header_->entry_count) * sizeof(asset_archive::Entry);
+    bool valid = memcmp(header_->magic, asset_archive::kMagic,
+               sizeof(asset_archive::kMagic)) == 0 &&
+        header_->version == asset_archive::kVersion &&
+        header_->index_offset % 8 == 0 &&
+        header_->index_offset <= size_ &&
+        entries_size <= size_ - header_->index_offset &&
+        header_->names_offset <= size_ &&
+        header_->names_size <= size_ - header_->names_offset;
+    if (valid) {
+        entries_ = reinterpret_cast<const asset_archive::Entry*>(
+            base_ + header_->index_offset);
+        names_ = reinterpret_cast<const char*>(base_ + header_->names_offset);
+        for (uint32 i = 0; valid && i < header_->entry_count; ++i) {
+            const asset_archive::Entry& entry = entries_[i];
+            valid = entry.name_offset <= header_->names_size &&
+                entry.name_length <= header_->names_size - entry.name_offset &&
+                entry.data_offset <= size_ &&
+                entry.data_size <= size_ - entry.data_offset &&
+                entry.encoding < asset_archive::ENCODING_COUNT;
+        }
+    }
+    if (!valid)
+        Close();
+    return valid;
+}
+
+void AssetArchive::Close()
+{
+#if defined(OS_WIN)
+    if (base_)
+        UnmapViewOfFile(base_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    mapping_ = NULL;
+#else
+    if (base_)
+        munmap(base_, size_);
+#endif
+    base_ = NULL;
+    size_ = 0;
+    header_ = NULL;
+    entries_ = NULL;
+    names_ = NULL;
+}
+
+bool AssetArchive::Find(const std::string& name, File& file) const
+{
+    if (!base_)
+        return false;
+    // Entries of a name are sorted by encoding, identity first.
+    const uint32 i = LowerBound(name);
+    if (i == header_->entry_count || CompareName(entries_[i], name) != 0 ||
+        entries_[i].encoding != asset_archive::ENCODING_IDENTITY) {
+        return false;
+    }
+    const asset_archive::Entry& entry = entries_[i];
+    file.data = base_ + entry.data_offset;
+    file.size = static_cast<size_t>(entry.data_size);
+    file.hash = entry.hash;
+    return true;
+}
+
+CefRefPtr<CefResourceHandler> AssetArchive::CreateResourceHandler(
+    CefRefPtr<CefRequest> request)
+{
+    const std::string name = GetEntryName(request->GetURL());
+    if (name.empty())
+        return NULL;
+    return new AssetResourceHandler(this, name);
+}
+
+uint32 AssetArchive::LowerBound(const std::string& name) const
+{
+    uint32 first = 0;
+    uint32 count = header_->entry_count;
+    while (count > 0) {
+        const uint32 step = count / 2;
+        if (CompareName(entries_[first + step], name) < 0) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    return first;
+}
+
+int AssetArchive::CompareName(const asset_archive::Entry& entry,
+                              const std::string& name) const
+{
+    const size_t length = std::min<size_t>(entry.name_length, name.size());
+    const int result = memcmp(names_ + entry.name_offset, name.data(), length);
+    if (result != 0)
+        return result;
+    if (entry.name_length == name.size())
+        return 0;
+    return entry.name_length < name.size() ? -1 : 1;
+}
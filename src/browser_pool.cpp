@@ -0,0 +1,468 @@
+/**
+ * @file browser_pool.cpp
+ *
+ * @breif Impl of browser_pool.h
+ */
+#include "browser_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <include/cef_runnable.h>
+
+#include "client_renderer.h"
+#include "util.h"
+
+namespace {
+
+const char kBlankURL[] = "about:blank";
+// Event emitted through the platform bridge once a blank page is usable.
+const char kReadyEvent[] = "BrowserPool.Ready";
+// Milliseconds CreateBrowser may take to call back before the browser is
+// replaced.
+const int64 kCreateTimeout = 10000;
+// Milliseconds a browser may take to get ready before it is replaced, e.g.
+// because its render process hangs.
+const int64 kWarmUpTimeout = 15000;
+
+int64 NowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+BrowserPool::BrowserPool(const CefWindowInfo& window_info,
+                         const CefBrowserSettings& settings,
+                         int size,
+                         CefRefPtr<ClientFactory> factory)
+    : window_info_(window_info),
+      settings_(settings),
+      factory_(factory),
+      size_(std::max(size, 0)),
+      shutdown_(false),
+      refill_pending_(false),
+      generation_(0),
+      hits_(0),
+      misses_(0)
+{
+}
+
+BrowserPool::~BrowserPool()
+{
+}
+
+void BrowserPool::SetSize(int size)
+{
+    {
+        AutoLock lock_scope(this);
+        size_ = std::max(size, 0);
+    }
+    PostRefill();
+}
+
+CefRefPtr<ClientHandlerImpl> BrowserPool::Acquire()
+{
+    const int64 start = NowMicros();
+    CefRefPtr<ClientHandlerImpl> client;
+    {
+        AutoLock lock_scope(this);
+        if (ready_.empty()) {
+            ++misses_;
+        } else {
+            Entry& entry = entries_[ready_.front()];
+            ready_.pop_front();
+            entry.state = STATE_ACQUIRED;
+            entry.since = start;
+            client = entry.client;
+            ++hits_;
+        }
+    }
+    if (client.get())
+        client->ResumeRendering();
+    PostRefill();
+
+    AutoLock lock_scope(this);
+    acquire_latency_.Add(NowMicros() - start);
+    return client;
+}
+
+void BrowserPool::Release(CefRefPtr<ClientHandlerImpl> client)
+{
+    if (!client.get())
+        return;
+    if (!CefCurrentlyOn(TID_UI)) {
+        CefPostTask(TID_UI,
+                    NewCefRunnableMethod(this, &BrowserPool::DoRelease,
+                                         client));
+        return;
+    }
+    DoRelease(client);
+}
+
+void BrowserPool::DoRelease(CefRefPtr<ClientHandlerImpl> client)
+{
+    REQUIRE_UI_THREAD();
+    CefRefPtr<CefBrowser> browser = client->GetBrowser();
+    if (!browser.get())
+        return;
+
+    bool reuse;
+    int64 since;
+    ClientHandlerImpl::MessageDelegateSet delegates;
+    {
+        AutoLock lock_scope(this);
+        EntryMap::iterator it = entries_.find(browser->GetIdentifier());
+        if (it == entries_.end() || it->second.state != STATE_ACQUIRED)
+            return;
+        Entry& entry = it->second;
+        reuse = !shutdown_ && SupplyLocked() < size_;
+        entry.state = reuse ? STATE_WARMING : STATE_CLOSING;
+        entry.since = NowMicros();
+        entry.recycled = true;
+        since = entry.since;
+        delegates = entry.delegates;
+    }
+
+    if (!reuse) {
+        browser->GetHost()->CloseBrowser(true);
+        return;
+    }
+    // Nothing of the last user may reach the next one.
+    client->SetMessageDelegates(delegates);
+    client->ClearHistory(browser->GetIdentifier());
+    // Hidden while the blank page loads; OnProcessMessageReceived puts it
+    // back once the bridge answers.
+    client->PauseRendering();
+    browser->StopLoad();
+    browser->GetMainFrame()->LoadURL(kBlankURL);
+    CefPostDelayedTask(TID_UI,
+                       NewCefRunnableMethod(this, &BrowserPool::OnWarmUpTimeout,
+                                            browser->GetIdentifier(), since),
+                       kWarmUpTimeout);
+}
+
+void BrowserPool::Shutdown()
+{
+    if (!CefCurrentlyOn(TID_UI)) {
+        CefPostTask(TID_UI,
+                    NewCefRunnableMethod(this, &BrowserPool::DoShutdown));
+        return;
+    }
+    DoShutdown();
+}
+
+void BrowserPool::DoShutdown()
+{
+    REQUIRE_UI_THREAD();
+    std::vector<CefRefPtr<CefBrowser> > browsers;
+    {
+        AutoLock lock_scope(this);
+        shutdown_ = true;
+        ready_.clear();
+        // Browsers still being created are closed in OnAfterCreated.
+        for (EntryMap::iterator it = entries_.begin(); it != entries_.end();
+             ++it) {
+            if (it->second.state == STATE_WARMING ||
+                it->second.state == STATE_READY) {
+                it->second.state = STATE_CLOSING;
+                browsers.push_back(it->second.client->GetBrowser());
+            }
+        }
+    }
+    for (size_t i = 0; i < browsers.size(); ++i)
+        browsers[i]->GetHost()->CloseBrowser(true);
+}
+
+BrowserPoolStats BrowserPool::GetStats()
+{
+    AutoLock lock_scope(this);
+    BrowserPoolStats stats;
+    stats.ready = static_cast<int>(ready_.size());
+    stats.warming = SupplyLocked() - stats.ready;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.acquire = acquire_latency_.Get();
+    stats.release = release_latency_.Get();
+    stats.warm_up = warm_up_latency_.Get();
+    return stats;
+}
+
+void BrowserPool::OnAfterCreated(CefRefPtr<CefBrowser> browser)
+{
+    REQUIRE_UI_THREAD();
+    bool close = false;
+    int64 since;
+    {
+        AutoLock lock_scope(this);
+        std::deque<Entry>::iterator it = creating_.begin();
+        for (; it != creating_.end(); ++it) {
+            if (it->client->GetBrowserId() == browser->GetIdentifier())
+                break;
+        }
+        // Not one of ours, e.g. DevTools opened on a handed out browser.
+        if (it == creating_.end())
+            return;
+        // Replaced already if it took too long.
+        close = shutdown_ || it->state == STATE_CLOSING;
+        Entry& entry = entries_[browser->GetIdentifier()];
+        entry = *it;
+        creating_.erase(it);
+        entry.state = close ? STATE_CLOSING : STATE_WARMING;
+        since = entry.since;
+    }
+    if (close) {
+        browser->GetHost()->CloseBrowser(true);
+        return;
+    }
+    CefPostDelayedTask(TID_UI,
+                       NewCefRunnableMethod(this, &BrowserPool::OnWarmUpTimeout,
+                                            browser->GetIdentifier(), since),
+                       kWarmUpTimeout);
+}
+
+void BrowserPool::OnLoadEnd(CefRefPtr<CefBrowser> browser,
+                            CefRefPtr<CefFrame> frame,
+                            int httpStatusCode)
+{
+    REQUIRE_UI_THREAD();
+    if (!frame->IsMain() || frame->GetURL() != kBlankURL)
+        return;
+    {
+        AutoLock lock_scope(this);
+        EntryMap::const_iterator it = entries_.find(browser->GetIdentifier());
+        if (it == entries_.end() || it->second.state != STATE_WARMING)
+            return;
+    }
+    // Running script creates the V8 context, and with it the bridge. The
+    // answer proves both ends of it work.
+    std::string script = "if (window.platform) platform.emit('";
+    script += kReadyEvent;
+    script += "');";
+    frame->ExecuteJavaScript(script, kBlankURL, 0);
+}
+
+bool BrowserPool::OnProcessMessageReceived(
+    CefRefPtr<CefBrowser> browser,
+    CefProcessId source_process,
+    CefRefPtr<CefProcessMessage> message)
+{
+    REQUIRE_UI_THREAD();
+    if (message->GetName() != client_renderer::GenPlatformMsg(kReadyEvent))
+        return false;
+
+    CefRefPtr<ClientHandlerImpl> client;
+    bool close = false;
+    {
+        AutoLock lock_scope(this);
+        EntryMap::iterator it = entries_.find(browser->GetIdentifier());
+        if (it == entries_.end() || it->second.state != STATE_WARMING)
+            return false;
+        Entry& entry = it->second;
+        const int64 now = NowMicros();
+        if (entry.recycled)
+            release_latency_.Add(now - entry.since);
+        else
+            warm_up_latency_.Add(now - entry.since);
+        // The pool may have shrunk meanwhile.
+        close = shutdown_ || static_cast<int>(ready_.size()) >= size_;
+        entry.state = close ? STATE_CLOSING : STATE_READY;
+        entry.since = now;
+        if (!close)
+            ready_.push_back(browser->GetIdentifier());
+        client = entry.client;
+    }
+    if (close)
+        browser->GetHost()->CloseBrowser(true);
+    else
+        client->PauseRendering();
+    return true;
+}
+
+void BrowserPool::OnBeforeClose(CefRefPtr<CefBrowser> browser)
+{
+    REQUIRE_UI_THREAD();
+    {
+        AutoLock lock_scope(this);
+        const int id = browser->GetIdentifier();
+        if (!entries_.erase(id))
+            return;
+        std::deque<int>::iterator it =
+            std::find(ready_.begin(), ready_.end(), id);
+        if (it != ready_.end())
+            ready_.erase(it);
+    }
+    // Crashed or closed by the user, replace it.
+    PostRefill();
+}
+
+void BrowserPool::OnRenderProcessTerminated(
+    CefRefPtr<CefBrowser> browser,
+    CefRequestHandler::TerminationStatus status)
+{
+    REQUIRE_UI_THREAD();
+    // The ready emit of a warming browser will never come, and a ready one
+    // would be handed out crashed.
+    Discard(browser->GetIdentifier());
+}
+
+void BrowserPool::OnCreateTimeout(int generation)
+{
+    REQUIRE_UI_THREAD();
+    {
+        AutoLock lock_scope(this);
+        std::deque<Entry>::iterator it = creating_.begin();
+        for (; it != creating_.end(); ++it) {
+            if (it->generation == generation)
+                break;
+        }
+        // Created meanwhile.
+        if (it == creating_.end() || it->state != STATE_CREATING)
+            return;
+        // No longer counted as supply. The entry stays until the browser
+        // shows up, if ever, so that it is closed then.
+        it->state = STATE_CLOSING;
+    }
+    PostRefill();
+}
+
+void BrowserPool::OnWarmUpTimeout(int browser_id, int64 since)
+{
+    REQUIRE_UI_THREAD();
+    {
+        AutoLock lock_scope(this);
+        EntryMap::const_iterator it = entries_.find(browser_id);
+        // Ready meanwhile, or warming up again after a later Release.
+        if (it == entries_.end() || it->second.state != STATE_WARMING ||
+            it->second.since != since) {
+            return;
+        }
+    }
+    Discard(browser_id);
+}
+
+void BrowserPool::Discard(int browser_id)
+{
+    REQUIRE_UI_THREAD();
+    CefRefPtr<CefBrowser> browser;
+    {
+        AutoLock lock_scope(this);
+        EntryMap::iterator it = entries_.find(browser_id);
+        if (it == entries_.end() ||
+            (it->second.state != STATE_WARMING &&
+             it->second.state != STATE_READY)) {
+            return;
+        }
+        std::deque<int>::iterator ready =
+            std::find(ready_.begin(), ready_.end(), browser_id);
+        if (ready != ready_.end())
+            ready_.erase(ready);
+        it->second.state = STATE_CLOSING;
+        browser = it->second.client->GetBrowser(browser_id);
+    }
+    // No longer counted as supply, so the refill creates a replacement
+    // without waiting for the close.
+    PostRefill();
+    if (browser.get())
+        browser->GetHost()->CloseBrowser(true);
+}
+
+void BrowserPool::Refill()
+{
+    REQUIRE_UI_THREAD();
+    int missing;
+    std::vector<CefRefPtr<CefBrowser> > extra;
+    {
+        AutoLock lock_scope(this);
+        refill_pending_ = false;
+        if (shutdown_)
+            return;
+        missing = size_ - SupplyLocked();
+        // Close the ready browsers the pool does not need any more, the ones
+        // waiting longest first.
+        while (missing < 0 && !ready_.empty()) {
+            Entry& entry = entries_[ready_.front()];
+            ready_.pop_front();
+            entry.state = STATE_CLOSING;
+            extra.push_back(entry.client->GetBrowser());
+            ++missing;
+        }
+    }
+    for (size_t i = 0; i < extra.size(); ++i)
+        extra[i]->GetHost()->CloseBrowser(true);
+
+    for (int i = 0; i < missing; ++i) {
+        Entry entry;
+        if (factory_.get())
+            entry.client = factory_->CreateClient();
+        else
+            entry.client = new ClientHandlerImpl();
+        if (!entry.client.get())
+            break;
+        entry.client->SetBrowserObserver(this);
+        entry.client->AddMessageDelegate(this);
+        entry.delegates = entry.client->GetMessageDelegates();
+        entry.since = NowMicros();
+        {
+            AutoLock lock_scope(this);
+            entry.generation = ++generation_;
+            creating_.push_back(entry);
+        }
+        // Returns at once, the browser shows up in OnAfterCreated.
+        if (!CefBrowserHost::CreateBrowser(window_info_, entry.client.get(),
+                                           kBlankURL, settings_, NULL)) {
+            {
+                AutoLock lock_scope(this);
+                std::deque<Entry>::iterator it = creating_.begin();
+                for (; it != creating_.end(); ++it) {
+                    if (it->generation == entry.generation) {
+                        creating_.erase(it);
+                        break;
+                    }
+                }
+            }
+            // Try again later rather than spin on a failing CreateBrowser.
+            CefPostDelayedTask(TID_UI,
+                               NewCefRunnableMethod(this,
+                                                    &BrowserPool::PostRefill),
+                               kCreateTimeout);
+            break;
+        }
+        CefPostDelayedTask(TID_UI,
+                           NewCefRunnableMethod(this,
+                                                &BrowserPool::OnCreateTimeout,
+                                                entry.generation),
+                           kCreateTimeout);
+    }
+}
+
+void BrowserPool::PostRefill()
+{
+    {
+        AutoLock lock_scope(this);
+        if (refill_pending_ || shutdown_)
+            return;
+        refill_pending_ = true;
+    }
+    CefPostTask(TID_UI, NewCefRunnableMethod(this, &BrowserPool::Refill));
+}
+
+int BrowserPool::SupplyLocked() const
+{
+    int supply = 0;
+    for (std::deque<Entry>::const_iterator it = creating_.begin();
+         it != creating_.end(); ++it) {
+        if (it->state == STATE_CREATING)
+            ++supply;
+    }
+    for (EntryMap::const_iterator it = entries_.begin(); it != entries_.end();
+         ++it) {
+        if (it->second.state == STATE_WARMING ||
+            it->second.state == STATE_READY) {
+            ++supply;
+        }
+    }
+    return supply;
+}
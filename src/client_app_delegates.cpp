@@ -3,6 +3,7 @@
 // can be found in the LICENSE file.
 
 #include "client_app.h"
+#include "asset_archive.h"
 #include "client_renderer.h"
 
 // static
@@ -21,4 +22,7 @@ void ClientApp::RegisterCustomSchemes(
     CefRefPtr<CefSchemeRegistrar> registrar,
     std::vector<CefString>& cookiable_schemes)
 {
+    // Bundled UI files, see AssetArchive. Standard so that relative URLs and
+    // origins work as with http.
+    registrar->AddCustomScheme(AssetArchive::kScheme, true, false, false);
 }
@@ -25,6 +25,7 @@
 #include "client_renderer.h"
 #include "client_switches.h"
 #include "util.h"
+#include "v8_util.h"
 
 namespace {
 
@@ -34,19 +35,50 @@ enum client_menu_ids {
     CLIENT_ID_CLOSE_DEVTOOLS
 };
 
+// Delay after the last Resize call before the new size is applied.
+const int64 kResizeSettleDelay = 50;
+
+// Fails the request it handles, used for requests blocked by the UrlFilter.
+class BlockedResourceHandler : public CefResourceHandler {
+public:
+    virtual bool ProcessRequest(CefRefPtr<CefRequest> request,
+                                CefRefPtr<CefCallback> callback) OVERRIDE
+    {
+        return false;
+    }
+    virtual void GetResponseHeaders(CefRefPtr<CefResponse> response,
+                                    int64& response_length,
+                                    CefString& redirectUrl) OVERRIDE {}
+    virtual bool ReadResponse(void* data_out,
+                              int bytes_to_read,
+                              int& bytes_read,
+                              CefRefPtr<CefCallback> callback) OVERRIDE
+    {
+        bytes_read = 0;
+        return false;
+    }
+    virtual void Cancel() OVERRIDE {}
+
+    IMPLEMENT_REFCOUNTING(BlockedResourceHandler);
+};
+
+// Start again a navigation cancelled while waiting for admission.
+void LoadRequest(CefRefPtr<CefBrowser> browser, CefRefPtr<CefRequest> request)
+{
+    browser->GetMainFrame()->LoadRequest(request);
+}
+
 }  // namespace
 
-int ClientHandlerImpl::m_BrowserCount = 0;
+std::atomic<int> ClientHandlerImpl::m_BrowserCount(0);
 
 ClientHandlerImpl::ClientHandlerImpl()
     : ClientHandler(),
+      m_MainNavState(new NavigationStateCell()),
       m_MainHwnd(NULL),
       m_BrowserId(0),
       m_bIsClosing(false),
-      m_bCanGoBack(false),
-      m_bCanGoForward(false),
-      m_bIsCrashed(false),
-      m_HistLinksPos(-1),
+      m_Calls(new PlatformCallRegistry()),
       m_bFocusOnEditableField(false),
       m_bDevToolsShown(false)
 {
@@ -81,7 +113,12 @@ void ClientHandlerImpl::OnTitleChange(CefRefPtr<CefBrowser> browser,
     if (view_handler_.get())
         view_handler_->OnTitleChange(browser, title);
 
-    m_Title = title;
+    AutoLock lock_scope(this);
+    BrowserState* state = m_BrowserStates.Find(browser->GetIdentifier());
+    if (state) {
+        state->title = title;
+        PublishNavigationState(*state);
+    }
 }
 bool ClientHandlerImpl::OnConsoleMessage(CefRefPtr<CefBrowser> browser,
                                      const CefString& message,
@@ -102,74 +139,269 @@ void ClientHandlerImpl::OnCursorChange(CefRefPtr<CefBrowser> browser,
 }
 
 /// Interfaces for outter wrapper
+CefRefPtr<NavigationStateCell> ClientHandlerImpl::GetNavigationStateCell(
+    int browser_id)
+{
+    AutoLock lock_scope(this);
+    const BrowserState* state = m_BrowserStates.Find(browser_id);
+    if (!state)
+        return NULL;
+    return state->nav_state;
+}
+NavigationState ClientHandlerImpl::GetNavigationState(int browser_id)
+{
+    NavigationState state;
+    CefRefPtr<NavigationStateCell> cell = GetNavigationStateCell(browser_id);
+    if (cell.get())
+        cell->Read(state);
+    return state;
+}
+void ClientHandlerImpl::PublishNavigationState(const BrowserState& state)
+{
+    NavigationState snapshot;
+    snapshot.browser_id = state.browser->GetIdentifier();
+    snapshot.is_loading = state.is_loading;
+    snapshot.can_go_back = state.can_go_back;
+    snapshot.can_go_forward = state.can_go_forward;
+    snapshot.is_crashed = state.is_crashed;
+    snapshot.is_paused = state.is_paused;
+    snapshot.SetTitle(state.title);
+    state.nav_state->Publish(snapshot);
+    if (snapshot.browser_id == m_BrowserId)
+        m_MainNavState->Publish(snapshot);
+}
+CefRefPtr<CefBrowser> ClientHandlerImpl::GetBrowser(int browser_id)
+{
+    AutoLock lock_scope(this);
+    const BrowserState* state = m_BrowserStates.Find(browser_id);
+    if (!state)
+        return NULL;
+    return state->browser;
+}
+int ClientHandlerImpl::GetBrowserCount()
+{
+    AutoLock lock_scope(this);
+    return static_cast<int>(m_BrowserStates.size());
+}
+bool ClientHandlerImpl::DeferNavigation(CefRefPtr<CefTask> navigation)
+{
+    int browser_id;
+    {
+        AutoLock lock_scope(this);
+        browser_id = m_BrowserId;
+    }
+    if (!m_Admission.get() || !browser_id || m_Admission->Admit(browser_id))
+        return false;
+    m_Admission->Defer(browser_id, GetNavigationStateCell(browser_id),
+                       navigation);
+    return true;
+}
 void ClientHandlerImpl::GoBack()
 {
-    if (m_Browser.get() && CanGoBack()) {
-        m_Browser->GoBack();
-        m_HistLinksPos--;
+    if (!CanGoBack() ||
+        DeferNavigation(NewCefRunnableMethod(this,
+                                             &ClientHandlerImpl::GoBack))) {
+        return;
+    }
+    AutoLock lock_scope(this);
+    BrowserState* state = m_BrowserStates.Find(m_BrowserId);
+    if (state && state->can_go_back) {
+        state->browser->GoBack();
+        state->hist_links_pos--;
     }
 }
 void ClientHandlerImpl::GoForward()
 {
-    if (m_Browser.get() && CanGoForward()) {
-        m_Browser->GoForward();
-        m_HistLinksPos++;
+    if (!CanGoForward() ||
+        DeferNavigation(NewCefRunnableMethod(this,
+                                             &ClientHandlerImpl::GoForward))) {
+        return;
+    }
+    AutoLock lock_scope(this);
+    BrowserState* state = m_BrowserStates.Find(m_BrowserId);
+    if (state && state->can_go_forward) {
+        state->browser->GoForward();
+        state->hist_links_pos++;
     }
 }
 void ClientHandlerImpl::GoToHistoryOffset(int offset)
 {
-    if (m_Browser.get() && m_HistLinksPos + offset >= 0 &&
-            m_HistLinksPos + offset < m_HistLinks.size()) {
-        m_HistLinksPos += offset;
-        m_Browser->GetMainFrame()->LoadURL(m_HistLinks[m_HistLinksPos]);
+    if (DeferNavigation(NewCefRunnableMethod(
+            this, &ClientHandlerImpl::GoToHistoryOffset, offset))) {
+        return;
+    }
+    AutoLock lock_scope(this);
+    BrowserState* state = m_BrowserStates.Find(m_BrowserId);
+    if (!state)
+        return;
+    const int pos = state->hist_links_pos + offset;
+    if (pos >= 0 && pos < static_cast<int>(state->hist_links.size())) {
+        state->hist_links_pos = pos;
+        state->browser->GetMainFrame()->LoadURL(state->hist_links[pos]);
     }
 }
 void ClientHandlerImpl::Stop()
 {
-    if (m_Browser.get())
-        m_Browser->StopLoad();
+    CefRefPtr<CefBrowser> browser = GetBrowser();
+    if (browser.get())
+        browser->StopLoad();
+    if (m_Admission.get())
+        m_Admission->Cancel(m_BrowserId);
 }
 void ClientHandlerImpl::Reload(bool ignore_cache)
 {
-    if (m_Browser.get()) {
+    if (DeferNavigation(NewCefRunnableMethod(this, &ClientHandlerImpl::Reload,
+                                             ignore_cache))) {
+        return;
+    }
+    CefRefPtr<CefBrowser> browser = GetBrowser();
+    if (browser.get()) {
         if (ignore_cache)
-            m_Browser->ReloadIgnoreCache();
+            browser->ReloadIgnoreCache();
         else
-            m_Browser->Reload();
+            browser->Reload();
+    }
+}
+void ClientHandlerImpl::Resize(int browser_id, int width, int height)
+{
+    if (!CefCurrentlyOn(TID_UI)) {
+        void (ClientHandlerImpl::*resize)(int, int, int) =
+            &ClientHandlerImpl::Resize;
+        CefPostTask(TID_UI, NewCefRunnableMethod(this, resize, browser_id,
+                                                 width, height));
+        return;
+    }
+    // Interactive resizes come in bursts, only the settled size reallocates
+    // the buffers and makes the browser lay out again.
+    int generation;
+    {
+        AutoLock lock_scope(this);
+        BrowserState* state = m_BrowserStates.Find(browser_id);
+        if (!state)
+            return;
+        state->resize_width = width;
+        state->resize_height = height;
+        generation = ++state->resize_generation;
     }
+    CefPostDelayedTask(TID_UI,
+                       NewCefRunnableMethod(this,
+                                            &ClientHandlerImpl::OnResizeSettled,
+                                            browser_id, generation),
+                       kResizeSettleDelay);
 }
-void ClientHandlerImpl::Resize(int width, int height)
+void ClientHandlerImpl::OnResizeSettled(int browser_id, int generation)
 {
-    //TODO
+    REQUIRE_UI_THREAD();
+    CefRefPtr<CefBrowser> browser;
+    int width, height;
+    {
+        AutoLock lock_scope(this);
+        const BrowserState* state = m_BrowserStates.Find(browser_id);
+        if (!state || generation != state->resize_generation)
+            return;
+        browser = state->browser;
+        width = state->resize_width;
+        height = state->resize_height;
+    }
+    CefRefPtr<RenderHandler> handler = FindOSRHandler(browser);
+    if (handler.get())
+        handler->OnResize(browser, width, height);
+    browser->GetHost()->WasResized();
+}
+void ClientHandlerImpl::PauseRendering(int browser_id)
+{
+    if (!CefCurrentlyOn(TID_UI)) {
+        void (ClientHandlerImpl::*pause)(int) =
+            &ClientHandlerImpl::PauseRendering;
+        CefPostTask(TID_UI, NewCefRunnableMethod(this, pause, browser_id));
+        return;
+    }
+    CefRefPtr<CefBrowser> browser;
+    {
+        AutoLock lock_scope(this);
+        BrowserState* state = m_BrowserStates.Find(browser_id);
+        if (!state || state->is_paused)
+            return;
+        state->is_paused = true;
+        PublishNavigationState(*state);
+        browser = state->browser;
+    }
+    CefRefPtr<CefBrowserHost> host = browser->GetHost();
+    if (host->IsWindowRenderingDisabled())
+        host->WasHidden(true);
+    CefRefPtr<RenderHandler> handler = FindOSRHandler(browser);
+    if (handler.get())
+        handler->OnPauseRendering(browser);
 }
-void ClientHandlerImpl::PauseRendering()
+void ClientHandlerImpl::ResumeRendering(int browser_id)
 {
-    //TODO
+    if (!CefCurrentlyOn(TID_UI)) {
+        void (ClientHandlerImpl::*resume)(int) =
+            &ClientHandlerImpl::ResumeRendering;
+        CefPostTask(TID_UI, NewCefRunnableMethod(this, resume, browser_id));
+        return;
+    }
+    CefRefPtr<CefBrowser> browser;
+    {
+        AutoLock lock_scope(this);
+        BrowserState* state = m_BrowserStates.Find(browser_id);
+        if (!state || !state->is_paused)
+            return;
+        state->is_paused = false;
+        PublishNavigationState(*state);
+        browser = state->browser;
+    }
+    CefRefPtr<CefBrowserHost> host = browser->GetHost();
+    CefRefPtr<RenderHandler> handler = FindOSRHandler(browser);
+    if (handler.get())
+        handler->OnResumeRendering(browser);
+    if (host->IsWindowRenderingDisabled()) {
+        host->WasHidden(false);
+        // Buffers may have been released while paused, repaint everything.
+        CefRect rect;
+        if (GetViewRect(browser, rect))
+            host->Invalidate(CefRect(0, 0, rect.width, rect.height), PET_VIEW);
+    }
 }
-void ClientHandlerImpl::ResumeRendering()
+void ClientHandlerImpl::ClearHistory(int browser_id)
 {
-    //TODO
+    REQUIRE_UI_THREAD();
+    AutoLock lock_scope(this);
+    BrowserState* state = m_BrowserStates.Find(browser_id);
+    if (!state)
+        return;
+    state->hist_links.clear();
+    state->hist_links_pos = -1;
+    state->history_cleared = true;
+    state->can_go_back = false;
+    state->can_go_forward = false;
+    state->title.clear();
+    PublishNavigationState(*state);
 }
 void ClientHandlerImpl::Focus()
 {
-    if (m_Browser.get())
-        m_Browser->GetHost()->SendFocusEvent(true);
+    CefRefPtr<CefBrowser> browser = GetBrowser();
+    if (browser.get())
+        browser->GetHost()->SendFocusEvent(true);
 }
 void ClientHandlerImpl::Unfocus()
 {
-    if (m_Browser.get())
-        m_Browser->GetHost()->SendFocusEvent(false);
+    CefRefPtr<CefBrowser> browser = GetBrowser();
+    if (browser.get())
+        browser->GetHost()->SendFocusEvent(false);
 }
 double ClientHandlerImpl::GetZoomLevel()
 {
-    if (m_Browser.get())
-        return m_Browser->GetHost()->GetZoomLevel();
+    CefRefPtr<CefBrowser> browser = GetBrowser();
+    if (browser.get())
+        return browser->GetHost()->GetZoomLevel();
     return 0;
 }
 void ClientHandlerImpl::SetZoomLevel(double zoom_level)
 {
-    if (m_Browser.get())
-        m_Browser->GetHost()->SetZoomLevel(zoom_level);
+    CefRefPtr<CefBrowser> browser = GetBrowser();
+    if (browser.get())
+        browser->GetHost()->SetZoomLevel(zoom_level);
 }
 ///
 
@@ -183,6 +415,43 @@ bool ClientHandlerImpl::OnProcessMessageReceived(
         return true;
     }
 
+    if (m_Calls->OnProcessMessageReceived(browser, message))
+        return true;
+
+    if (message->GetName() == client_renderer::kHistoryNavigationMessage) {
+        AutoLock lock_scope(this);
+        BrowserState* state = m_BrowserStates.Find(browser->GetIdentifier());
+        if (state) {
+            state->history_navigation =
+                message->GetArgumentList()->GetString(0);
+        }
+        return true;
+    }
+
+    // Unpack batched platform.emit calls, delivered in order as if each had
+    // been sent on its own
+    if (message->GetName() == client_renderer::kPlatformBatchMessage) {
+        CefRefPtr<CefListValue> records = message->GetArgumentList();
+        for (size_t i = 0; i < records->GetSize(); ++i) {
+            CefRefPtr<CefListValue> record = records->GetList(i);
+            if (!record.get() || record->GetType(0) != VTYPE_STRING)
+                continue;
+            CefRefPtr<CefProcessMessage> emit = CefProcessMessage::Create(
+                client_renderer::GenPlatformMsg(record->GetString(0)));
+            util::SetList(record, emit->GetArgumentList());
+            DeliverToDelegates(browser, source_process, emit);
+        }
+        return true;
+    }
+
+    return DeliverToDelegates(browser, source_process, message);
+}
+
+bool ClientHandlerImpl::DeliverToDelegates(
+    CefRefPtr<CefBrowser> browser,
+    CefProcessId source_process,
+    CefRefPtr<CefProcessMessage> message)
+{
     // Handle process messages
     for (auto it = message_delegates_.begin(); it != message_delegates_.end();
          ++it) {
@@ -295,9 +564,9 @@ bool ClientHandlerImpl::OnPreKeyEvent(CefRefPtr<CefBrowser> browser,
     switch (event.windows_key_code) {
     case 0x7b:  // F12
         if (m_bDevToolsShown) {
-            CloseDevTools(m_Browser);  // @note the is the main browser
+            CloseDevTools(GetBrowser());  // @note the is the main browser
         } else {
-            ShowDevTools(m_Browser);
+            ShowDevTools(GetBrowser());
         }
         m_bDevToolsShown = !m_bDevToolsShown;
         return true;
@@ -342,17 +611,18 @@ void ClientHandlerImpl::OnAfterCreated(CefRefPtr<CefBrowser> browser)
     // @note Important - Create message handlers for platform
     //CreateMessageDelegates(message_delegates_);
 
-    AutoLock lock_scope(this);
-    if (!m_Browser.get())   {
-        // We need to keep the main child window, but not popup windows
-        m_Browser = browser;
-        m_BrowserId = browser->GetIdentifier();
-    } else if (browser->IsPopup()) {
-        // Add to the list of popup browsers.
-        m_PopupBrowsers.push_back(browser);
+    {
+        AutoLock lock_scope(this);
+        // The first browser is the main one, the others are popups or tools.
+        if (!m_BrowserId)
+            m_BrowserId = browser->GetIdentifier();
+        PublishNavigationState(*m_BrowserStates.Insert(browser));
     }
 
     m_BrowserCount++;
+
+    if (m_BrowserObserver.get())
+        m_BrowserObserver->OnAfterCreated(browser);
 }
 
 bool ClientHandlerImpl::DoClose(CefRefPtr<CefBrowser> browser)
@@ -380,28 +650,42 @@ void ClientHandlerImpl::OnBeforeClose(CefRefPtr<CefBrowser> browser)
     REQUIRE_UI_THREAD();
 
     message_router_->OnBeforeClose(browser);
+    m_Calls->OnBeforeClose(browser);
 
-    if (m_BrowserId == browser->GetIdentifier()) {
-        // Free the browser pointer so that the browser can be destroyed
-        m_Browser = NULL;
+    RenderHandlerMap::iterator handler = m_OSRHandlers.find(
+        browser->GetIdentifier());
+    if (handler != m_OSRHandlers.end()) {
+        handler->second->OnBeforeClose(browser);
+        m_OSRHandlers.erase(handler);
+    }
 
-        if (m_OSRHandler.get()) {
-            m_OSRHandler->OnBeforeClose(browser);
-            m_OSRHandler = NULL;
-        }
-    } else if (browser->IsPopup()) {
-        // Remove from the browser popup list.
-        BrowserList::iterator it = m_PopupBrowsers.begin();
-        for (; it != m_PopupBrowsers.end(); ++it) {
-            if ((*it)->IsSame(browser)) {
-                m_PopupBrowsers.erase(it);
-                break;
-            }
+    bool is_main;
+    bool last_browser;
+    {
+        AutoLock lock_scope(this);
+        // Free the browser pointer so that the browser can be destroyed
+        m_BrowserStates.Remove(browser->GetIdentifier());
+        m_PendingNavigations.erase(browser->GetIdentifier());
+        last_browser = m_BrowserStates.empty();
+        is_main = m_BrowserId == browser->GetIdentifier();
+        if (is_main) {
+            m_BrowserId = 0;
+            m_MainNavState->Publish(NavigationState());
         }
     }
+    // The fallback handler may serve several browsers, popups and pooled
+    // ones included, so it goes with the last of them.
+    if (last_browser && m_OSRHandler.get()) {
+        m_OSRHandler->OnBeforeClose(browser);
+        m_OSRHandler = NULL;
+    }
+
+    if (m_Admission.get())
+        m_Admission->OnBrowserClosed(browser->GetIdentifier());
 
-    if (--m_BrowserCount == 0) {
-        // All browser windows have closed.
+    m_BrowserCount--;
+    if (last_browser) {
+        // All browser windows of this client have closed.
         // Remove and delete message router handlers.
         MessageHandlerSet::const_iterator it = message_handlers_.begin();
         for (; it != message_handlers_.end(); ++it) {
@@ -414,6 +698,9 @@ void ClientHandlerImpl::OnBeforeClose(CefRefPtr<CefBrowser> browser)
         // Quit the application message loop.
         //@todo AppQuitMessageLoop();
     }
+
+    if (m_BrowserObserver.get())
+        m_BrowserObserver->OnBeforeClose(browser);
 }
 
 // CefLoadHandler
@@ -422,19 +709,43 @@ void ClientHandlerImpl::OnLoadingStateChange(CefRefPtr<CefBrowser> browser,
                                              bool canGoBack,
                                              bool canGoForward)
 {
-    SetLoading(isLoading);
-    SetNavState(canGoBack, canGoForward);
+    {
+        AutoLock lock_scope(this);
+        BrowserState* state = m_BrowserStates.Find(browser->GetIdentifier());
+        if (state) {
+            state->is_loading = isLoading;
+            state->can_go_back = canGoBack;
+            state->can_go_forward = canGoForward;
+            if (state->history_cleared) {
+                const int pos = state->hist_links_pos;
+                state->can_go_back = canGoBack && pos > 0;
+                state->can_go_forward = canGoForward &&
+                    pos + 1 < static_cast<int>(state->hist_links.size());
+            }
+            PublishNavigationState(*state);
+        }
+    }
+    if (m_Admission.get())
+        m_Admission->OnLoadingStateChange(browser->GetIdentifier(), isLoading);
 }
 void ClientHandlerImpl::OnLoadStart(CefRefPtr<CefBrowser> browser,
                                     CefRefPtr<CefFrame> frame)
 {
     if (load_handler_.get())
         load_handler_->OnLoadStart(browser, frame);
-    if (frame->IsMain() && frame->GetURL() != m_HistLinks[m_HistLinksPos]) {
+    if (!frame->IsMain())
+        return;
+    AutoLock lock_scope(this);
+    BrowserState* state = m_BrowserStates.Find(browser->GetIdentifier());
+    if (!state)
+        return;
+    const CefString url = frame->GetURL();
+    if (state->hist_links_pos < 0 ||
+        url != state->hist_links[state->hist_links_pos]) {
         // Update history links on main frame when opening new link
-        m_HistLinks.resize(m_HistLinksPos + 1);
-        m_HistLinks.push_back(frame->GetURL());
-        m_HistLinksPos++;
+        state->hist_links.resize(state->hist_links_pos + 1);
+        state->hist_links.push_back(url);
+        state->hist_links_pos++;
     }
 }
 void ClientHandlerImpl::OnLoadError(CefRefPtr<CefBrowser> browser,
@@ -459,6 +770,8 @@ void ClientHandlerImpl::OnLoadEnd(CefRefPtr<CefBrowser> browser,
 {
     if (load_handler_.get())
         load_handler_->OnLoadEnd(browser, frame, httpStatusCode);
+    if (m_BrowserObserver.get())
+        m_BrowserObserver->OnLoadEnd(browser, frame, httpStatusCode);
 }
 
 bool ClientHandlerImpl::OnBeforeBrowse(CefRefPtr<CefBrowser> browser,
@@ -467,6 +780,31 @@ bool ClientHandlerImpl::OnBeforeBrowse(CefRefPtr<CefBrowser> browser,
                                        bool is_redirect)
 {
     message_router_->OnBeforeBrowse(browser, frame);
+    // Returning true cancels the navigation.
+    if (m_UrlFilter.get() && m_UrlFilter->ShouldBlock(request->GetURL()))
+        return true;
+    // Navigations of the entry points above were admitted before they
+    // started, others are cancelled here and loaded again once admitted.
+    // Back and forward cannot be started again without losing the history
+    // after them, they go over the limit instead.
+    const int browser_id = browser->GetIdentifier();
+    if (m_Admission.get() && frame->IsMain() && !is_redirect &&
+        !m_Admission->Admit(browser_id) &&
+        !IsHistoryNavigation(browser_id, request->GetURL())) {
+        CefRequest::HeaderMap headers;
+        request->GetHeaderMap(headers);
+        CefRefPtr<CefRequest> copy = CefRequest::Create();
+        copy->Set(request->GetURL(), request->GetMethod(),
+                  request->GetPostData(), headers);
+        m_Admission->Defer(browser_id, GetNavigationStateCell(browser_id),
+                           NewCefRunnableFunction(&LoadRequest, browser, copy));
+        return true;
+    }
+    if (m_ResponseCache.get()) {
+        AutoLock lock_scope(this);
+        m_PendingNavigations[browser_id][frame->GetIdentifier()] =
+            request->GetURL();
+    }
     return false;
 }
 
@@ -475,10 +813,54 @@ CefRefPtr<CefResourceHandler> ClientHandlerImpl::GetResourceHandler(
     CefRefPtr<CefFrame> frame,
     CefRefPtr<CefRequest> request)
 {
-    std::string url = request->GetURL();
     // @note This is the place to handle certain url specially
+    if (m_UrlFilter.get() && m_UrlFilter->ShouldBlock(request->GetURL()))
+        return new BlockedResourceHandler();
+    CefRefPtr<CefResourceHandler> handler;
+    if (m_AssetArchive.get())
+        handler = m_AssetArchive->CreateResourceHandler(request);
+    if (!handler.get() && m_ResponseCache.get() &&
+        !TakePendingNavigation(browser->GetIdentifier(),
+                               frame->GetIdentifier(), request->GetURL())) {
+        handler = m_ResponseCache->CreateResourceHandler(request);
+    }
+    return handler;
+}
+
+bool ClientHandlerImpl::TakePendingNavigation(int browser_id,
+                                              int64 frame_id,
+                                              const std::string& url)
+{
+    AutoLock lock_scope(this);
+    PendingNavigationMap::iterator browser =
+        m_PendingNavigations.find(browser_id);
+    if (browser == m_PendingNavigations.end())
+        return false;
+    std::unordered_map<int64, std::string>::iterator frame =
+        browser->second.find(frame_id);
+    if (frame == browser->second.end() || frame->second != url)
+        return false;
+    browser->second.erase(frame);
+    return true;
+}
 
-    return NULL;
+bool ClientHandlerImpl::IsHistoryNavigation(int browser_id,
+                                            const CefString& url)
+{
+    AutoLock lock_scope(this);
+    BrowserState* state = m_BrowserStates.Find(browser_id);
+    if (!state)
+        return false;
+    if (!state->history_navigation.empty()) {
+        const bool announced = state->history_navigation == url;
+        state->history_navigation.clear();
+        if (announced)
+            return true;
+    }
+    const int pos = state->hist_links_pos;
+    const int size = static_cast<int>(state->hist_links.size());
+    return (pos > 0 && state->hist_links[pos - 1] == url) ||
+           (pos >= 0 && pos + 1 < size && state->hist_links[pos + 1] == url);
 }
 
 bool ClientHandlerImpl::OnQuotaRequest(CefRefPtr<CefBrowser> browser,
@@ -513,7 +895,14 @@ void ClientHandlerImpl::OnRenderProcessTerminated(CefRefPtr<CefBrowser> browser,
     if (process_handler_.get())
         process_handler_->OnRenderProcessTerminated(browser, status);
 
-    m_bIsCrashed = true;
+    {
+        AutoLock lock_scope(this);
+        BrowserState* state = m_BrowserStates.Find(browser->GetIdentifier());
+        if (state) {
+            state->is_crashed = true;
+            PublishNavigationState(*state);
+        }
+    }
 
     // Load the startup URL if that's not the website that we terminated on.
     CefRefPtr<CefFrame> frame = browser->GetMainFrame();
@@ -525,22 +914,26 @@ void ClientHandlerImpl::OnRenderProcessTerminated(CefRefPtr<CefBrowser> browser,
         url.find(startupURL) != 0) {
         frame->LoadURL(startupURL);
     }
+    if (m_BrowserObserver.get())
+        m_BrowserObserver->OnRenderProcessTerminated(browser, status);
 }
 
 /// *** BEGIN IMPORTANT *** ///
 bool ClientHandlerImpl::GetRootScreenRect(CefRefPtr<CefBrowser> browser,
                                           CefRect& rect)
 {
-    if (!m_OSRHandler.get())
+    CefRefPtr<RenderHandler> handler = FindOSRHandler(browser);
+    if (!handler.get())
         return false;
-    return m_OSRHandler->GetRootScreenRect(browser, rect);
+    return handler->GetRootScreenRect(browser, rect);
 }
 
 bool ClientHandlerImpl::GetViewRect(CefRefPtr<CefBrowser> browser, CefRect& rect)
 {
-    if (!m_OSRHandler.get())
+    CefRefPtr<RenderHandler> handler = FindOSRHandler(browser);
+    if (!handler.get())
         return false;
-    return m_OSRHandler->GetViewRect(browser, rect);
+    return handler->GetViewRect(browser, rect);
 }
 
 /// *** BEGIN IMPORTANT *** ///
@@ -550,33 +943,37 @@ bool ClientHandlerImpl::GetScreenPoint(CefRefPtr<CefBrowser> browser,
                                    int& screenX,
                                    int& screenY)
 {
-    if (!m_OSRHandler.get())
+    CefRefPtr<RenderHandler> handler = FindOSRHandler(browser);
+    if (!handler.get())
         return false;
-    return m_OSRHandler->GetScreenPoint(browser, viewX, viewY, screenX, screenY);
+    return handler->GetScreenPoint(browser, viewX, viewY, screenX, screenY);
 }
 
 bool ClientHandlerImpl::GetScreenInfo(CefRefPtr<CefBrowser> browser,
                                   CefScreenInfo& screen_info)
 {
-    if (!m_OSRHandler.get())
+    CefRefPtr<RenderHandler> handler = FindOSRHandler(browser);
+    if (!handler.get())
         return false;
-    return m_OSRHandler->GetScreenInfo(browser, screen_info);
+    return handler->GetScreenInfo(browser, screen_info);
 }
 
 void ClientHandlerImpl::OnPopupShow(CefRefPtr<CefBrowser> browser,
                                 bool show)
 {
-    if (!m_OSRHandler.get())
+    CefRefPtr<RenderHandler> handler = FindOSRHandler(browser);
+    if (!handler.get())
         return;
-    return m_OSRHandler->OnPopupShow(browser, show);
+    handler->OnPopupShow(browser, show);
 }
 
 void ClientHandlerImpl::OnPopupSize(CefRefPtr<CefBrowser> browser,
                                 const CefRect& rect)
 {
-    if (!m_OSRHandler.get())
+    CefRefPtr<RenderHandler> handler = FindOSRHandler(browser);
+    if (!handler.get())
         return;
-    return m_OSRHandler->OnPopupSize(browser, rect);
+    handler->OnPopupSize(browser, rect);
 }
 
 void ClientHandlerImpl::OnPaint(CefRefPtr<CefBrowser> browser,
@@ -586,9 +983,10 @@ void ClientHandlerImpl::OnPaint(CefRefPtr<CefBrowser> browser,
                             int width,
                             int height)
 {
-    if (!m_OSRHandler.get())
+    CefRefPtr<RenderHandler> handler = FindOSRHandler(browser);
+    if (!handler.get())
         return;
-    m_OSRHandler->OnPaint(browser, type, dirtyRects, buffer, width, height);
+    handler->OnPaint(browser, type, dirtyRects, buffer, width, height);
 }
 
 // void ClientHandlerImpl::OnCursorChange(CefRefPtr<CefBrowser> browser,
@@ -600,6 +998,35 @@ void ClientHandlerImpl::OnPaint(CefRefPtr<CefBrowser> browser,
 // }
 /// *** END IMPORTANT *** ///
 
+CefRefPtr<ClientHandlerImpl::RenderHandler> ClientHandlerImpl::GetOSRHandler(
+    int browser_id) const
+{
+    RenderHandlerMap::const_iterator it = m_OSRHandlers.find(browser_id);
+    if (it == m_OSRHandlers.end())
+        return NULL;
+    return it->second;
+}
+
+CefRefPtr<ClientHandlerImpl::RenderHandler> ClientHandlerImpl::FindOSRHandler(
+    CefRefPtr<CefBrowser> browser)
+{
+    if (!browser.get())
+        return m_OSRHandler;
+    const int id = browser->GetIdentifier();
+    RenderHandlerMap::const_iterator it = m_OSRHandlers.find(id);
+    if (it != m_OSRHandlers.end())
+        return it->second;
+    if (m_RenderHandlerFactory.get()) {
+        CefRefPtr<RenderHandler> handler =
+            m_RenderHandlerFactory->CreateRenderHandler(browser);
+        if (handler.get()) {
+            m_OSRHandlers[id] = handler;
+            return handler;
+        }
+    }
+    return m_OSRHandler;
+}
+
 bool ClientHandlerImpl::OnFileDialog(CefRefPtr<CefBrowser> browser,
                                      CefDialogHandler::FileDialogMode mode,
                                      const CefString& title,
@@ -655,17 +1082,23 @@ void ClientHandlerImpl::CloseAllBrowsers(bool force_close)
         return;
     }
 
-    if (!m_PopupBrowsers.empty()) {
-        // Request that any popup browsers close.
-        BrowserList::const_iterator it = m_PopupBrowsers.begin();
-        for (; it != m_PopupBrowsers.end(); ++it)
-            (*it)->GetHost()->CloseBrowser(force_close);
-    }
-
-    if (m_Browser.get()) {
-        // Request that the main browser close.
-        m_Browser->GetHost()->CloseBrowser(force_close);
+    // Request that the popup browsers and then the main browser close.
+    std::vector<CefRefPtr<CefBrowser> > browsers;
+    CefRefPtr<CefBrowser> main_browser;
+    {
+        AutoLock lock_scope(this);
+        BrowserStateTable::const_iterator it = m_BrowserStates.begin();
+        for (; it != m_BrowserStates.end(); ++it) {
+            if (it->browser->GetIdentifier() == m_BrowserId)
+                main_browser = it->browser;
+            else
+                browsers.push_back(it->browser);
+        }
     }
+    if (main_browser.get())
+        browsers.push_back(main_browser);
+    for (size_t i = 0; i < browsers.size(); ++i)
+        browsers[i]->GetHost()->CloseBrowser(force_close);
 }
 
 void ClientHandlerImpl::SetLastDownloadFile(const std::string& fileName)
@@ -0,0 +1,25 @@
+// Copyright (c) 2011 The Chromium Embedded Framework Authors. All rights
+// reserved. Use of this source code is governed by a BSD-style license that
+// can be found in the LICENSE file.
+
+#include "client_handler_impl.h"
+
+#include <stdlib.h>
+#include <string>
+
+void ClientHandlerImpl::SendNotification(NotificationType type)
+{
+    // Headless hosts have no main window to notify.
+}
+
+std::string ClientHandlerImpl::GetDownloadPath(const std::string& file_name)
+{
+    std::string path;
+    // Save the file in the user's home folder, if there is one.
+    const char* home = getenv("HOME");
+    if (home && *home) {
+        path = home;
+        path += "/" + file_name;
+    }
+    return path;
+}
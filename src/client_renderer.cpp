@@ -4,13 +4,20 @@
 
 #include "client_renderer.h"
 
-#include <sstream>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <include/cef_dom.h>
+#include <include/cef_runnable.h>
 #include <include/cef_v8.h>
 #include <include/wrapper/cef_message_router.h>
 
+#include "platform_events.h"
 #include "util.h"
 #include "v8_util.h"
 
@@ -19,25 +26,433 @@ namespace client_renderer {
     const char kFocusedNodeChangedMessage[] = "ClientRenderer.FocusedNodeChanged";
     const char kTestMessage[] = "ClientRenderer.TestMsg";
     const char kPlatformMessage[] = "ClientRenderer.PlatformMsg";
+    const char kPlatformBatchMessage[] = "ClientRenderer.PlatformBatch";
+    const char kPlatformCallMessage[] = "ClientRenderer.PlatformCall";
+    const char kPlatformCancelMessage[] = "ClientRenderer.PlatformCancel";
+    const char kPlatformResultMessage[] = "ClientRenderer.PlatformResult";
+    const char kHistoryNavigationMessage[] = "ClientRenderer.HistoryNavigation";
 
-    CallbackMap g_callbacks;
-
-    std::string GenPlatformMsg(std::string event_name) {
-        std::ostringstream oss;
-        oss << kPlatformMessage << ':' << event_name;
-        return oss.str();
+    std::string GenPlatformMsg(const std::string& event_name) {
+        const size_t prefix_length = sizeof(kPlatformMessage) - 1;
+        std::string message;
+        message.reserve(prefix_length + 1 + event_name.size());
+        message.append(kPlatformMessage, prefix_length);
+        message += ':';
+        message += event_name;
+        return message;
     }
 
-    bool IsPlatformMsg(std::string message) {
-        return message.substr(0, message.find_first_of(':')) == std::string(kPlatformMessage);
+    bool IsPlatformMsg(const std::string& message) {
+        const size_t prefix_length = sizeof(kPlatformMessage) - 1;
+        return message.compare(0, prefix_length, kPlatformMessage) == 0 &&
+            (message.size() == prefix_length ||
+             message[prefix_length] == ':');
     }
 
-    std::string GetEventFromMsg(std::string message) {
+    std::string GetEventFromMsg(const std::string& message) {
         return message.substr(message.find_first_of(':') + 1);
     }
 
     namespace {
 
+        // Size of a batch that makes it leave at once.
+        const size_t kDefaultBatchBytes = 64 * 1024;
+
+        // Last batch generation handed out, across browsers and pages, so
+        // that a deadline never matches a batch it was not posted for.
+        int g_batch_generation = 0;
+
+        // platform.emit calls of one browser waiting to be sent together,
+        // enabled with platform.setBatching until the main frame navigates.
+        // Renderer thread only.
+        struct EmitBatch {
+            EmitBatch()
+                : enabled(false),
+                  max_delay(0),
+                  max_bytes(kDefaultBatchBytes),
+                  bytes(0),
+                  generation(++g_batch_generation),
+                  flush_pending(false) {}
+
+            bool enabled;
+            // Time in ms a batch may wait, 0 to send it once the current
+            // task is done.
+            int max_delay;
+            size_t max_bytes;
+
+            CefRefPtr<CefBrowser> browser;
+            CefRefPtr<CefProcessMessage> message;
+            // Estimated size of |message|.
+            size_t bytes;
+            // Tells the deadlines of successive batches apart.
+            int generation;
+            bool flush_pending;
+        };
+        std::map<int, EmitBatch> g_batches;
+
+        // Rough serialized size of |values|.
+        size_t EstimateSize(const CefV8ValueList& values)
+        {
+            size_t size = 0;
+            for (size_t i = 0; i < values.size(); ++i) {
+                size += 8;
+                if (values[i]->IsString()) {
+                    size += values[i]->GetStringValue().length();
+                } else if (values[i]->IsArray()) {
+                    CefV8ValueList items(values[i]->GetArrayLength());
+                    for (size_t j = 0; j < items.size(); ++j)
+                        items[j] = values[i]->GetValue(static_cast<int>(j));
+                    size += EstimateSize(items);
+                }
+            }
+            return size;
+        }
+
+        // Send the batch of |browser_id|, if any.
+        void FlushBatch(int browser_id)
+        {
+            std::map<int, EmitBatch>::iterator it = g_batches.find(browser_id);
+            if (it == g_batches.end() || !it->second.message.get())
+                return;
+            EmitBatch& batch = it->second;
+            CefRefPtr<CefProcessMessage> message = batch.message;
+            batch.message = NULL;
+            batch.bytes = 0;
+            batch.generation = ++g_batch_generation;
+            batch.flush_pending = false;
+            batch.browser->SendProcessMessage(PID_BROWSER, message);
+        }
+
+        void OnBatchDeadline(int browser_id, int generation)
+        {
+            std::map<int, EmitBatch>::iterator it = g_batches.find(browser_id);
+            if (it != g_batches.end() && it->second.generation == generation)
+                FlushBatch(browser_id);
+        }
+
+        // Call |function| from a microtask of |context|, i.e. right after
+        // the running script. Returns false if there are no promises.
+        bool QueueMicrotask(CefRefPtr<CefV8Context> context,
+                            CefRefPtr<CefV8Value> function)
+        {
+            CefRefPtr<CefV8Value> promise_class =
+                context->GetGlobal()->GetValue("Promise");
+            if (!promise_class.get() || !promise_class->IsFunction())
+                return false;
+            CefRefPtr<CefV8Value> resolve = promise_class->GetValue("resolve");
+            if (!resolve.get() || !resolve->IsFunction())
+                return false;
+            CefRefPtr<CefV8Value> promise =
+                resolve->ExecuteFunction(promise_class, CefV8ValueList());
+            if (!promise.get() || !promise->IsObject())
+                return false;
+            CefRefPtr<CefV8Value> then = promise->GetValue("then");
+            if (!then.get() || !then->IsFunction())
+                return false;
+            return then->ExecuteFunction(promise,
+                                         CefV8ValueList(1, function)).get() !=
+                NULL;
+        }
+
+        PlatformEventTable g_events;
+        PlatformEventBus g_bus;
+
+        // Message of |event| for the listener |listener_id|.
+        struct QueuedMessage {
+            PlatformEventId event;
+            int listener_id;
+            CefRefPtr<CefProcessMessage> message;
+        };
+
+        // Platform messages received for the listeners of one context and
+        // not delivered yet. A burst of messages is delivered with one entry
+        // into the context.
+        struct DeliveryQueue {
+            CefRefPtr<CefV8Context> context;
+            int browser_id;
+            std::vector<QueuedMessage> messages;
+            // Coalescing key to the index of its message.
+            std::unordered_map<uint64, size_t> coalesced;
+        };
+        std::vector<DeliveryQueue> g_queues;
+        bool g_delivery_pending = false;
+
+        // Whether argument |index| of |a| and |b| is the same value, or
+        // missing from both.
+        bool SameArgument(CefRefPtr<CefListValue> a,
+                          CefRefPtr<CefListValue> b,
+                          int index)
+        {
+            const bool in_a =
+                index >= 0 && index < static_cast<int>(a->GetSize());
+            const bool in_b =
+                index >= 0 && index < static_cast<int>(b->GetSize());
+            if (!in_a || !in_b)
+                return in_a == in_b;
+            if (a->GetType(index) != b->GetType(index))
+                return false;
+            switch (a->GetType(index)) {
+                case VTYPE_STRING:
+                return a->GetString(index) == b->GetString(index);
+                case VTYPE_INT:
+                return a->GetInt(index) == b->GetInt(index);
+                case VTYPE_DOUBLE:
+                return a->GetDouble(index) == b->GetDouble(index);
+                case VTYPE_BOOL:
+                return a->GetBool(index) == b->GetBool(index);
+                default:
+                return true;
+            }
+        }
+
+        // Coalescing key of |args| of |event| for |listener|: the event and
+        // the listener, mixed with a hash of the argument it coalesces by.
+        // Queues are per context, so browser and frame are implied. Equal
+        // keys of different values are told apart with SameArgument.
+        uint64 GetCoalescingKey(PlatformEventId event,
+                                const PlatformEventBus::Listener& listener,
+                                CefRefPtr<CefListValue> args)
+        {
+            const uint64 key = (static_cast<uint64>(event) << 32) |
+                static_cast<uint32>(listener.id);
+            const int index = listener.key;
+            if (index < 0 || index >= static_cast<int>(args->GetSize()))
+                return key;
+            // 64-bit FNV-1a over the value, typed
+            uint64 hash = 14695981039346656037ULL ^ args->GetType(index);
+            switch (args->GetType(index)) {
+                case VTYPE_STRING: {
+                    const CefString value = args->GetString(index);
+                    for (size_t i = 0; i < value.length(); ++i) {
+                        hash ^= static_cast<uint64>(value.c_str()[i]);
+                        hash *= 1099511628211ULL;
+                    }
+                    break;
+                }
+                case VTYPE_INT:
+                hash ^= static_cast<uint32>(args->GetInt(index));
+                break;
+                case VTYPE_DOUBLE: {
+                    const double value = args->GetDouble(index);
+                    uint64 bits;
+                    memcpy(&bits, &value, sizeof(bits));
+                    hash ^= bits;
+                    break;
+                }
+                case VTYPE_BOOL:
+                hash ^= args->GetBool(index) ? 1 : 0;
+                break;
+                default:
+                break;
+            }
+            hash *= 1099511628211ULL;
+            return key ^ hash;
+        }
+
+        void DeliverQueue(const DeliveryQueue& queue)
+        {
+            if (!queue.context->IsValid())
+                return;
+            queue.context->Enter();
+            std::vector<int> batched;
+            for (size_t i = 0; i < queue.messages.size(); ++i) {
+                const QueuedMessage& queued = queue.messages[i];
+                // The listener may have been removed since the message was
+                // queued. Callbacks may add and remove listeners, which
+                // moves them, so copy what is needed.
+                const PlatformEventBus::Listener* listener =
+                    g_bus.FindListener(queued.event, queue.browser_id,
+                                       queued.listener_id);
+                if (!listener)
+                    continue;
+                CefRefPtr<CefV8Value> callback = listener->callback;
+                const bool batch = listener->batch;
+                if (listener->once) {
+                    g_bus.RemoveListener(queued.event, queue.browser_id,
+                                         queued.listener_id);
+                }
+                if (!batch) {
+                    CefV8ValueList arguments;
+                    util::SetList(queued.message->GetArgumentList(),
+                                  arguments);
+                    callback->ExecuteFunction(NULL, arguments);
+                    continue;
+                }
+                // All events of a batched listener go at its first one
+                if (std::find(batched.begin(), batched.end(),
+                              queued.listener_id) != batched.end()) {
+                    continue;
+                }
+                batched.push_back(queued.listener_id);
+                CefRefPtr<CefV8Value> events = CefV8Value::CreateArray(0);
+                int count = 0;
+                for (size_t j = i; j < queue.messages.size(); ++j) {
+                    if (queue.messages[j].listener_id != queued.listener_id)
+                        continue;
+                    CefRefPtr<CefListValue> args =
+                        queue.messages[j].message->GetArgumentList();
+                    CefRefPtr<CefV8Value> value =
+                        CefV8Value::CreateArray(args->GetSize());
+                    util::SetList(args, value);
+                    events->SetValue(count++, value);
+                }
+                callback->ExecuteFunction(NULL, CefV8ValueList(1, events));
+            }
+            queue.context->Exit();
+        }
+
+        void DeliverQueued()
+        {
+            g_delivery_pending = false;
+            // Messages received while delivering start a new burst
+            std::vector<DeliveryQueue> queues;
+            queues.swap(g_queues);
+            for (size_t i = 0; i < queues.size(); ++i)
+                DeliverQueue(queues[i]);
+        }
+
+        // Queue |message| of |event| for delivery to |listener|. Delivery
+        // runs once the messages already received are queued as well.
+        void QueueDelivery(const PlatformEventBus::Listener& listener,
+                           int browser_id,
+                           PlatformEventId event,
+                           CefRefPtr<CefProcessMessage> message)
+        {
+            std::vector<DeliveryQueue>::iterator queue = g_queues.begin();
+            for (; queue != g_queues.end(); ++queue) {
+                if (queue->context->IsSame(listener.context))
+                    break;
+            }
+            if (queue == g_queues.end()) {
+                DeliveryQueue new_queue;
+                new_queue.context = listener.context;
+                new_queue.browser_id = browser_id;
+                queue = g_queues.insert(g_queues.end(), new_queue);
+            }
+
+            QueuedMessage queued;
+            queued.event = event;
+            queued.listener_id = listener.id;
+            queued.message = message;
+            if (listener.coalesce) {
+                // Latest value wins, in the place of the first one
+                CefRefPtr<CefListValue> args = message->GetArgumentList();
+                const uint64 key = GetCoalescingKey(event, listener, args);
+                std::unordered_map<uint64, size_t>::iterator it =
+                    queue->coalesced.find(key);
+                if (it == queue->coalesced.end()) {
+                    queue->coalesced[key] = queue->messages.size();
+                } else {
+                    QueuedMessage& first = queue->messages[it->second];
+                    if (first.event == event &&
+                        first.listener_id == listener.id &&
+                        SameArgument(first.message->GetArgumentList(), args,
+                                     listener.key)) {
+                        first = queued;
+                        return;
+                    }
+                }
+            }
+            queue->messages.push_back(queued);
+
+            if (!g_delivery_pending) {
+                g_delivery_pending = true;
+                CefPostTask(TID_RENDERER,
+                            NewCefRunnableFunction(&DeliverQueued));
+            }
+        }
+
+        // Time in ms a platform.call may take by default.
+        const int kDefaultCallTimeout = 30000;
+
+        // Source of a function returning a promise with its resolve and
+        // reject functions, as V8 values cannot construct promises.
+        const char kDeferredSource[] =
+            "(function() {"
+            "  var deferred = {};"
+            "  deferred.promise = new Promise(function(resolve, reject) {"
+            "    deferred.resolve = resolve;"
+            "    deferred.reject = reject;"
+            "  });"
+            "  return deferred;"
+            "})";
+
+        // Calls of platform.call waiting for their answer, by call id.
+        struct PendingCall {
+            CefRefPtr<CefV8Context> context;
+            CefRefPtr<CefBrowser> browser;
+            CefRefPtr<CefV8Value> resolve;
+            CefRefPtr<CefV8Value> reject;
+        };
+        std::map<int, PendingCall> g_calls;
+        int g_last_call_id = 0;
+
+        // Error of |message|, to reject promises with. In a context.
+        CefRefPtr<CefV8Value> CreateError(CefRefPtr<CefV8Context> context,
+                                          const std::string& message)
+        {
+            CefRefPtr<CefV8Value> error_class =
+                context->GetGlobal()->GetValue("Error");
+            CefRefPtr<CefV8Value> text = CefV8Value::CreateString(message);
+            if (error_class.get() && error_class->IsFunction()) {
+                CefRefPtr<CefV8Value> error =
+                    error_class->ExecuteFunction(NULL,
+                                                 CefV8ValueList(1, text));
+                if (error.get())
+                    return error;
+            }
+            return text;
+        }
+
+        // Resolve call |call_id| with the first value of |result|, or reject
+        // it with |error|. Unknown calls, e.g. timed out, are ignored.
+        void SettleCall(int call_id, bool success,
+                        CefRefPtr<CefListValue> result,
+                        const std::string& error)
+        {
+            std::map<int, PendingCall>::iterator it = g_calls.find(call_id);
+            if (it == g_calls.end())
+                return;
+            PendingCall call = it->second;
+            g_calls.erase(it);
+            if (!call.context->IsValid())
+                return;
+
+            call.context->Enter();
+            if (success) {
+                CefV8ValueList values;
+                if (result.get())
+                    util::SetList(result, values);
+                if (values.empty())
+                    values.push_back(CefV8Value::CreateUndefined());
+                call.resolve->ExecuteFunction(NULL,
+                                              CefV8ValueList(1, values[0]));
+            } else {
+                call.reject->ExecuteFunction(
+                    NULL, CefV8ValueList(1, CreateError(call.context, error)));
+            }
+            call.context->Exit();
+        }
+
+        // Reject call |call_id| with |reason| and tell the browser, so that
+        // its handler can stop early.
+        void AbortCall(int call_id, const std::string& reason)
+        {
+            std::map<int, PendingCall>::iterator it = g_calls.find(call_id);
+            if (it == g_calls.end())
+                return;
+            CefRefPtr<CefProcessMessage> message =
+                CefProcessMessage::Create(kPlatformCancelMessage);
+            message->GetArgumentList()->SetInt(0, call_id);
+            it->second.browser->SendProcessMessage(PID_BROWSER, message);
+            SettleCall(call_id, false, NULL, reason);
+        }
+
+        void OnCallTimeout(int call_id)
+        {
+            AbortCall(call_id, "platform.call timed out");
+        }
+
         /// @note Test platform javascript callbacks
         class PlatformV8Handler : public CefV8Handler
         {
@@ -49,35 +464,240 @@ namespace client_renderer {
                                  CefRefPtr<CefV8Value>& retval,
                                  CefString& exception) OVERRIDE {
                 CefRefPtr<CefV8Context> context = CefV8Context::GetCurrentContext();
-                if (name == "bind") {
-                    // Save the callback, together with its context
-                    if (arguments.size() == 2 && arguments[0]->IsString()
+                if (name == "bind" || name == "once") {
+                    // Add a listener, together with its context, after the
+                    // others of the event. Returns its id.
+                    // bind(event, callback[, {batch, coalesce, key}])
+                    if ((arguments.size() == 2 || arguments.size() == 3)
+                        && arguments[0]->IsString()
                         && arguments[1]->IsFunction()) {
-                        std::string event_name = arguments[0]->GetStringValue();
-                        std::string message_name = GenPlatformMsg(event_name);
-                        int browser_id = context->GetBrowser()->GetIdentifier();
-                        g_callbacks[std::make_pair(message_name, browser_id)] =
-                            std::make_pair(context, arguments[1]);
+                        PlatformEventBus::Listener listener;
+                        if (arguments.size() == 3 && arguments[2]->IsObject())
+                            listener = GetListenerOptions(arguments[2]);
+                        listener.context = context;
+                        listener.callback = arguments[1];
+                        listener.once = name == "once";
+                        PlatformEventId event =
+                            g_events.Intern(arguments[0]->GetStringValue());
+                        int id = g_bus.Add(
+                            event, context->GetBrowser()->GetIdentifier(),
+                            context->GetFrame()->GetIdentifier(), listener);
+                        retval = CefV8Value::CreateInt(id);
+                        return true;
+                    }
+                } else if (name == "unbind") {
+                    // unbind(event[, callback]), the listeners of the event
+                    // in this context, or those of |callback| only. Returns
+                    // the number removed.
+                    if ((arguments.size() == 1 || arguments.size() == 2)
+                        && arguments[0]->IsString()) {
+                        CefRefPtr<CefV8Value> callback;
+                        if (arguments.size() == 2 && arguments[1]->IsFunction())
+                            callback = arguments[1];
+                        PlatformEventId event =
+                            g_events.Find(arguments[0]->GetStringValue());
+                        int removed = 0;
+                        if (event != kNoPlatformEvent) {
+                            removed = g_bus.Remove(
+                                event, context->GetBrowser()->GetIdentifier(),
+                                context, callback);
+                        }
+                        retval = CefV8Value::CreateInt(removed);
                         return true;
                     }
                 } else if (name == "emit") {
                     // Send IPC message to the browser process
                     if (arguments.size() >= 1 && arguments[0]->IsString()) {
-                        std::string event_name = arguments[0]->GetStringValue();
-                        std::string message_name = GenPlatformMsg(event_name);
-                        CefRefPtr<CefProcessMessage> message =
-                            CefProcessMessage::Create(message_name);
+                        CefRefPtr<CefBrowser> browser = context->GetBrowser();
+                        std::map<int, EmitBatch>::iterator batch =
+                            g_batches.find(browser->GetIdentifier());
+                        if (batch != g_batches.end() && batch->second.enabled) {
+                            AddToBatch(context, browser, batch->second,
+                                       arguments);
+                            return true;
+                        }
+                        // Bound events have their message name already
+                        CefString event_name = arguments[0]->GetStringValue();
+                        PlatformEventId event = g_events.Find(event_name);
+                        CefRefPtr<CefProcessMessage> message;
+                        if (event != kNoPlatformEvent) {
+                            message = CefProcessMessage::Create(
+                                g_events.GetMessageName(event));
+                        } else {
+                            message = CefProcessMessage::Create(
+                                GenPlatformMsg(event_name));
+                        }
                         CefRefPtr<CefListValue> args =
                             message->GetArgumentList();
                         util::SetList(arguments, args);
-                        context->GetBrowser()->SendProcessMessage(PID_BROWSER,
-                                                                  message);
+                        browser->SendProcessMessage(PID_BROWSER, message);
+                        return true;
+                    }
+                } else if (name == "setBatching") {
+                    // setBatching(enabled[, max_delay_ms[, max_bytes]])
+                    if (arguments.size() >= 1 && arguments[0]->IsBool()) {
+                        CefRefPtr<CefBrowser> browser = context->GetBrowser();
+                        const int browser_id = browser->GetIdentifier();
+                        FlushBatch(browser_id);
+                        EmitBatch& batch = g_batches[browser_id];
+                        batch.browser = browser;
+                        batch.enabled = arguments[0]->GetBoolValue();
+                        if (arguments.size() >= 2 && arguments[1]->IsInt())
+                            batch.max_delay = std::max(0,
+                                arguments[1]->GetIntValue());
+                        if (arguments.size() >= 3 && arguments[2]->IsInt())
+                            batch.max_bytes = static_cast<size_t>(
+                                std::max(1, arguments[2]->GetIntValue()));
                         return true;
                     }
+                } else if (name == "call" || name == "callWithTimeout") {
+                    // call(name, ...args) or
+                    // callWithTimeout(timeout_ms, name, ...args)
+                    size_t first = 0;
+                    int timeout = kDefaultCallTimeout;
+                    if (name == "callWithTimeout") {
+                        if (arguments.empty() || !arguments[0]->IsInt())
+                            return false;
+                        timeout = arguments[0]->GetIntValue();
+                        first = 1;
+                    }
+                    if (arguments.size() <= first ||
+                        !arguments[first]->IsString()) {
+                        return false;
+                    }
+                    retval = Call(context, arguments[first]->GetStringValue(),
+                                  CefV8ValueList(arguments.begin() + first + 1,
+                                                 arguments.end()),
+                                  timeout);
+                    if (!retval.get())
+                        exception = "platform.call needs Promise support";
+                    return true;
+                } else if (name == "cancel") {
+                    // promise.cancel() of a platform.call
+                    CefRefPtr<CefV8Value> call_id;
+                    if (object.get())
+                        call_id = object->GetValue("callId");
+                    if (call_id.get() && call_id->IsInt()) {
+                        AbortCall(call_id->GetIntValue(),
+                                  "platform.call cancelled");
+                    }
+                    return true;
+                } else if (name == "flush") {
+                    // Send the pending batch now, also run as a microtask.
+                    FlushBatch(context->GetBrowser()->GetIdentifier());
+                    return true;
                 }
                 return false;
             }
 
+        private:
+            // Send the call |name| and return its promise, NULL if promises
+            // are not supported.
+            CefRefPtr<CefV8Value> Call(CefRefPtr<CefV8Context> context,
+                                       const std::string& name,
+                                       const CefV8ValueList& arguments,
+                                       int timeout) {
+                if (!deferred_factory_.get()) {
+                    CefRefPtr<CefV8Exception> eval_exception;
+                    if (!context->Eval(kDeferredSource, deferred_factory_,
+                                       eval_exception)) {
+                        deferred_factory_ = NULL;
+                        return NULL;
+                    }
+                }
+                CefRefPtr<CefV8Value> deferred =
+                    deferred_factory_->ExecuteFunction(NULL, CefV8ValueList());
+                if (!deferred.get() || !deferred->IsObject())
+                    return NULL;
+
+                const int call_id = ++g_last_call_id;
+                PendingCall& call = g_calls[call_id];
+                call.context = context;
+                call.browser = context->GetBrowser();
+                call.resolve = deferred->GetValue("resolve");
+                call.reject = deferred->GetValue("reject");
+
+                CefRefPtr<CefProcessMessage> message =
+                    CefProcessMessage::Create(kPlatformCallMessage);
+                CefRefPtr<CefListValue> args = message->GetArgumentList();
+                args->SetInt(0, call_id);
+                args->SetString(1, name);
+                CefRefPtr<CefListValue> call_args = CefListValue::Create();
+                util::SetList(arguments, call_args);
+                args->SetList(2, call_args);
+                call.browser->SendProcessMessage(PID_BROWSER, message);
+                if (timeout > 0) {
+                    CefPostDelayedTask(
+                        TID_RENDERER,
+                        NewCefRunnableFunction(&OnCallTimeout, call_id),
+                        timeout);
+                }
+
+                CefRefPtr<CefV8Value> promise = deferred->GetValue("promise");
+                promise->SetValue("callId", CefV8Value::CreateInt(call_id),
+                                  V8_PROPERTY_ATTRIBUTE_READONLY);
+                promise->SetValue("cancel",
+                                  CefV8Value::CreateFunction("cancel", this),
+                                  V8_PROPERTY_ATTRIBUTE_NONE);
+                return promise;
+            }
+
+            static PlatformEventBus::Listener GetListenerOptions(
+                CefRefPtr<CefV8Value> object) {
+                PlatformEventBus::Listener options;
+                CefRefPtr<CefV8Value> value = object->GetValue("batch");
+                if (value.get() && value->IsBool())
+                    options.batch = value->GetBoolValue();
+                value = object->GetValue("coalesce");
+                if (value.get() && value->IsBool())
+                    options.coalesce = value->GetBoolValue();
+                value = object->GetValue("key");
+                if (value.get() && value->IsInt())
+                    options.key = value->GetIntValue();
+                return options;
+            }
+
+            void AddToBatch(CefRefPtr<CefV8Context> context,
+                            CefRefPtr<CefBrowser> browser,
+                            EmitBatch& batch,
+                            const CefV8ValueList& arguments) {
+                if (!batch.message.get()) {
+                    batch.message =
+                        CefProcessMessage::Create(kPlatformBatchMessage);
+                }
+                CefRefPtr<CefListValue> records =
+                    batch.message->GetArgumentList();
+                CefRefPtr<CefListValue> record = CefListValue::Create();
+                util::SetList(arguments, record);
+                records->SetList(records->GetSize(), record);
+                batch.bytes += EstimateSize(arguments);
+
+                const int browser_id = browser->GetIdentifier();
+                if (batch.bytes >= batch.max_bytes) {
+                    FlushBatch(browser_id);
+                } else if (!batch.flush_pending) {
+                    batch.flush_pending = true;
+                    if (batch.max_delay > 0) {
+                        CefPostDelayedTask(
+                            TID_RENDERER,
+                            NewCefRunnableFunction(&OnBatchDeadline,
+                                                   browser_id,
+                                                   batch.generation),
+                            batch.max_delay);
+                    } else if (!QueueMicrotask(
+                                   context,
+                                   CefV8Value::CreateFunction("flush", this))) {
+                        CefPostTask(TID_RENDERER,
+                                    NewCefRunnableFunction(&OnBatchDeadline,
+                                                           browser_id,
+                                                           batch.generation));
+                    }
+                }
+            }
+
+            // Function of kDeferredSource in the context of the handler.
+            CefRefPtr<CefV8Value> deferred_factory_;
+
             IMPLEMENT_REFCOUNTING(PlatformV8Handler);
         };
 
@@ -96,6 +716,28 @@ namespace client_renderer {
                 message_router_ = CefMessageRouterRendererSide::Create(config);
             }
 
+            virtual bool OnBeforeNavigation(
+                CefRefPtr<ClientApp> app,
+                CefRefPtr<CefBrowser> browser,
+                CefRefPtr<CefFrame> frame,
+                CefRefPtr<CefRequest> request,
+                cef_navigation_type_t navigation_type,
+                bool is_redirect) OVERRIDE
+            {
+                // Sent ahead of the request, so the browser knows not to
+                // hold back or restart the navigation, which would add a
+                // new history entry instead of moving in the history.
+                if (frame->IsMain() && !is_redirect &&
+                    navigation_type == NAVIGATION_BACK_FORWARD) {
+                    CefRefPtr<CefProcessMessage> message =
+                        CefProcessMessage::Create(kHistoryNavigationMessage);
+                    message->GetArgumentList()->SetString(0,
+                                                          request->GetURL());
+                    browser->SendProcessMessage(PID_BROWSER, message);
+                }
+                return false;
+            }
+
             virtual void OnContextCreated(CefRefPtr<ClientApp> app,
                                           CefRefPtr<CefBrowser> browser,
                                           CefRefPtr<CefFrame> frame,
@@ -112,9 +754,34 @@ namespace client_renderer {
                 CefRefPtr<CefV8Value> bind_fn =
                     CefV8Value::CreateFunction("bind", platform_handler);
                 platform->SetValue("bind", bind_fn, V8_PROPERTY_ATTRIBUTE_NONE);
+                CefRefPtr<CefV8Value> once_fn =
+                    CefV8Value::CreateFunction("once", platform_handler);
+                platform->SetValue("once", once_fn, V8_PROPERTY_ATTRIBUTE_NONE);
+                CefRefPtr<CefV8Value> unbind_fn =
+                    CefV8Value::CreateFunction("unbind", platform_handler);
+                platform->SetValue("unbind", unbind_fn,
+                                   V8_PROPERTY_ATTRIBUTE_NONE);
                 CefRefPtr<CefV8Value> emit_fn =
                     CefV8Value::CreateFunction("emit", platform_handler);
                 platform->SetValue("emit", emit_fn, V8_PROPERTY_ATTRIBUTE_NONE);
+                // Calls answered by the browser, returning promises
+                CefRefPtr<CefV8Value> call_fn =
+                    CefV8Value::CreateFunction("call", platform_handler);
+                platform->SetValue("call", call_fn, V8_PROPERTY_ATTRIBUTE_NONE);
+                CefRefPtr<CefV8Value> call_with_timeout_fn =
+                    CefV8Value::CreateFunction("callWithTimeout",
+                                               platform_handler);
+                platform->SetValue("callWithTimeout", call_with_timeout_fn,
+                                   V8_PROPERTY_ATTRIBUTE_NONE);
+                // Batching of emit calls
+                CefRefPtr<CefV8Value> set_batching_fn =
+                    CefV8Value::CreateFunction("setBatching", platform_handler);
+                platform->SetValue("setBatching", set_batching_fn,
+                                   V8_PROPERTY_ATTRIBUTE_NONE);
+                CefRefPtr<CefV8Value> flush_fn =
+                    CefV8Value::CreateFunction("flush", platform_handler);
+                platform->SetValue("flush", flush_fn,
+                                   V8_PROPERTY_ATTRIBUTE_NONE);
                 global->SetValue("platform", platform,
                                  V8_PROPERTY_ATTRIBUTE_NONE);
             }
@@ -126,16 +793,44 @@ namespace client_renderer {
                 OVERRIDE
             {
                 message_router_->OnContextReleased(browser,  frame, context);
+                // Emits made right before unload still go out, and the
+                // next page starts unbatched
+                FlushBatch(browser->GetIdentifier());
+                if (frame->IsMain())
+                    g_batches.erase(browser->GetIdentifier());
                 // Remove any JavaScript callbacks registered for the context that
                 // is being released
-                for (auto it = g_callbacks.begin(); it != g_callbacks.end();) {
-                    if (it->second.first->IsSame(context))
-                        g_callbacks.erase(it++);
+                g_bus.RemoveContext(frame->GetIdentifier(), context);
+                // Calls of the context can no longer be answered
+                for (auto it = g_calls.begin(); it != g_calls.end();) {
+                    if (it->second.context->IsSame(context)) {
+                        CefRefPtr<CefProcessMessage> message =
+                            CefProcessMessage::Create(kPlatformCancelMessage);
+                        message->GetArgumentList()->SetInt(0, it->first);
+                        browser->SendProcessMessage(PID_BROWSER, message);
+                        g_calls.erase(it++);
+                    } else {
+                        ++it;
+                    }
+                }
+                // and the messages not delivered to them yet
+                for (auto it = g_queues.begin(); it != g_queues.end();) {
+                    if (it->context->IsSame(context))
+                        it = g_queues.erase(it);
                     else
                         ++it;
                 }
             }
 
+            virtual void OnBrowserDestroyed(CefRefPtr<ClientApp> app,
+                                            CefRefPtr<CefBrowser> browser)
+                OVERRIDE
+            {
+                // Anything still batched has nobody left to go to. The id may
+                // come back with a recycled browser, which starts unbatched.
+                g_batches.erase(browser->GetIdentifier());
+            }
+
             virtual void OnFocusedNodeChanged(CefRefPtr<ClientApp> app,
                                               CefRefPtr<CefBrowser> browser,
                                               CefRefPtr<CefFrame> frame,
@@ -166,25 +861,39 @@ namespace client_renderer {
                                                               message)) {
                     return true;
                 }
-                bool handled = false;
+                // Events of bound callbacks, looked up without copying the
+                // message name
+                const int browser_id = browser->GetIdentifier();
+                const PlatformEventId event =
+                    g_events.FindMessage(message->GetName());
+                if (event != kNoPlatformEvent) {
+                    const PlatformEventBus::ListenerList* listeners =
+                        g_bus.Find(event, browser_id);
+                    if (!listeners)
+                        return false;
+                    // Delivered together with the rest of the burst, to
+                    // each listener in order
+                    for (size_t i = 0; i < listeners->size(); ++i) {
+                        QueueDelivery((*listeners)[i], browser_id, event,
+                                      message);
+                    }
+                    return true;
+                }
                 std::string message_name = message->GetName();
-                int browser_id = browser->GetIdentifier();
-                auto it = g_callbacks.find(std::make_pair(message_name, browser_id));
-                if (it != g_callbacks.end()) {
-                    CefRefPtr<CefV8Context> context = it->second.first;
-                    CefRefPtr<CefV8Value> callback = it->second.second;
-                    context->Enter();
-                    CefV8ValueList arguments;
-                    util::SetList(message->GetArgumentList(), arguments);
-                    std::string event_name = GetEventFromMsg(message_name);
-                    CefRefPtr<CefV8Value> retval = callback->ExecuteFunction(NULL, arguments);
-                    if (retval.get()) {
-                        if (retval->IsBool())
-                            handled = retval->GetBoolValue();
+                if (message_name == kPlatformResultMessage) {
+                    CefRefPtr<CefListValue> args = message->GetArgumentList();
+                    if (!args->GetBool(1)) {
+                        SettleCall(args->GetInt(0), false, NULL,
+                                   args->GetString(2));
+                    } else if (args->GetType(2) == VTYPE_LIST) {
+                        SettleCall(args->GetInt(0), true, args->GetList(2),
+                                   std::string());
+                    } else {
+                        SettleCall(args->GetInt(0), true, NULL, std::string());
                     }
-                    context->Exit();
+                    return true;
                 }
-                return handled;
+                return false;
             }
 
         private:
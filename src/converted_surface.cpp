@@ -0,0 +1,191 @@
+/**
+ * @file converted_surface.cpp
+ *
+ * @breif Impl of converted_surface.h
+ */
+#include "converted_surface.h"
+
+#include <algorithm>
+
+#include "pixel_util.h"
+
+namespace {
+
+int AlignStride(int bytes)
+{
+    return (bytes + 63) & ~63;
+}
+
+}  // namespace
+
+ConvertedSurface::ConvertedSurface(PixelFormat format)
+    : format_(format),
+      width_(0),
+      height_(0),
+      data_(NULL)
+{
+    strides_[0] = strides_[1] = strides_[2] = 0;
+    offsets_[0] = offsets_[1] = offsets_[2] = 0;
+}
+
+ConvertedSurface::~ConvertedSurface()
+{
+    Release();
+}
+
+int ConvertedSurface::plane_count() const
+{
+    switch (format_) {
+    case PIXEL_FORMAT_I420:
+        return 3;
+    case PIXEL_FORMAT_NV12:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+void ConvertedSurface::Update(const OffScreenSurface& source,
+                              const std::vector<CefRect>& damage, bool opaque)
+{
+    if (source.IsEmpty())
+        return;
+    if (Resize(source.width(), source.height())) {
+        if (data_)
+            ConvertRect(source, CefRect(0, 0, width_, height_), opaque);
+        return;
+    }
+    std::vector<CefRect>::const_iterator it = damage.begin();
+    for (; it != damage.end(); ++it) {
+        CefRect rect = *it;
+        if (util::ClipRect(rect, width_, height_))
+            ConvertRect(source, rect, opaque);
+    }
+}
+
+void ConvertedSurface::Release()
+{
+    if (data_)
+        util::FreeAligned(data_);
+    data_ = NULL;
+    width_ = height_ = 0;
+    strides_[0] = strides_[1] = strides_[2] = 0;
+    offsets_[0] = offsets_[1] = offsets_[2] = 0;
+}
+
+bool ConvertedSurface::Resize(int width, int height)
+{
+    if (data_ && width == width_ && height == height_)
+        return false;
+    Release();
+    if (width <= 0 || height <= 0)
+        return true;
+
+    const int chroma_width = (width + 1) / 2;
+    const int chroma_height = (height + 1) / 2;
+    size_t size = 0;
+    switch (format_) {
+    case PIXEL_FORMAT_RGB24:
+        strides_[0] = AlignStride(width * 3);
+        size = static_cast<size_t>(strides_[0]) * height;
+        break;
+    case PIXEL_FORMAT_I420:
+        strides_[0] = AlignStride(width);
+        strides_[1] = strides_[2] = AlignStride(chroma_width);
+        offsets_[1] = static_cast<size_t>(strides_[0]) * height;
+        offsets_[2] = offsets_[1] +
+            static_cast<size_t>(strides_[1]) * chroma_height;
+        size = offsets_[2] + static_cast<size_t>(strides_[2]) * chroma_height;
+        break;
+    case PIXEL_FORMAT_NV12:
+        strides_[0] = AlignStride(width);
+        strides_[1] = AlignStride(chroma_width * 2);
+        offsets_[1] = static_cast<size_t>(strides_[0]) * height;
+        size = offsets_[1] + static_cast<size_t>(strides_[1]) * chroma_height;
+        break;
+    default:
+        strides_[0] = width * util::kBytesPerPixel;
+        size = static_cast<size_t>(strides_[0]) * height;
+        break;
+    }
+    data_ = util::AllocAligned(size);
+    if (!data_) {
+        Release();
+        return true;
+    }
+    width_ = width;
+    height_ = height;
+    return true;
+}
+
+void ConvertedSurface::ConvertRect(const OffScreenSurface& source,
+                                   const CefRect& rect, bool opaque)
+{
+    const unsigned char* src =
+        static_cast<const unsigned char*>(source.pixel(rect.x, rect.y));
+    const int src_stride = source.stride();
+
+    if (format_ == PIXEL_FORMAT_I420 || format_ == PIXEL_FORMAT_NV12) {
+        // Whole 2x2 chroma blocks only.
+        const int left = rect.x & ~1;
+        const int top = rect.y & ~1;
+        const int right = (std::min)((rect.x + rect.width + 1) & ~1, width_);
+        const int bottom =
+            (std::min)((rect.y + rect.height + 1) & ~1, height_);
+        const int width = right - left;
+        src = static_cast<const unsigned char*>(source.pixel(left, top));
+        unsigned char* y_plane = plane(0) +
+            static_cast<size_t>(top) * strides_[0] + left;
+        for (int y = top; y < bottom; ++y) {
+            util::ExtractYRow(y_plane, src + (y - top) * src_stride, width);
+            y_plane += strides_[0];
+        }
+        const bool nv12 = format_ == PIXEL_FORMAT_NV12;
+        unsigned char* u = plane(1) +
+            static_cast<size_t>(top / 2) * strides_[1] +
+            (nv12 ? left : left / 2);
+        unsigned char* v = nv12 ? u + 1 : plane(2) +
+            static_cast<size_t>(top / 2) * strides_[2] + left / 2;
+        for (int y = top; y < bottom; y += 2) {
+            const unsigned char* row0 = src + (y - top) * src_stride;
+            // An odd last row pairs with itself.
+            const unsigned char* row1 = y + 1 < bottom ? row0 + src_stride
+                                                       : row0;
+            util::ExtractUVRow(u, v, nv12 ? 2 : 1, row0, row1, width);
+            u += strides_[1];
+            v += nv12 ? strides_[1] : strides_[2];
+        }
+        return;
+    }
+
+    const int bytes_per_pixel =
+        format_ == PIXEL_FORMAT_RGB24 ? 3 : util::kBytesPerPixel;
+    unsigned char* dst = plane(0) + static_cast<size_t>(rect.y) * strides_[0] +
+        rect.x * bytes_per_pixel;
+    for (int y = 0; y < rect.height; ++y) {
+        const unsigned char* s = src + y * src_stride;
+        unsigned char* d = dst + y * strides_[0];
+        switch (format_) {
+        case PIXEL_FORMAT_BGRA_STRAIGHT:
+            if (opaque)
+                util::CopyRow(d, s, rect.width * util::kBytesPerPixel);
+            else
+                util::UnpremultiplyRow(d, s, rect.width, false);
+            break;
+        case PIXEL_FORMAT_RGBA:
+            util::SwizzleRow(d, s, rect.width);
+            break;
+        case PIXEL_FORMAT_RGBA_STRAIGHT:
+            if (opaque)
+                util::SwizzleRow(d, s, rect.width);
+            else
+                util::UnpremultiplyRow(d, s, rect.width, true);
+            break;
+        case PIXEL_FORMAT_RGB24:
+            util::PackRgbRow(d, s, rect.width);
+            break;
+        default:
+            break;
+        }
+    }
+}
@@ -0,0 +1,194 @@
+/**
+ * @file damage_region.cpp
+ *
+ * @breif Impl of damage_region.h
+ */
+#include "damage_region.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+int64 Area(const CefRect& rect)
+{
+    return static_cast<int64>(rect.width) * rect.height;
+}
+
+CefRect Union(const CefRect& a, const CefRect& b)
+{
+    if (a.IsEmpty())
+        return b;
+    if (b.IsEmpty())
+        return a;
+    int left = (std::min)(a.x, b.x);
+    int top = (std::min)(a.y, b.y);
+    int right = (std::max)(a.x + a.width, b.x + b.width);
+    int bottom = (std::max)(a.y + a.height, b.y + b.height);
+    return CefRect(left, top, right - left, bottom - top);
+}
+
+// True if |a| and |b| overlap or share an edge.
+bool Touches(const CefRect& a, const CefRect& b)
+{
+    return a.x <= b.x + b.width && b.x <= a.x + a.width &&
+           a.y <= b.y + b.height && b.y <= a.y + a.height;
+}
+
+int SnapDown(int value, int tile)
+{
+    int rem = value % tile;
+    return rem < 0 ? value - rem - tile : value - rem;
+}
+
+int SnapUp(int value, int tile)
+{
+    return -SnapDown(-value, tile);
+}
+
+}  // namespace
+
+DamageRegion::DamageRegion()
+    : tile_width_(kDefaultTileWidth),
+      tile_height_(kDefaultTileHeight),
+      bounding_box_ratio_(0.75),
+      max_rects_(kDefaultMaxRects),
+      width_(0),
+      height_(0)
+{
+}
+
+void DamageRegion::SetSnap(int tile_width, int tile_height)
+{
+    tile_width_ = (std::max)(tile_width, 1);
+    tile_height_ = (std::max)(tile_height, 1);
+}
+
+void DamageRegion::SetBoundingBoxThreshold(double ratio, size_t max_rects)
+{
+    bounding_box_ratio_ = ratio;
+    max_rects_ = (std::max)(max_rects, static_cast<size_t>(1));
+}
+
+void DamageRegion::SetBounds(int width, int height)
+{
+    if (width == width_ && height == height_)
+        return;
+    width_ = width;
+    height_ = height;
+    Clear();
+}
+
+void DamageRegion::Add(const CefRect& rect)
+{
+    if (rect.IsEmpty())
+        return;
+    int left = SnapDown(rect.x, tile_width_);
+    int top = SnapDown(rect.y, tile_height_);
+    int right = SnapUp(rect.x + rect.width, tile_width_);
+    int bottom = SnapUp(rect.y + rect.height, tile_height_);
+    left = (std::max)(left, 0);
+    top = (std::max)(top, 0);
+    right = (std::min)(right, width_);
+    bottom = (std::min)(bottom, height_);
+    if (right <= left || bottom <= top)
+        return;
+
+    CefRect snapped(left, top, right - left, bottom - top);
+    bounds_ = Union(bounds_, snapped);
+    Insert(snapped);
+    CollapseIfDense();
+}
+
+void DamageRegion::Add(const std::vector<CefRect>& rects)
+{
+    std::vector<CefRect>::const_iterator it = rects.begin();
+    for (; it != rects.end(); ++it)
+        Add(*it);
+}
+
+void DamageRegion::Clear()
+{
+    rects_.clear();
+    bounds_.Set(0, 0, 0, 0);
+}
+
+int64 DamageRegion::CoveredArea(const std::vector<CefRect>& rects)
+{
+    // Cut the rects into vertical slabs at every left and right edge and add
+    // up the merged row spans of each slab.
+    std::vector<int> edges;
+    std::vector<CefRect>::const_iterator it = rects.begin();
+    for (; it != rects.end(); ++it) {
+        edges.push_back(it->x);
+        edges.push_back(it->x + it->width);
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    int64 area = 0;
+    std::vector<std::pair<int, int> > spans;
+    for (size_t i = 0; i + 1 < edges.size(); ++i) {
+        spans.clear();
+        for (it = rects.begin(); it != rects.end(); ++it) {
+            if (it->x <= edges[i] && edges[i + 1] <= it->x + it->width)
+                spans.push_back(std::make_pair(it->y, it->y + it->height));
+        }
+        std::sort(spans.begin(), spans.end());
+        int64 height = 0;
+        int top = 0;
+        int bottom = 0;
+        for (size_t j = 0; j < spans.size(); ++j) {
+            if (j == 0 || spans[j].first > bottom) {
+                height += bottom - top;
+                top = spans[j].first;
+                bottom = spans[j].second;
+            } else {
+                bottom = (std::max)(bottom, spans[j].second);
+            }
+        }
+        height += bottom - top;
+        area += height * (edges[i + 1] - edges[i]);
+    }
+    return area;
+}
+
+void DamageRegion::Insert(CefRect rect)
+{
+    // A merge can make the union touch rects that were skipped before, so
+    // start over after each one.
+    size_t i = 0;
+    while (i < rects_.size()) {
+        const CefRect& other = rects_[i];
+        if (Touches(other, rect)) {
+            CefRect merged = Union(other, rect);
+            if (Area(merged) <= Area(other) + Area(rect)) {
+                rects_[i] = rects_.back();
+                rects_.pop_back();
+                rect = merged;
+                i = 0;
+                continue;
+            }
+        }
+        ++i;
+    }
+    rects_.push_back(rect);
+}
+
+void DamageRegion::CollapseIfDense()
+{
+    if (rects_.size() < 2)
+        return;
+    if (rects_.size() <= max_rects_) {
+        const double threshold = bounding_box_ratio_ * Area(bounds_);
+        // Merged rects may still overlap, so the sum of their areas is only
+        // an upper bound of the covered area. It is cheap though.
+        int64 sum = 0;
+        std::vector<CefRect>::const_iterator it = rects_.begin();
+        for (; it != rects_.end(); ++it)
+            sum += Area(*it);
+        if (sum < threshold || CoveredArea(rects_) < threshold)
+            return;
+    }
+    rects_.assign(1, bounds_);
+}
@@ -0,0 +1,142 @@
+/**
+ * @file frame_clock.cpp
+ *
+ * @breif Impl of frame_clock.h
+ */
+#include "frame_clock.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <include/cef_runnable.h>
+
+#include "frame_scheduler.h"
+#include "util.h"
+
+// static
+CefRefPtr<FrameClock> FrameClock::GetInstance()
+{
+    static CefRefPtr<FrameClock> instance = new FrameClock();
+    return instance;
+}
+
+// static
+int64 FrameClock::NowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FrameClock::FrameClock()
+    : interval_(1000000 / kDefaultFrameRate),
+      budget_us_(kDefaultFrameBudget),
+      phase_(NowMicros()),
+      generation_(0),
+      wakeup_pending_(false),
+      wakeup_time_(0),
+      deferred_count_(0)
+{
+}
+
+// static
+bool FrameClock::RunsBefore(const CefRefPtr<FrameScheduler>& a,
+                            const CefRefPtr<FrameScheduler>& b)
+{
+    if (a->priority() != b->priority())
+        return a->priority() > b->priority();
+    return a->deferred_frames() > b->deferred_frames();
+}
+
+void FrameClock::SetFrameRate(int fps)
+{
+    interval_ = 1000000 / (std::max)(fps, 1);
+}
+
+void FrameClock::Schedule(FrameScheduler* scheduler)
+{
+    REQUIRE_UI_THREAD();
+    if (scheduler->clock_index_ < 0) {
+        scheduler->clock_index_ = static_cast<int>(schedulers_.size());
+        schedulers_.push_back(scheduler);
+    }
+    ScheduleWakeup(scheduler->tick_time());
+}
+
+void FrameClock::Unschedule(FrameScheduler* scheduler)
+{
+    REQUIRE_UI_THREAD();
+    const int index = scheduler->clock_index_;
+    if (index < 0)
+        return;
+    // Swap with the last one and pop, |scheduler| may go with its reference.
+    scheduler->clock_index_ = -1;
+    CefRefPtr<FrameScheduler> last = schedulers_.back();
+    schedulers_.pop_back();
+    if (last.get() != scheduler) {
+        last->clock_index_ = index;
+        schedulers_[index] = last;
+    }
+}
+
+void FrameClock::ScheduleWakeup(int64 due)
+{
+    // First tick of the grid that runs |due|.
+    int64 now = NowMicros();
+    int64 time = (std::max)(due - interval_ / 2, now);
+    int64 ticks = (time - phase_ + interval_ - 1) / interval_;
+    time = phase_ + ticks * interval_;
+    if (wakeup_pending_ && wakeup_time_ <= time)
+        return;
+    wakeup_pending_ = true;
+    wakeup_time_ = time;
+    CefPostDelayedTask(TID_UI,
+                       NewCefRunnableMethod(this, &FrameClock::OnTick,
+                                            ++generation_),
+                       (std::max)((time - now + 500) / 1000,
+                                  static_cast<int64>(0)));
+}
+
+void FrameClock::OnTick(int generation)
+{
+    if (generation != generation_)
+        return;
+    wakeup_pending_ = false;
+    const int64 start = NowMicros();
+    const int64 horizon = start + interval_ / 2;
+
+    // Stopped schedulers are gone already, collect the due ones.
+    std::vector<CefRefPtr<FrameScheduler> > due;
+    for (size_t i = 0; i < schedulers_.size(); ++i) {
+        if (schedulers_[i]->IsTickPending() &&
+            schedulers_[i]->tick_time() <= horizon) {
+            due.push_back(schedulers_[i]);
+        }
+    }
+    std::stable_sort(due.begin(), due.end(), RunsBefore);
+
+    const int top_priority = due.empty() ? 0 : due.front()->priority();
+    for (size_t i = 0; i < due.size(); ++i) {
+        FrameScheduler* scheduler = due[i].get();
+        if (scheduler->priority() < top_priority &&
+            NowMicros() - start > budget_us_) {
+            // Over budget, it stays due and runs early in the next tick.
+            scheduler->Defer();
+            ++deferred_count_;
+            continue;
+        }
+        scheduler->OnTick();
+    }
+
+    // Wake up for the earliest pending tick, if any.
+    int64 next = 0;
+    bool pending = false;
+    for (size_t i = 0; i < schedulers_.size(); ++i) {
+        if (!schedulers_[i]->IsTickPending())
+            continue;
+        if (!pending || schedulers_[i]->tick_time() < next)
+            next = schedulers_[i]->tick_time();
+        pending = true;
+    }
+    if (pending)
+        ScheduleWakeup((std::max)(next, start + interval_));
+}
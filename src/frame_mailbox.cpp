@@ -0,0 +1,162 @@
+/**
+ * @file frame_mailbox.cpp
+ *
+ * @breif Impl of frame_mailbox.h
+ */
+#include "frame_mailbox.h"
+
+#include <algorithm>
+#include <chrono>
+
+#if defined(OS_WIN)
+#include <windows.h>
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "pixel_util.h"
+
+namespace {
+
+int64 NowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+FrameMailbox::FrameMailbox(Consumer* consumer)
+    : consumer_(consumer),
+      back_(0),
+      published_(0),
+      front_(2),
+      middle_(1),
+      consumed_sequence_(0),
+      running_(true),
+      doorbell_(0),
+      stats_published_(0),
+      stats_consumed_(0),
+      stats_skipped_(0),
+      stats_last_us_(0),
+      stats_max_us_(0),
+      stats_total_us_(0)
+{
+    for (int i = 0; i < kSlotCount; ++i)
+        slot_sequence_[i] = 0;
+#if defined(OS_WIN)
+    wake_event_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+#endif
+    thread_ = std::thread(&FrameMailbox::ThreadMain, this);
+}
+
+FrameMailbox::~FrameMailbox()
+{
+    running_.store(false);
+    Ring();
+    if (thread_.joinable())
+        thread_.join();
+#if defined(OS_WIN)
+    CloseHandle(wake_event_);
+#endif
+}
+
+void FrameMailbox::Publish(const OffScreenSurface& source,
+                           const std::vector<CefRect>& damage)
+{
+    if (source.IsEmpty())
+        return;
+    const uint64 sequence = ++published_;
+    history_.Record(sequence, damage);
+
+    OffScreenFrame& frame = slots_[back_];
+    const CefRect full(0, 0, source.width(), source.height());
+    std::vector<CefRect> rects;
+    // Bring the back surface up to date: it misses every frame published
+    // since it was filled last.
+    if (frame.surface.Resize(source.width(), source.height()) ||
+        !history_.Collect(slot_sequence_[back_], sequence, rects)) {
+        rects.assign(1, full);
+    }
+    frame.surface.CopyFrom(source.data(), source.stride(), rects);
+
+    // The consumer may skip frames, report everything since the last one it
+    // got.
+    if (!history_.Collect(consumed_sequence_.load(std::memory_order_acquire),
+                          sequence, frame.damage)) {
+        frame.damage.assign(1, full);
+    }
+    frame.sequence = sequence;
+    frame.paint_time = NowMicros();
+    slot_sequence_[back_] = sequence;
+
+    int previous = middle_.exchange(back_ | kFreshBit,
+                                    std::memory_order_acq_rel);
+    back_ = previous & kIndexMask;
+    if (previous & kFreshBit)
+        stats_skipped_.fetch_add(1, std::memory_order_relaxed);
+    stats_published_.fetch_add(1, std::memory_order_relaxed);
+    Ring();
+}
+
+FrameLatencyStats FrameMailbox::GetLatencyStats() const
+{
+    FrameLatencyStats stats;
+    stats.published = stats_published_.load(std::memory_order_relaxed);
+    stats.consumed = stats_consumed_.load(std::memory_order_relaxed);
+    stats.skipped = stats_skipped_.load(std::memory_order_relaxed);
+    stats.last_us = stats_last_us_.load(std::memory_order_relaxed);
+    stats.max_us = stats_max_us_.load(std::memory_order_relaxed);
+    int64 total = stats_total_us_.load(std::memory_order_relaxed);
+    stats.average_us =
+        stats.consumed ? total / static_cast<int64>(stats.consumed) : 0;
+    return stats;
+}
+
+void FrameMailbox::ThreadMain()
+{
+    while (running_.load(std::memory_order_acquire)) {
+        if (!(middle_.load(std::memory_order_acquire) & kFreshBit)) {
+#if defined(OS_WIN)
+            WaitForSingleObject(wake_event_, INFINITE);
+#elif defined(__linux__)
+            int seen = doorbell_.load(std::memory_order_acquire);
+            if (!(middle_.load(std::memory_order_acquire) & kFreshBit) &&
+                running_.load(std::memory_order_acquire)) {
+                syscall(SYS_futex, reinterpret_cast<int*>(&doorbell_),
+                        FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+            }
+#else
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+            continue;
+        }
+
+        int previous = middle_.exchange(front_, std::memory_order_acq_rel);
+        front_ = previous & kIndexMask;
+        const OffScreenFrame& frame = slots_[front_];
+
+        int64 latency = NowMicros() - frame.paint_time;
+        stats_last_us_.store(latency, std::memory_order_relaxed);
+        stats_total_us_.fetch_add(latency, std::memory_order_relaxed);
+        if (latency > stats_max_us_.load(std::memory_order_relaxed))
+            stats_max_us_.store(latency, std::memory_order_relaxed);
+        stats_consumed_.fetch_add(1, std::memory_order_relaxed);
+
+        consumer_->Consume(frame);
+        consumed_sequence_.store(frame.sequence, std::memory_order_release);
+    }
+}
+
+void FrameMailbox::Ring()
+{
+    doorbell_.fetch_add(1, std::memory_order_release);
+#if defined(OS_WIN)
+    SetEvent(wake_event_);
+#elif defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<int*>(&doorbell_), FUTEX_WAKE_PRIVATE,
+            1, NULL, NULL, 0);
+#endif
+}
@@ -0,0 +1,136 @@
+/**
+ * @file frame_scheduler.cpp
+ *
+ * @breif Impl of frame_scheduler.h
+ */
+#include "frame_scheduler.h"
+
+#include <algorithm>
+
+#include <include/cef_runnable.h>
+
+#include "frame_clock.h"
+#include "util.h"
+
+FrameScheduler::FrameScheduler(Delegate* delegate)
+    : delegate_(delegate),
+      frame_rate_(kDefaultFrameRate),
+      idle_frame_rate_(kDefaultIdleFrameRate),
+      idle_threshold_(kDefaultIdleThreshold),
+      priority_(FrameClock::PRIORITY_VISIBLE),
+      paused_(false),
+      needs_frame_(false),
+      idle_frames_(0),
+      deferred_frames_(0),
+      tick_pending_(false),
+      tick_time_(0),
+      last_frame_time_(0),
+      clock_index_(-1)
+{
+}
+
+void FrameScheduler::SetFrameRate(int fps)
+{
+    frame_rate_ = (std::max)(fps, 1);
+}
+
+void FrameScheduler::SetIdleFrameRate(int fps, int idle_threshold)
+{
+    idle_frame_rate_ = (std::max)(fps, 0);
+    idle_threshold_ = (std::max)(idle_threshold, 1);
+}
+
+void FrameScheduler::SetNeedsFrame()
+{
+    REQUIRE_UI_THREAD();
+    needs_frame_ = true;
+    idle_frames_ = 0;
+    // Keep the frame cadence, but never present sooner than one interval
+    // after the previous frame.
+    int64 now = FrameClock::NowMicros();
+    int64 due = (std::max)(now, last_frame_time_ + GetInterval());
+    if (!tick_pending_ || tick_time_ > due)
+        ScheduleTick(due - now);
+}
+
+void FrameScheduler::NotifyInput()
+{
+    REQUIRE_UI_THREAD();
+    bool was_idle = IsIdle();
+    idle_frames_ = 0;
+    if (was_idle || !tick_pending_)
+        ScheduleTick(GetInterval());
+}
+
+void FrameScheduler::Pause()
+{
+    REQUIRE_UI_THREAD();
+    paused_ = true;
+    tick_pending_ = false;
+}
+
+void FrameScheduler::Resume()
+{
+    REQUIRE_UI_THREAD();
+    if (!paused_)
+        return;
+    paused_ = false;
+    idle_frames_ = 0;
+    ScheduleTick(0);
+}
+
+void FrameScheduler::Stop()
+{
+    delegate_ = NULL;
+    needs_frame_ = false;
+    tick_pending_ = false;
+    if (clock_index_ < 0)
+        return;
+    // The clock holds a reference until then. Stop may come from the
+    // destructor of the delegate on another thread.
+    CefRefPtr<FrameClock> clock = FrameClock::GetInstance();
+    if (CefCurrentlyOn(TID_UI)) {
+        clock->Unschedule(this);
+    } else {
+        CefPostTask(TID_UI, NewCefRunnableMethod(
+                                clock.get(), &FrameClock::Unschedule,
+                                CefRefPtr<FrameScheduler>(this)));
+    }
+}
+
+int64 FrameScheduler::GetInterval() const
+{
+    return 1000000 / frame_rate_;
+}
+
+void FrameScheduler::ScheduleTick(int64 delay_us)
+{
+    if (!delegate_ || paused_)
+        return;
+    tick_pending_ = true;
+    tick_time_ = FrameClock::NowMicros() + delay_us;
+    FrameClock::GetInstance()->Schedule(this);
+}
+
+void FrameScheduler::OnTick()
+{
+    if (!delegate_ || !tick_pending_)
+        return;
+    tick_pending_ = false;
+    deferred_frames_ = 0;
+
+    if (needs_frame_) {
+        needs_frame_ = false;
+        idle_frames_ = 0;
+        last_frame_time_ = FrameClock::NowMicros();
+        delegate_->OnBeginFrame();
+    } else if (idle_frames_ < idle_threshold_) {
+        ++idle_frames_;
+    }
+
+    if (!IsIdle()) {
+        ScheduleTick(GetInterval());
+    } else if (idle_frame_rate_ > 0) {
+        ScheduleTick(1000000 / idle_frame_rate_);
+    }
+}
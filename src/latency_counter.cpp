@@ -0,0 +1,26 @@
+/**
+ * @file latency_counter.cpp
+ *
+ * @breif Impl of latency_counter.h
+ */
+#include "latency_counter.h"
+
+#include <algorithm>
+
+void LatencyCounter::Add(int64 value)
+{
+    ++count_;
+    last_us_ = value;
+    max_us_ = (std::max)(max_us_, value);
+    total_us_ += value;
+}
+
+Latency LatencyCounter::Get() const
+{
+    Latency latency;
+    latency.count = count_;
+    latency.last_us = last_us_;
+    latency.max_us = max_us_;
+    latency.average_us = count_ ? total_us_ / static_cast<int64>(count_) : 0;
+    return latency;
+}
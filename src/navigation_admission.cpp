@@ -0,0 +1,215 @@
+/**
+ * @file navigation_admission.cpp
+ *
+ * @breif Impl of navigation_admission.h
+ */
+#include "navigation_admission.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <include/cef_runnable.h>
+
+namespace {
+
+// Time a browser is given to start loading once admitted.
+const int64 kStartTimeout = 5000;
+
+int64 NowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+NavigationAdmission::NavigationAdmission(int max_loading)
+    : max_loading_(std::max(max_loading, 1)),
+      generation_(0),
+      admitted_(0),
+      deferred_(0)
+{
+}
+
+NavigationAdmission::~NavigationAdmission()
+{
+}
+
+void NavigationAdmission::SetMaxLoading(int max_loading)
+{
+    {
+        AutoLock lock_scope(this);
+        max_loading_ = std::max(max_loading, 1);
+    }
+    Dispatch();
+}
+
+int NavigationAdmission::max_loading()
+{
+    AutoLock lock_scope(this);
+    return max_loading_;
+}
+
+bool NavigationAdmission::Admit(int browser_id)
+{
+    AutoLock lock_scope(this);
+    if (slots_.count(browser_id))
+        return true;
+    if (static_cast<int>(slots_.size()) >= max_loading_)
+        return false;
+    Grant(browser_id, NowMicros());
+    admitted_++;
+    return true;
+}
+
+void NavigationAdmission::Defer(int browser_id,
+                                CefRefPtr<NavigationStateCell> state,
+                                CefRefPtr<CefTask> navigation)
+{
+    {
+        AutoLock lock_scope(this);
+        Pending pending;
+        pending.browser_id = browser_id;
+        pending.state = state;
+        pending.navigation = navigation;
+        pending.since = NowMicros();
+        PendingQueue::iterator it = queue_.begin();
+        for (; it != queue_.end(); ++it) {
+            if (it->browser_id == browser_id)
+                break;
+        }
+        // A replaced navigation keeps its place in the queue.
+        if (it != queue_.end()) {
+            pending.since = it->since;
+            *it = pending;
+        } else {
+            queue_.push_back(pending);
+        }
+        deferred_++;
+    }
+    // A slot may have been freed since Admit failed.
+    Dispatch();
+}
+
+void NavigationAdmission::Cancel(int browser_id)
+{
+    AutoLock lock_scope(this);
+    PendingQueue::iterator it = queue_.begin();
+    for (; it != queue_.end(); ++it) {
+        if (it->browser_id == browser_id) {
+            queue_.erase(it);
+            return;
+        }
+    }
+}
+
+void NavigationAdmission::OnLoadingStateChange(int browser_id,
+                                               bool is_loading)
+{
+    {
+        AutoLock lock_scope(this);
+        std::unordered_map<int, Slot>::iterator it = slots_.find(browser_id);
+        if (it == slots_.end())
+            return;
+        if (is_loading) {
+            it->second.started = true;
+            return;
+        }
+        // Stops of a load started before the slot was given do not count.
+        if (!it->second.started)
+            return;
+    }
+    Release(browser_id);
+}
+
+void NavigationAdmission::OnBrowserClosed(int browser_id)
+{
+    Cancel(browser_id);
+    Release(browser_id);
+}
+
+NavigationAdmissionStats NavigationAdmission::GetStats()
+{
+    AutoLock lock_scope(this);
+    NavigationAdmissionStats stats;
+    stats.loading = static_cast<int>(slots_.size());
+    stats.queued = static_cast<int>(queue_.size());
+    stats.admitted = admitted_;
+    stats.deferred = deferred_;
+    stats.queued_time = queued_time_.Get();
+    stats.loading_time = loading_time_.Get();
+    return stats;
+}
+
+void NavigationAdmission::Grant(int browser_id, int64 now)
+{
+    Slot& slot = slots_[browser_id];
+    slot.since = now;
+    slot.started = false;
+    slot.generation = ++generation_;
+    CefPostDelayedTask(
+        TID_UI,
+        NewCefRunnableMethod(this, &NavigationAdmission::OnStartTimeout,
+                             browser_id, slot.generation),
+        kStartTimeout);
+}
+
+void NavigationAdmission::Release(int browser_id)
+{
+    {
+        AutoLock lock_scope(this);
+        std::unordered_map<int, Slot>::iterator it = slots_.find(browser_id);
+        if (it == slots_.end())
+            return;
+        if (it->second.started)
+            loading_time_.Add(NowMicros() - it->second.since);
+        slots_.erase(it);
+    }
+    Dispatch();
+}
+
+void NavigationAdmission::Dispatch()
+{
+    std::vector<CefRefPtr<CefTask> > navigations;
+    {
+        AutoLock lock_scope(this);
+        const int64 now = NowMicros();
+        while (!queue_.empty() &&
+               static_cast<int>(slots_.size()) < max_loading_) {
+            // The first visible browser, or the longest waiting one.
+            PendingQueue::iterator next = queue_.begin();
+            for (PendingQueue::iterator it = queue_.begin();
+                 it != queue_.end(); ++it) {
+                NavigationState state;
+                if (it->state.get())
+                    it->state->Read(state);
+                if (!state.is_paused) {
+                    next = it;
+                    break;
+                }
+            }
+            // A browser admitted since it was queued keeps its slot.
+            if (!slots_.count(next->browser_id))
+                Grant(next->browser_id, now);
+            queued_time_.Add(now - next->since);
+            navigations.push_back(next->navigation);
+            queue_.erase(next);
+        }
+    }
+    for (size_t i = 0; i < navigations.size(); ++i)
+        CefPostTask(TID_UI, navigations[i]);
+}
+
+void NavigationAdmission::OnStartTimeout(int browser_id, int generation)
+{
+    {
+        AutoLock lock_scope(this);
+        std::unordered_map<int, Slot>::iterator it = slots_.find(browser_id);
+        if (it == slots_.end() || it->second.generation != generation ||
+            it->second.started) {
+            return;
+        }
+    }
+    Release(browser_id);
+}
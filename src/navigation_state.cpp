@@ -0,0 +1,67 @@
+/**
+ * @file navigation_state.cpp
+ *
+ * @breif Impl of navigation_state.h
+ */
+#include "navigation_state.h"
+
+#include <string.h>
+
+#include <string>
+#include <thread>
+
+NavigationState::NavigationState()
+    : sequence(0),
+      browser_id(0),
+      is_loading(false),
+      can_go_back(false),
+      can_go_forward(false),
+      is_crashed(false),
+      is_paused(false)
+{
+    title[0] = '\0';
+}
+
+void NavigationState::SetTitle(const CefString& value)
+{
+    const std::string utf8 = value.ToString();
+    size_t length = utf8.size();
+    if (length > kMaxTitleLength) {
+        length = kMaxTitleLength;
+        // Back up to the first byte of the character that does not fit.
+        while (length > 0 && (utf8[length] & 0xC0) == 0x80)
+            --length;
+    }
+    memcpy(title, utf8.data(), length);
+    title[length] = '\0';
+}
+
+NavigationStateCell::NavigationStateCell()
+    : lock_(0)
+{
+}
+
+void NavigationStateCell::Publish(const NavigationState& state)
+{
+    const uint32 lock = lock_.load(std::memory_order_relaxed);
+    lock_.store(lock + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&state_, &state, sizeof(state_));
+    state_.sequence = lock / 2 + 1;
+    lock_.store(lock + 2, std::memory_order_release);
+}
+
+void NavigationStateCell::Read(NavigationState& state) const
+{
+    for (;;) {
+        const uint32 before = lock_.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        memcpy(&state, &state_, sizeof(state));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (lock_.load(std::memory_order_relaxed) == before)
+            return;
+    }
+}
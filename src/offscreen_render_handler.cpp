@@ -4,11 +4,12 @@
 
 #include "offscreen_render_handler.h"
 
-#include <windowsx.h>
 #include <iostream>
 
 #include <include/cef_runnable.h>
 
+#include "frame_clock.h"
+#include "pixel_util.h"
 #include "util.h"
 
 // static
@@ -27,7 +28,49 @@ CefRefPtr<OffScreenRenderHandler> OffScreenRenderHandler::From(
 
 void OffScreenRenderHandler::OnBeforeClose(CefRefPtr<CefBrowser> browser)
 {
-    // @todo
+    scheduler_->Stop();
+    pending_damage_.Clear();
+    delete mailbox_;
+    mailbox_ = NULL;
+    StopFrameExport();
+    ReleaseSurfaces();
+    if (thumbnails_)
+        thumbnails_->Release();
+    for (int i = 0; i < PIXEL_FORMAT_COUNT; ++i) {
+        if (converted_surfaces_[i])
+            converted_surfaces_[i]->Release();
+    }
+}
+
+void OffScreenRenderHandler::OnResize(CefRefPtr<CefBrowser> browser,
+                                      int width, int height)
+{
+    REQUIRE_UI_THREAD();
+    view_width_ = width;
+    view_height_ = height;
+    // The surfaces are reallocated by the repaint that follows WasResized,
+    // at the size actually painted, which accounts for the device scale
+    // factor.
+}
+
+void OffScreenRenderHandler::OnPauseRendering(CefRefPtr<CefBrowser> browser)
+{
+    REQUIRE_UI_THREAD();
+    paused_ = true;
+    scheduler_->Pause();
+    size_t bytes = view_surface_.size() + popup_surface_.size() +
+        popup_underlay_.size();
+    if (bytes > paused_memory_budget_) {
+        pending_damage_.Clear();
+        ReleaseSurfaces();
+    }
+}
+
+void OffScreenRenderHandler::OnResumeRendering(CefRefPtr<CefBrowser> browser)
+{
+    REQUIRE_UI_THREAD();
+    paused_ = false;
+    scheduler_->Resume();
 }
 
 bool OffScreenRenderHandler::GetRootScreenRect(CefRefPtr<CefBrowser> browser,
@@ -43,11 +86,18 @@ bool OffScreenRenderHandler::GetRootScreenRect(CefRefPtr<CefBrowser> browser,
 bool OffScreenRenderHandler::GetViewRect(CefRefPtr<CefBrowser> browser,
                                          CefRect& rect)
 {
-    if (window_ && window_->IsShown()) {
+    if (window_ && window_->IsShown())
         window_->GetViewRect(rect);
-        return true;
+    else if (view_width_ > 0 && view_height_ > 0)
+        rect.Set(0, 0, 0, 0);
+    else
+        return false;
+    // An explicit Resize wins over the window size.
+    if (view_width_ > 0 && view_height_ > 0) {
+        rect.width = view_width_;
+        rect.height = view_height_;
     }
-    return false;
+    return true;
 }
 
 bool OffScreenRenderHandler::GetScreenPoint(CefRefPtr<CefBrowser> browser,
@@ -63,14 +113,32 @@ bool OffScreenRenderHandler::GetScreenPoint(CefRefPtr<CefBrowser> browser,
     return false;
 }
 
+bool OffScreenRenderHandler::GetScreenInfo(CefRefPtr<CefBrowser> browser,
+                                           CefScreenInfo& screen_info)
+{
+    if (window_)
+        return window_->GetScreenInfo(screen_info);
+    return false;
+}
+
 void OffScreenRenderHandler::OnPopupShow(CefRefPtr<CefBrowser> browser,
                                          bool show)
 {
-    if (!show) {
-        CefRect dirty_rect = popup_rect_;
-        popup_rect_.Set(0, 0, 0, 0);
-        browser->GetHost()->Invalidate(dirty_rect, PET_VIEW);
+    if (show)
+        return;
+    // Put the view pixels saved under the popup back in place, no repaint of
+    // the view is needed for that.
+    std::vector<CefRect> damage;
+    CefRect old_rect = GetPopupViewRect();
+    if (!old_rect.IsEmpty()) {
+        RestorePopupUnderlay(old_rect);
+        damage.push_back(old_rect);
     }
+    popup_rect_.Set(0, 0, 0, 0);
+    popup_painted_ = false;
+    popup_surface_.Release();
+    popup_underlay_.Release();
+    AddDamage(damage);
 }
 
 void OffScreenRenderHandler::OnPopupSize(CefRefPtr<CefBrowser> browser,
@@ -78,7 +146,35 @@ void OffScreenRenderHandler::OnPopupSize(CefRefPtr<CefBrowser> browser,
 {
     if (rect.width <= 0 || rect.height <= 0)
         return;
+
+    std::vector<CefRect> damage;
+    CefRect old_rect = GetPopupViewRect();
+    if (!old_rect.IsEmpty()) {
+        RestorePopupUnderlay(old_rect);
+        damage.push_back(old_rect);
+    }
+
     popup_rect_ = rect;
+    // A popup that was only moved keeps its pixels, a resized one waits for
+    // its next PET_POPUP paint.
+    if (popup_surface_.Resize(rect.width, rect.height))
+        popup_painted_ = false;
+    popup_underlay_.Resize(rect.width, rect.height);
+
+    CefRect new_rect = GetPopupViewRect();
+    if (!new_rect.IsEmpty() && !popup_underlay_.IsEmpty()) {
+        // The view surface is free of popup pixels at this point.
+        util::CopyRows(popup_underlay_.pixel(new_rect.x - popup_rect_.x,
+                                             new_rect.y - popup_rect_.y),
+                       popup_underlay_.stride(),
+                       view_surface_.pixel(new_rect.x, new_rect.y),
+                       view_surface_.stride(),
+                       new_rect.width * util::kBytesPerPixel,
+                       new_rect.height);
+        CompositePopup(new_rect);
+        damage.push_back(new_rect);
+    }
+    AddDamage(damage);
 }
 
 void OffScreenRenderHandler::OnPaint(CefRefPtr<CefBrowser> browser,
@@ -87,15 +183,89 @@ void OffScreenRenderHandler::OnPaint(CefRefPtr<CefBrowser> browser,
                                      const void* buffer,
                                      int width, int height)
 {
-    if (popup_painting_)
+    // Hidden browsers should not paint, drop anything still in flight.
+    if (paused_)
         return;
-    renderer_->Render(dirty_rects, buffer, width, height);
-    if (type == PET_VIEW && !popup_rect_.IsEmpty()) {
-        popup_painting_ = true;
-        CefRect client_popup_rect(0, 0, popup_rect_.width, popup_rect_.height);
-        browser->GetHost()->Invalidate(client_popup_rect, PET_POPUP);
-        popup_painting_ = false;
+
+    const int stride = width * util::kBytesPerPixel;
+    std::vector<CefRect> damage;
+
+    if (type == PET_VIEW) {
+        if (view_surface_.Resize(width, height)) {
+            // Fresh storage, the whole frame has to be copied once. Damage
+            // and popup pixels of the old size no longer apply, the popup
+            // is shown again by OnPopupSize.
+            pending_damage_.Clear();
+            popup_rect_.Set(0, 0, 0, 0);
+            popup_painted_ = false;
+            popup_surface_.Release();
+            popup_underlay_.Release();
+            damage.push_back(CefRect(0, 0, width, height));
+        } else {
+            // CEF reports many small and overlapping rects, copy their
+            // coalesced spans instead. The buffer holds the whole view, so
+            // the few extra pixels copied are up to date as well.
+            DamageRegion region;
+            region.SetSnap(damage_tile_width_, damage_tile_height_);
+            region.SetBoundingBoxThreshold(damage_bounding_box_ratio_,
+                                           DamageRegion::kDefaultMaxRects);
+            region.SetBounds(width, height);
+            RectList::const_iterator it = dirty_rects.begin();
+            for (; it != dirty_rects.end(); ++it)
+                region.Add(*it);
+            damage = region.rects();
+        }
+        if (view_surface_.IsEmpty())
+            return;
+        view_surface_.CopyFrom(buffer, stride, damage);
+
+        // Parts of the view below the popup go to the underlay and get the
+        // popup composited back on top.
+        CefRect popup_view_rect = GetPopupViewRect();
+        if (!popup_view_rect.IsEmpty() && !popup_underlay_.IsEmpty()) {
+            std::vector<CefRect>::const_iterator it = damage.begin();
+            for (; it != damage.end(); ++it) {
+                CefRect rect = util::IntersectRect(*it, popup_view_rect);
+                if (rect.IsEmpty())
+                    continue;
+                util::CopyRows(popup_underlay_.pixel(rect.x - popup_rect_.x,
+                                                     rect.y - popup_rect_.y),
+                               popup_underlay_.stride(),
+                               static_cast<const unsigned char*>(buffer) +
+                                   rect.y * stride +
+                                   rect.x * util::kBytesPerPixel,
+                               stride, rect.width * util::kBytesPerPixel,
+                               rect.height);
+                CompositePopup(rect);
+            }
+        }
+    } else if (type == PET_POPUP) {
+        CefRect popup_view_rect = GetPopupViewRect();
+        if (popup_view_rect.IsEmpty() || popup_underlay_.IsEmpty() ||
+            width != popup_surface_.width() ||
+            height != popup_surface_.height()) {
+            return;
+        }
+        RectList::const_iterator it = dirty_rects.begin();
+        for (; it != dirty_rects.end(); ++it) {
+            CefRect rect = *it;
+            if (!util::ClipRect(rect, width, height))
+                continue;
+            util::CopyRect(popup_surface_.data(), popup_surface_.stride(),
+                           buffer, stride, rect);
+            popup_painted_ = true;
+            // Popup to view coordinates.
+            rect.x += popup_rect_.x;
+            rect.y += popup_rect_.y;
+            rect = util::IntersectRect(rect, popup_view_rect);
+            if (rect.IsEmpty())
+                continue;
+            CompositePopup(rect);
+            damage.push_back(rect);
+        }
     }
+
+    AddDamage(damage);
 }
 
 void OffScreenRenderHandler::OnCursorChange(CefRefPtr<CefBrowser> browser,
@@ -107,43 +277,281 @@ void OffScreenRenderHandler::OnCursorChange(CefRefPtr<CefBrowser> browser,
 
 OffScreenRenderHandler::OffScreenRenderHandler(bool transparent)
     : transparent_(transparent),
-      popup_painting_(false),
-      render_task_pending_(false)
+      popup_painted_(false),
+      paused_(false),
+      view_width_(0),
+      view_height_(0),
+      paused_memory_budget_(0),
+      damage_tile_width_(DamageRegion::kDefaultTileWidth),
+      damage_tile_height_(DamageRegion::kDefaultTileHeight),
+      damage_bounding_box_ratio_(0.75),
+      suppress_redundant_paints_(false),
+      window_(NULL),
+      renderer_(NULL),
+      mailbox_(NULL),
+      thumbnails_(NULL),
+      exporter_(NULL)
 {
+    for (int i = 0; i < PIXEL_FORMAT_COUNT; ++i)
+        converted_surfaces_[i] = NULL;
+    present_stats_.presented = 0;
+    present_stats_.suppressed = 0;
+    scheduler_ = new FrameScheduler(this);
 }
 
 OffScreenRenderHandler::~OffScreenRenderHandler()
 {
-    // @todo
+    // The clock keeps the scheduler alive and would tick a destroyed
+    // delegate when the handler goes without OnBeforeClose.
+    scheduler_->Stop();
+    delete mailbox_;
+    delete thumbnails_;
+    delete exporter_;
+    for (int i = 0; i < PIXEL_FORMAT_COUNT; ++i)
+        delete converted_surfaces_[i];
+}
+
+void OffScreenRenderHandler::SetRenderer(RendererWrapper* renderer,
+                                         bool threaded)
+{
+    // Stop the render thread before the renderer it calls changes.
+    delete mailbox_;
+    mailbox_ = NULL;
+    renderer_ = renderer;
+    if (renderer_ && threaded)
+        mailbox_ = new FrameMailbox(this);
+}
+
+FrameLatencyStats OffScreenRenderHandler::GetFrameLatencyStats() const
+{
+    if (mailbox_)
+        return mailbox_->GetLatencyStats();
+    return FrameLatencyStats();
+}
+
+void OffScreenRenderHandler::SetOutputFormat(PixelFormat format,
+                                             bool enabled)
+{
+    REQUIRE_UI_THREAD();
+    if (enabled == (converted_surfaces_[format] != NULL))
+        return;
+    // The render thread updates the surfaces, stop it while they change.
+    const bool threaded = mailbox_ != NULL;
+    delete mailbox_;
+    mailbox_ = NULL;
+    if (enabled) {
+        converted_surfaces_[format] = new ConvertedSurface(format);
+    } else {
+        delete converted_surfaces_[format];
+        converted_surfaces_[format] = NULL;
+    }
+    if (threaded)
+        mailbox_ = new FrameMailbox(this);
+    // A new format starts with a full conversion.
+    if (enabled)
+        Invalidate();
+}
+
+const ConvertedSurface* OffScreenRenderHandler::GetConvertedSurface(
+    PixelFormat format) const
+{
+    return converted_surfaces_[format];
+}
+
+void OffScreenRenderHandler::SetThumbnailLevels(int levels)
+{
+    REQUIRE_UI_THREAD();
+    if (thumbnails_ && thumbnails_->level_count() == levels)
+        return;
+    delete thumbnails_;
+    thumbnails_ = NULL;
+    if (levels > 0) {
+        thumbnails_ = new ThumbnailPyramid(levels);
+        // Build the levels from the retained view right away.
+        thumbnails_->Update(view_surface_, std::vector<CefRect>());
+    }
+}
+
+bool OffScreenRenderHandler::StartFrameExport(const std::string& name,
+                                              int max_width, int max_height)
+{
+    REQUIRE_UI_THREAD();
+    StopFrameExport();
+    SharedFrameWriter* exporter = new SharedFrameWriter();
+    if (!exporter->Create(name, max_width, max_height)) {
+        delete exporter;
+        return false;
+    }
+    exporter_ = exporter;
+    // The first exported frame must be complete.
+    Invalidate();
+    return true;
 }
 
-/// METHODS NOT USED
-void OffScreenRenderHandler::Invalidate() {
+void OffScreenRenderHandler::StopFrameExport()
+{
+    delete exporter_;
+    exporter_ = NULL;
+}
+
+void OffScreenRenderHandler::Invalidate()
+{
     if (!CefCurrentlyOn(TID_UI)) {
         CefPostTask(TID_UI,
                     NewCefRunnableMethod(this, &OffScreenRenderHandler::Invalidate));
         return;
     }
+    // A forced present must not be suppressed because the content did not
+    // change, forgetting the hashes makes all of it count as changed.
+    tile_hashes_.Reset();
+    std::vector<CefRect> damage;
+    damage.push_back(CefRect(0, 0, view_surface_.width(),
+                             view_surface_.height()));
+    AddDamage(damage);
+}
 
-    // Don't post another task if the previous task is still pending.
-    if (render_task_pending_)
+void OffScreenRenderHandler::NotifyInput()
+{
+    if (!CefCurrentlyOn(TID_UI)) {
+        CefPostTask(TID_UI,
+                    NewCefRunnableMethod(this, &OffScreenRenderHandler::NotifyInput));
         return;
+    }
+    scheduler_->NotifyInput();
+}
+
+void OffScreenRenderHandler::SetFrameRate(int fps)
+{
+    scheduler_->SetFrameRate(fps);
+}
 
-    render_task_pending_ = true;
+void OffScreenRenderHandler::SetIdleFrameRate(int idle_fps, int idle_threshold)
+{
+    scheduler_->SetIdleFrameRate(idle_fps, idle_threshold);
+}
 
-    // @note This may have impact on the render loop
-    // Render at 30fps.
-    static const int kRenderDelay = 1000 / 30;
-    CefPostDelayedTask(TID_UI,
-                       NewCefRunnableMethod(this, &OffScreenRenderHandler::Render),
-                       kRenderDelay);
+void OffScreenRenderHandler::SetVisible(bool visible)
+{
+    scheduler_->SetPriority(visible ? FrameClock::PRIORITY_VISIBLE
+                                    : FrameClock::PRIORITY_BACKGROUND);
+}
+
+void OffScreenRenderHandler::SetDamageCoalescing(int tile_width,
+                                                 int tile_height,
+                                                 double bounding_box_ratio)
+{
+    damage_tile_width_ = tile_width;
+    damage_tile_height_ = tile_height;
+    damage_bounding_box_ratio_ = bounding_box_ratio;
+    pending_damage_.SetSnap(tile_width, tile_height);
+    pending_damage_.SetBoundingBoxThreshold(bounding_box_ratio,
+                                            DamageRegion::kDefaultMaxRects);
+}
+
+void OffScreenRenderHandler::SetRedundantPaintSuppression(bool enabled)
+{
+    REQUIRE_UI_THREAD();
+    suppress_redundant_paints_ = enabled;
+    // Hashes go stale while disabled.
+    tile_hashes_.Reset();
+}
+
+void OffScreenRenderHandler::OnBeginFrame()
+{
+    REQUIRE_UI_THREAD();
+    if (pending_damage_.IsEmpty() || view_surface_.IsEmpty())
+        return;
+    const std::vector<CefRect>* damage = &pending_damage_.rects();
+    if (suppress_redundant_paints_) {
+        if (!tile_hashes_.Update(view_surface_, *damage, changed_damage_)) {
+            ++present_stats_.suppressed;
+            pending_damage_.Clear();
+            return;
+        }
+        damage = &changed_damage_;
+    }
+    ++present_stats_.presented;
+    if (thumbnails_)
+        thumbnails_->Update(view_surface_, *damage);
+    // Copies the damage once more, from the view surface into a ring slot.
+    if (exporter_)
+        exporter_->Publish(view_surface_, *damage);
+    if (mailbox_)
+        mailbox_->Publish(view_surface_, *damage);
+    else if (renderer_)
+        RenderFrame(view_surface_, *damage);
+    pending_damage_.Clear();
+}
+
+void OffScreenRenderHandler::Consume(const OffScreenFrame& frame)
+{
+    RenderFrame(frame.surface, frame.damage);
+}
+
+void OffScreenRenderHandler::RenderFrame(const OffScreenSurface& surface,
+                                         const std::vector<CefRect>& damage)
+{
+    for (int i = 0; i < PIXEL_FORMAT_COUNT; ++i) {
+        if (converted_surfaces_[i])
+            converted_surfaces_[i]->Update(surface, damage, !transparent_);
+    }
+    renderer_->Render(surface, damage);
+}
+
+void OffScreenRenderHandler::AddDamage(const std::vector<CefRect>& damage)
+{
+    if (damage.empty() || view_surface_.IsEmpty())
+        return;
+    pending_damage_.SetBounds(view_surface_.width(), view_surface_.height());
+    pending_damage_.Add(damage);
+    scheduler_->SetNeedsFrame();
+}
+
+CefRect OffScreenRenderHandler::GetPopupViewRect() const
+{
+    CefRect rect = popup_rect_;
+    util::ClipRect(rect, view_surface_.width(), view_surface_.height());
+    return rect;
+}
+
+void OffScreenRenderHandler::CompositePopup(const CefRect& rect)
+{
+    if (!popup_painted_)
+        return;
+    const void* popup = popup_surface_.pixel(rect.x - popup_rect_.x,
+                                             rect.y - popup_rect_.y);
+    if (!transparent_) {
+        // Opaque browsers have opaque popups, no blending needed.
+        util::CopyRows(view_surface_.pixel(rect.x, rect.y),
+                       view_surface_.stride(), popup, popup_surface_.stride(),
+                       rect.width * util::kBytesPerPixel, rect.height);
+        return;
+    }
+    util::BlendRows(view_surface_.pixel(rect.x, rect.y), view_surface_.stride(),
+                    popup, popup_surface_.stride(),
+                    popup_underlay_.pixel(rect.x - popup_rect_.x,
+                                          rect.y - popup_rect_.y),
+                    popup_underlay_.stride(), rect.width, rect.height);
+}
+
+void OffScreenRenderHandler::RestorePopupUnderlay(const CefRect& rect)
+{
+    if (popup_underlay_.IsEmpty())
+        return;
+    util::CopyRows(view_surface_.pixel(rect.x, rect.y), view_surface_.stride(),
+                   popup_underlay_.pixel(rect.x - popup_rect_.x,
+                                         rect.y - popup_rect_.y),
+                   popup_underlay_.stride(),
+                   rect.width * util::kBytesPerPixel, rect.height);
 }
 
-void OffScreenRenderHandler::Render()
+void OffScreenRenderHandler::ReleaseSurfaces()
 {
-    ASSERT(CefCurrentlyOn(TID_UI));
-    if (render_task_pending_)
-        render_task_pending_ = false;
+    view_surface_.Release();
+    popup_surface_.Release();
+    popup_underlay_.Release();
+    popup_rect_.Set(0, 0, 0, 0);
+    popup_painted_ = false;
 }
 
 void OffScreenRenderHandler::OnDestroyed()
@@ -0,0 +1,57 @@
+/**
+ * @file offscreen_surface.cpp
+ *
+ * @breif Impl of offscreen_surface.h
+ */
+#include "offscreen_surface.h"
+
+#include "pixel_util.h"
+
+OffScreenSurface::OffScreenSurface()
+    : width_(0),
+      height_(0),
+      stride_(0),
+      data_(NULL)
+{
+}
+
+OffScreenSurface::~OffScreenSurface()
+{
+    Release();
+}
+
+bool OffScreenSurface::Resize(int width, int height)
+{
+    if (data_ && width == width_ && height == height_)
+        return false;
+    Release();
+    if (width <= 0 || height <= 0)
+        return true;
+    stride_ = width * util::kBytesPerPixel;
+    data_ = util::AllocAligned(static_cast<size_t>(stride_) * height);
+    if (!data_) {
+        stride_ = 0;
+        return true;
+    }
+    width_ = width;
+    height_ = height;
+    return true;
+}
+
+void OffScreenSurface::Release()
+{
+    if (data_)
+        util::FreeAligned(data_);
+    data_ = NULL;
+    width_ = height_ = stride_ = 0;
+}
+
+void OffScreenSurface::CopyFrom(const void* buffer, int stride,
+                                const std::vector<CefRect>& rects)
+{
+    if (!data_)
+        return;
+    std::vector<CefRect>::const_iterator it = rects.begin();
+    for (; it != rects.end(); ++it)
+        util::CopyRect(data_, stride_, buffer, stride, *it);
+}
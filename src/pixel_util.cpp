@@ -0,0 +1,490 @@
+/**
+ * @file pixel_util.cpp
+ *
+ * @breif Impl of pixel_util.h
+ */
+#include "pixel_util.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#if defined(OS_WIN)
+#include <malloc.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PIXEL_UTIL_SSE2 1
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace util {
+
+// AVX2 kernels, built in pixel_util_avx2.cpp with AVX2 code generation. Each
+// converts a multiple of 8 pixels from the start of the row and returns how
+// many it converted; the caller finishes the rest.
+namespace avx2 {
+bool IsCompiled();
+int SwizzleRow(unsigned char* dst, const unsigned char* src, int count);
+int UnpremultiplyRow(unsigned char* dst, const unsigned char* src, int count,
+                     bool swap_rb, const unsigned int* table);
+int PackRgbRow(unsigned char* dst, const unsigned char* src, int count);
+int ExtractYRow(unsigned char* dst, const unsigned char* src, int count);
+}  // namespace avx2
+
+namespace {
+
+const size_t kAlignment = 64;
+
+bool UseAVX2()
+{
+    static const bool use = avx2::IsCompiled() && HasAVX2();
+    return use;
+}
+
+// 16.16 fixed point 255 / alpha, 0 for alpha 0.
+struct UnpremultiplyTable {
+    UnpremultiplyTable() {
+        values[0] = 0;
+        for (unsigned int a = 1; a < 256; ++a)
+            values[a] = (255u * 65536u + a / 2) / a;
+    }
+    unsigned int values[256];
+};
+
+const unsigned int* GetUnpremultiplyTable()
+{
+    static const UnpremultiplyTable table;
+    return table.values;
+}
+
+// BT.601 limited range, 8-bit fixed point. The bias adds the offset and
+// rounds.
+inline unsigned char ToY(int b, int g, int r)
+{
+    return static_cast<unsigned char>(
+        (66 * r + 129 * g + 25 * b + 0x1080) >> 8);
+}
+
+inline unsigned char ToU(int b, int g, int r)
+{
+    return static_cast<unsigned char>(
+        (112 * b - 74 * g - 38 * r + 0x8080) >> 8);
+}
+
+inline unsigned char ToV(int b, int g, int r)
+{
+    return static_cast<unsigned char>(
+        (112 * r - 94 * g - 18 * b + 0x8080) >> 8);
+}
+
+#if defined(PIXEL_UTIL_SSE2)
+// Per pixel sums of the 16-bit products of |pixels| (two pixels widened to
+// 16 bits) with |coeffs|, in the low two 32-bit lanes.
+inline __m128i SumChannels(__m128i pixels, __m128i coeffs)
+{
+    __m128i m = _mm_madd_epi16(pixels, coeffs);
+    m = _mm_add_epi32(m, _mm_srli_epi64(m, 32));
+    return _mm_shuffle_epi32(m, _MM_SHUFFLE(3, 1, 2, 0));
+}
+#endif
+
+}  // namespace
+
+unsigned char* AllocAligned(size_t size)
+{
+#if defined(OS_WIN)
+    return static_cast<unsigned char*>(_aligned_malloc(size, kAlignment));
+#else
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, kAlignment, size) != 0)
+        return NULL;
+    return static_cast<unsigned char*>(ptr);
+#endif
+}
+
+void FreeAligned(unsigned char* ptr)
+{
+#if defined(OS_WIN)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+bool HasAVX2()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    // AVX and OSXSAVE, then check that the OS saves the YMM registers.
+    if ((info[2] & (1 << 28)) == 0 || (info[2] & (1 << 27)) == 0)
+        return false;
+    if ((_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, NULL) < 7)
+        return false;
+    __cpuid(1, eax, ebx, ecx, edx);
+    if ((ecx & (1 << 28)) == 0 || (ecx & (1 << 27)) == 0)
+        return false;
+    unsigned int xcr0_low, xcr0_high;
+    __asm__ __volatile__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+    if ((xcr0_low & 6) != 6)
+        return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+void CopyRow(void* dst, const void* src, size_t bytes)
+{
+    unsigned char* d = static_cast<unsigned char*>(dst);
+    const unsigned char* s = static_cast<const unsigned char*>(src);
+#if defined(PIXEL_UTIL_SSE2)
+    // 64 bytes (16 pixels) per iteration, the tail is left to memcpy.
+    for (; bytes >= 64; bytes -= 64, s += 64, d += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 32));
+        __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 48));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d), a);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 16), b);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 32), c);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 48), e);
+    }
+#endif
+    if (bytes)
+        memcpy(d, s, bytes);
+}
+
+void CopyRows(void* dst, int dst_stride, const void* src, int src_stride,
+              size_t row_bytes, int rows)
+{
+    unsigned char* d = static_cast<unsigned char*>(dst);
+    const unsigned char* s = static_cast<const unsigned char*>(src);
+    if (row_bytes == static_cast<size_t>(dst_stride) &&
+        dst_stride == src_stride) {
+        // Full-width rows are contiguous in both buffers, copy them at once.
+        CopyRow(d, s, row_bytes * rows);
+        return;
+    }
+    for (int y = 0; y < rows; ++y, d += dst_stride, s += src_stride)
+        CopyRow(d, s, row_bytes);
+}
+
+void BlendRow(void* dst, const void* src, const void* under, int count)
+{
+    unsigned char* d = static_cast<unsigned char*>(dst);
+    const unsigned char* s = static_cast<const unsigned char*>(src);
+    const unsigned char* u = static_cast<const unsigned char*>(under);
+#if defined(PIXEL_UTIL_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i k255 = _mm_set1_epi16(255);
+    const __m128i k128 = _mm_set1_epi16(128);
+    // 4 pixels per iteration, 2 pixels per 16-bit half.
+    for (; count >= 4; count -= 4, d += 16, s += 16, u += 16) {
+        __m128i sp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        __m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u));
+        __m128i out[2];
+        for (int half = 0; half < 2; ++half) {
+            __m128i s16 = half ? _mm_unpackhi_epi8(sp, zero)
+                               : _mm_unpacklo_epi8(sp, zero);
+            __m128i u16 = half ? _mm_unpackhi_epi8(up, zero)
+                               : _mm_unpacklo_epi8(up, zero);
+            // Broadcast the alpha of each pixel to its four channels.
+            __m128i a = _mm_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+            // under * (255 - alpha) / 255, rounded.
+            __m128i t = _mm_add_epi16(
+                _mm_mullo_epi16(u16, _mm_sub_epi16(k255, a)), k128);
+            t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+            out[half] = _mm_add_epi16(s16, t);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d),
+                         _mm_packus_epi16(out[0], out[1]));
+    }
+#endif
+    for (; count > 0; --count, d += 4, s += 4, u += 4) {
+        const unsigned int inv = 255 - s[3];
+        for (int c = 0; c < 4; ++c) {
+            unsigned int t = u[c] * inv + 128;
+            t = s[c] + ((t + (t >> 8)) >> 8);
+            d[c] = static_cast<unsigned char>(t > 255 ? 255 : t);
+        }
+    }
+}
+
+void BlendRows(void* dst, int dst_stride, const void* src, int src_stride,
+               const void* under, int under_stride, int width, int rows)
+{
+    unsigned char* d = static_cast<unsigned char*>(dst);
+    const unsigned char* s = static_cast<const unsigned char*>(src);
+    const unsigned char* u = static_cast<const unsigned char*>(under);
+    for (int y = 0; y < rows; ++y) {
+        BlendRow(d, s, u, width);
+        d += dst_stride;
+        s += src_stride;
+        u += under_stride;
+    }
+}
+
+void SwizzleRow(void* dst, const void* src, int count)
+{
+    unsigned char* d = static_cast<unsigned char*>(dst);
+    const unsigned char* s = static_cast<const unsigned char*>(src);
+    if (UseAVX2()) {
+        int done = avx2::SwizzleRow(d, s, count);
+        d += done * 4;
+        s += done * 4;
+        count -= done;
+    }
+#if defined(PIXEL_UTIL_SSE2)
+    const __m128i ga_mask = _mm_set1_epi32(0xFF00FF00);
+    const __m128i rb_mask = _mm_set1_epi32(0x00FF00FF);
+    for (; count >= 4; count -= 4, d += 16, s += 16) {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        __m128i rb = _mm_and_si128(p, rb_mask);
+        // Moving the 32-bit lanes by 16 bits exchanges bytes 0 and 2.
+        rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d),
+                         _mm_or_si128(_mm_and_si128(p, ga_mask), rb));
+    }
+#endif
+    for (; count > 0; --count, d += 4, s += 4) {
+        unsigned char b = s[0];
+        d[0] = s[2];
+        d[1] = s[1];
+        d[2] = b;
+        d[3] = s[3];
+    }
+}
+
+void UnpremultiplyRow(void* dst, const void* src, int count, bool swap_rb)
+{
+    unsigned char* d = static_cast<unsigned char*>(dst);
+    const unsigned char* s = static_cast<const unsigned char*>(src);
+    const unsigned int* table = GetUnpremultiplyTable();
+    if (UseAVX2()) {
+        int done = avx2::UnpremultiplyRow(d, s, count, swap_rb, table);
+        d += done * 4;
+        s += done * 4;
+        count -= done;
+    }
+    const int r = swap_rb ? 0 : 2;
+    const int b = swap_rb ? 2 : 0;
+#if defined(PIXEL_UTIL_SSE2)
+    const __m128i alpha_mask = _mm_set1_epi32(0xFF000000);
+    const __m128i zero = _mm_setzero_si128();
+    while (count >= 4) {
+        // Runs of opaque or fully transparent pixels are the common case and
+        // are the same in both representations.
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        __m128i a = _mm_and_si128(p, alpha_mask);
+        int opaque = _mm_movemask_epi8(_mm_cmpeq_epi32(a, alpha_mask));
+        int clear = _mm_movemask_epi8(_mm_cmpeq_epi32(a, zero));
+        if ((opaque | clear) != 0xFFFF)
+            break;
+        if (swap_rb)
+            SwizzleRow(d, s, 4);
+        else
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d), p);
+        count -= 4;
+        d += 16;
+        s += 16;
+    }
+#endif
+    for (; count > 0; --count, d += 4, s += 4) {
+        const unsigned int recip = table[s[3]];
+        unsigned char sb = s[0], sg = s[1], sr = s[2];
+        d[b] = static_cast<unsigned char>((sb * recip + 0x8000) >> 16);
+        d[1] = static_cast<unsigned char>((sg * recip + 0x8000) >> 16);
+        d[r] = static_cast<unsigned char>((sr * recip + 0x8000) >> 16);
+        d[3] = s[3];
+    }
+}
+
+void PackRgbRow(void* dst, const void* src, int count)
+{
+    unsigned char* d = static_cast<unsigned char*>(dst);
+    const unsigned char* s = static_cast<const unsigned char*>(src);
+    // SSE2 has no byte shuffle, below AVX2 this stays scalar.
+    if (UseAVX2()) {
+        int done = avx2::PackRgbRow(d, s, count);
+        d += done * 3;
+        s += done * 4;
+        count -= done;
+    }
+    for (; count > 0; --count, d += 3, s += 4) {
+        d[0] = s[2];
+        d[1] = s[1];
+        d[2] = s[0];
+    }
+}
+
+void ExtractYRow(void* dst, const void* src, int count)
+{
+    unsigned char* d = static_cast<unsigned char*>(dst);
+    const unsigned char* s = static_cast<const unsigned char*>(src);
+    if (UseAVX2()) {
+        int done = avx2::ExtractYRow(d, s, count);
+        d += done;
+        s += done * 4;
+        count -= done;
+    }
+#if defined(PIXEL_UTIL_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i coeffs = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+    const __m128i bias = _mm_set1_epi32(0x1080);
+    for (; count >= 4; count -= 4, d += 4, s += 16) {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        __m128i lo = SumChannels(_mm_unpacklo_epi8(p, zero), coeffs);
+        __m128i hi = SumChannels(_mm_unpackhi_epi8(p, zero), coeffs);
+        __m128i y = _mm_srli_epi32(
+            _mm_add_epi32(_mm_unpacklo_epi64(lo, hi), bias), 8);
+        y = _mm_packs_epi32(y, y);
+        y = _mm_packus_epi16(y, y);
+        int value = _mm_cvtsi128_si32(y);
+        memcpy(d, &value, 4);
+    }
+#endif
+    for (; count > 0; --count, ++d, s += 4)
+        *d = ToY(s[0], s[1], s[2]);
+}
+
+void ExtractUVRow(void* dst_u, void* dst_v, int step, const void* row0,
+                  const void* row1, int count)
+{
+    unsigned char* u = static_cast<unsigned char*>(dst_u);
+    unsigned char* v = static_cast<unsigned char*>(dst_v);
+    const unsigned char* s0 = static_cast<const unsigned char*>(row0);
+    const unsigned char* s1 = static_cast<const unsigned char*>(row1);
+#if defined(PIXEL_UTIL_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i u_coeffs = _mm_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0);
+    const __m128i v_coeffs = _mm_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0);
+    const __m128i bias = _mm_set1_epi32(0x8080);
+    for (; count >= 4; count -= 4, s0 += 16, s1 += 16) {
+        // Average the two rows, then the pixel pairs (0, 1) and (2, 3).
+        __m128i p = _mm_avg_epu8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(s0)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(s1)));
+        p = _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 1, 2, 0));
+        p = _mm_unpacklo_epi8(_mm_avg_epu8(p, _mm_srli_si128(p, 8)), zero);
+        __m128i us = _mm_srai_epi32(
+            _mm_add_epi32(SumChannels(p, u_coeffs), bias), 8);
+        __m128i vs = _mm_srai_epi32(
+            _mm_add_epi32(SumChannels(p, v_coeffs), bias), 8);
+        u[0] = static_cast<unsigned char>(_mm_cvtsi128_si32(us));
+        v[0] = static_cast<unsigned char>(_mm_cvtsi128_si32(vs));
+        u[step] = static_cast<unsigned char>(
+            _mm_cvtsi128_si32(_mm_srli_si128(us, 4)));
+        v[step] = static_cast<unsigned char>(
+            _mm_cvtsi128_si32(_mm_srli_si128(vs, 4)));
+        u += step * 2;
+        v += step * 2;
+    }
+#endif
+    for (; count > 0; count -= 2, s0 += 8, s1 += 8, u += step, v += step) {
+        // An odd last pixel pairs with itself.
+        const int next = count > 1 ? 4 : 0;
+        int c[3];
+        for (int i = 0; i < 3; ++i)
+            c[i] = (s0[i] + s0[i + next] + s1[i] + s1[i + next] + 2) >> 2;
+        *u = ToU(c[0], c[1], c[2]);
+        *v = ToV(c[0], c[1], c[2]);
+    }
+}
+
+void ReduceRow2x2(void* dst, const void* row0, const void* row1, int count)
+{
+    unsigned char* d = static_cast<unsigned char*>(dst);
+    const unsigned char* s0 = static_cast<const unsigned char*>(row0);
+    const unsigned char* s1 = static_cast<const unsigned char*>(row1);
+#if defined(PIXEL_UTIL_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(2);
+    // 8 source pixels to 4 per iteration, sums are exact in 16 bits.
+    for (; count >= 8; count -= 8, d += 16, s0 += 32, s1 += 32) {
+        __m128i out[2];
+        for (int half = 0; half < 2; ++half) {
+            __m128i a = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(s0 + half * 16));
+            __m128i b = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(s1 + half * 16));
+            // Vertical sums of pixels 0-1 and 2-3, then the pairs.
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero),
+                                       _mm_unpacklo_epi8(b, zero));
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero),
+                                       _mm_unpackhi_epi8(b, zero));
+            lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+            hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+            out[half] = _mm_srli_epi16(
+                _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), round), 2);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d),
+                         _mm_packus_epi16(out[0], out[1]));
+    }
+#endif
+    for (; count > 0; count -= 2, d += 4, s0 += 8, s1 += 8) {
+        const int next = count > 1 ? 4 : 0;
+        for (int c = 0; c < 4; ++c) {
+            d[c] = static_cast<unsigned char>(
+                (s0[c] + s0[c + next] + s1[c] + s1[c + next] + 2) >> 2);
+        }
+    }
+}
+
+void CopyRect(void* dst, int dst_stride, const void* src, int src_stride,
+              const CefRect& rect)
+{
+    if (rect.IsEmpty())
+        return;
+    const size_t offset = static_cast<size_t>(rect.x) * kBytesPerPixel;
+    unsigned char* d = static_cast<unsigned char*>(dst) +
+        static_cast<size_t>(rect.y) * dst_stride + offset;
+    const unsigned char* s = static_cast<const unsigned char*>(src) +
+        static_cast<size_t>(rect.y) * src_stride + offset;
+    CopyRows(d, dst_stride, s, src_stride,
+             static_cast<size_t>(rect.width) * kBytesPerPixel, rect.height);
+}
+
+CefRect IntersectRect(const CefRect& a, const CefRect& b)
+{
+    int left = (std::max)(a.x, b.x);
+    int top = (std::max)(a.y, b.y);
+    int right = (std::min)(a.x + a.width, b.x + b.width);
+    int bottom = (std::min)(a.y + a.height, b.y + b.height);
+    if (right <= left || bottom <= top)
+        return CefRect();
+    return CefRect(left, top, right - left, bottom - top);
+}
+
+bool ClipRect(CefRect& rect, int width, int height)
+{
+    int left = (std::max)(rect.x, 0);
+    int top = (std::max)(rect.y, 0);
+    int right = (std::min)(rect.x + rect.width, width);
+    int bottom = (std::min)(rect.y + rect.height, height);
+    if (right <= left || bottom <= top) {
+        rect.Set(0, 0, 0, 0);
+        return false;
+    }
+    rect.Set(left, top, right - left, bottom - top);
+    return true;
+}
+
+}  // namespace util
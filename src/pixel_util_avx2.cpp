@@ -0,0 +1,169 @@
+/**
+ * @file pixel_util_avx2.cpp
+ *
+ * @breif AVX2 variants of the pixel_util.h conversion kernels
+ *
+ * Built with AVX2 code generation, only called after util::HasAVX2().
+ */
+#include "pixel_util.h"
+
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace util {
+namespace avx2 {
+
+#if defined(__AVX2__)
+
+namespace {
+
+// Per pixel sums of the 16-bit products of |pixels| with |coeffs|, pixels 0-1
+// of each 128-bit lane in its low two 32-bit lanes.
+inline __m256i SumChannels(__m256i pixels, __m256i coeffs)
+{
+    __m256i m = _mm256_madd_epi16(pixels, coeffs);
+    m = _mm256_add_epi32(m, _mm256_srli_epi64(m, 32));
+    return _mm256_shuffle_epi32(m, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+}  // namespace
+
+bool IsCompiled()
+{
+    return true;
+}
+
+int SwizzleRow(unsigned char* dst, const unsigned char* src, int count)
+{
+    const __m256i shuffle = _mm256_setr_epi8(
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i p = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(src + i * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4),
+                            _mm256_shuffle_epi8(p, shuffle));
+    }
+    return i;
+}
+
+int UnpremultiplyRow(unsigned char* dst, const unsigned char* src, int count,
+                     bool swap_rb, const unsigned int* table)
+{
+    const __m256i swizzle = _mm256_setr_epi8(
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    const __m256i alpha_mask = _mm256_set1_epi32(0xFF000000);
+    const __m256i round = _mm256_set1_epi32(0x8000);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i p = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(src + i * 4));
+        __m256i recip = _mm256_i32gather_epi32(
+            reinterpret_cast<const int*>(table), _mm256_srli_epi32(p, 24), 4);
+        __m256i out = _mm256_and_si256(p, alpha_mask);
+        for (int shift = 0; shift < 24; shift += 8) {
+            __m256i c = _mm256_and_si256(
+                _mm256_srli_epi32(p, shift), byte_mask);
+            // c * 255 / alpha fits in 32 unsigned bits and never exceeds
+            // 255 for premultiplied input.
+            c = _mm256_srli_epi32(
+                _mm256_add_epi32(_mm256_mullo_epi32(c, recip), round), 16);
+            c = _mm256_min_epu32(c, byte_mask);
+            out = _mm256_or_si256(out, _mm256_slli_epi32(c, shift));
+        }
+        if (swap_rb)
+            out = _mm256_shuffle_epi8(out, swizzle);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), out);
+    }
+    return i;
+}
+
+int PackRgbRow(unsigned char* dst, const unsigned char* src, int count)
+{
+    // R, G, B of each pixel packed into the low 12 bytes of each lane.
+    const __m256i shuffle = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i p = _mm256_shuffle_epi8(_mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(src + i * 4)), shuffle);
+        unsigned char* d = dst + i * 3;
+        __m128i lo = _mm256_castsi256_si128(p);
+        __m128i hi = _mm256_extracti128_si256(p, 1);
+        // 8 + 4 bytes per lane, nothing is written past the 24 bytes.
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(d), lo);
+        int tail = _mm_cvtsi128_si32(_mm_srli_si128(lo, 8));
+        memcpy(d + 8, &tail, 4);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(d + 12), hi);
+        tail = _mm_cvtsi128_si32(_mm_srli_si128(hi, 8));
+        memcpy(d + 20, &tail, 4);
+    }
+    return i;
+}
+
+int ExtractYRow(unsigned char* dst, const unsigned char* src, int count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i coeffs = _mm256_setr_epi16(
+        25, 129, 66, 0, 25, 129, 66, 0, 25, 129, 66, 0, 25, 129, 66, 0);
+    const __m256i bias = _mm256_set1_epi32(0x1080);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i p = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(src + i * 4));
+        __m256i lo = SumChannels(_mm256_unpacklo_epi8(p, zero), coeffs);
+        __m256i hi = SumChannels(_mm256_unpackhi_epi8(p, zero), coeffs);
+        // Pixels 0-3 in the low lane, 4-7 in the high lane.
+        __m256i y = _mm256_srli_epi32(
+            _mm256_add_epi32(_mm256_unpacklo_epi64(lo, hi), bias), 8);
+        y = _mm256_packs_epi32(y, y);
+        y = _mm256_packus_epi16(y, y);
+        int values[2] = {
+            _mm_cvtsi128_si32(_mm256_castsi256_si128(y)),
+            _mm_cvtsi128_si32(_mm256_extracti128_si256(y, 1))
+        };
+        memcpy(dst + i, values, 8);
+    }
+    return i;
+}
+
+#else  // !__AVX2__
+
+// Built without AVX2 support, the dispatcher never calls these.
+bool IsCompiled()
+{
+    return false;
+}
+
+int SwizzleRow(unsigned char*, const unsigned char*, int)
+{
+    return 0;
+}
+
+int UnpremultiplyRow(unsigned char*, const unsigned char*, int, bool,
+                     const unsigned int*)
+{
+    return 0;
+}
+
+int PackRgbRow(unsigned char*, const unsigned char*, int)
+{
+    return 0;
+}
+
+int ExtractYRow(unsigned char*, const unsigned char*, int)
+{
+    return 0;
+}
+
+#endif  // !__AVX2__
+
+}  // namespace avx2
+}  // namespace util
@@ -0,0 +1,209 @@
+/**
+ * @file platform_call.cpp
+ *
+ * @breif Impl of platform_call.h
+ */
+#include "platform_call.h"
+
+#include <atomic>
+#include <vector>
+
+#include <include/cef_runnable.h>
+
+#include "client_renderer.h"
+#include "util.h"
+
+namespace {
+
+void SendToRenderer(CefRefPtr<CefBrowser> browser,
+                    CefRefPtr<CefProcessMessage> message)
+{
+    browser->SendProcessMessage(PID_RENDERER, message);
+}
+
+void RunCall(CefRefPtr<PlatformCallHandler> handler,
+             CefRefPtr<CefBrowser> browser,
+             CefString name,
+             CefRefPtr<CefListValue> args,
+             CefRefPtr<PlatformCallHandler::Callback> callback)
+{
+    if (!callback->IsCancelled())
+        handler->OnCall(browser, name, args, callback);
+}
+
+}  // namespace
+
+class PlatformCallRegistry::Callback : public PlatformCallHandler::Callback {
+public:
+    Callback(CefRefPtr<PlatformCallRegistry> registry,
+             CefRefPtr<CefBrowser> browser,
+             int call_id)
+        : registry_(registry),
+          browser_(browser),
+          call_id_(call_id),
+          cancelled_(false) {}
+
+    virtual void Success(CefRefPtr<CefListValue> result) OVERRIDE {
+        if (!registry_->Finish(key()))
+            return;
+        CefRefPtr<CefProcessMessage> message = CreateResult(true);
+        if (result.get()) {
+            message->GetArgumentList()->SetList(2, result);
+        } else {
+            message->GetArgumentList()->SetList(2, CefListValue::Create());
+        }
+        Send(message);
+    }
+
+    virtual void Failure(const CefString& error) OVERRIDE {
+        if (!registry_->Finish(key()))
+            return;
+        CefRefPtr<CefProcessMessage> message = CreateResult(false);
+        message->GetArgumentList()->SetString(2, error);
+        Send(message);
+    }
+
+    virtual bool IsCancelled() OVERRIDE { return cancelled_.load(); }
+
+    void MarkCancelled() { cancelled_.store(true); }
+
+private:
+    CallKey key() const {
+        return CallKey(browser_->GetIdentifier(), call_id_);
+    }
+
+    CefRefPtr<CefProcessMessage> CreateResult(bool success) {
+        CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create(
+            client_renderer::kPlatformResultMessage);
+        message->GetArgumentList()->SetInt(0, call_id_);
+        message->GetArgumentList()->SetBool(1, success);
+        return message;
+    }
+
+    void Send(CefRefPtr<CefProcessMessage> message) {
+        if (CefCurrentlyOn(TID_UI)) {
+            SendToRenderer(browser_, message);
+        } else {
+            CefPostTask(TID_UI, NewCefRunnableFunction(&SendToRenderer,
+                                                       browser_, message));
+        }
+    }
+
+    CefRefPtr<PlatformCallRegistry> registry_;
+    CefRefPtr<CefBrowser> browser_;
+    int call_id_;
+    std::atomic<bool> cancelled_;
+
+    IMPLEMENT_REFCOUNTING(Callback);
+};
+
+PlatformCallRegistry::PlatformCallRegistry()
+{
+}
+
+PlatformCallRegistry::~PlatformCallRegistry()
+{
+}
+
+void PlatformCallRegistry::AddHandler(const std::string& name,
+                                      CefRefPtr<PlatformCallHandler> handler,
+                                      CefThreadId thread)
+{
+    AutoLock lock_scope(this);
+    Registration& registration = handlers_[name];
+    registration.handler = handler;
+    registration.thread = thread;
+}
+
+void PlatformCallRegistry::RemoveHandler(const std::string& name)
+{
+    AutoLock lock_scope(this);
+    handlers_.erase(name);
+}
+
+bool PlatformCallRegistry::OnProcessMessageReceived(
+    CefRefPtr<CefBrowser> browser,
+    CefRefPtr<CefProcessMessage> message)
+{
+    REQUIRE_UI_THREAD();
+
+    const std::string message_name = message->GetName();
+    CefRefPtr<CefListValue> args = message->GetArgumentList();
+    const int browser_id = browser->GetIdentifier();
+
+    if (message_name == client_renderer::kPlatformCancelMessage) {
+        Cancel(CallKey(browser_id, args->GetInt(0)));
+        return true;
+    }
+    if (message_name != client_renderer::kPlatformCallMessage)
+        return false;
+
+    const int call_id = args->GetInt(0);
+    const std::string name = args->GetString(1);
+    CefRefPtr<Callback> callback = new Callback(this, browser, call_id);
+    Registration registration;
+    {
+        AutoLock lock_scope(this);
+        std::map<std::string, Registration>::const_iterator it =
+            handlers_.find(name);
+        if (it != handlers_.end())
+            registration = it->second;
+        calls_[CallKey(browser_id, call_id)] = callback;
+    }
+    if (!registration.handler.get()) {
+        callback->Failure("No handler for platform.call " + name);
+        return true;
+    }
+
+    // The arguments of a received message are read-only and owned by it.
+    CefRefPtr<CefListValue> call_args;
+    if (args->GetType(2) == VTYPE_LIST) {
+        call_args = args->GetList(2)->Copy();
+    } else {
+        call_args = CefListValue::Create();
+    }
+    CefRefPtr<PlatformCallHandler::Callback> answer = callback.get();
+    CefPostTask(registration.thread,
+                NewCefRunnableFunction(&RunCall, registration.handler,
+                                       browser, CefString(name), call_args,
+                                       answer));
+    return true;
+}
+
+void PlatformCallRegistry::OnBeforeClose(CefRefPtr<CefBrowser> browser)
+{
+    REQUIRE_UI_THREAD();
+
+    const int browser_id = browser->GetIdentifier();
+    std::vector<CefRefPtr<Callback> > cancelled;
+    {
+        AutoLock lock_scope(this);
+        CallMap::iterator it = calls_.lower_bound(CallKey(browser_id, 0));
+        while (it != calls_.end() && it->first.first == browser_id) {
+            cancelled.push_back(it->second);
+            calls_.erase(it++);
+        }
+    }
+    for (size_t i = 0; i < cancelled.size(); ++i)
+        cancelled[i]->MarkCancelled();
+}
+
+bool PlatformCallRegistry::Finish(const CallKey& key)
+{
+    AutoLock lock_scope(this);
+    return calls_.erase(key) != 0;
+}
+
+void PlatformCallRegistry::Cancel(const CallKey& key)
+{
+    CefRefPtr<Callback> callback;
+    {
+        AutoLock lock_scope(this);
+        CallMap::iterator it = calls_.find(key);
+        if (it == calls_.end())
+            return;
+        callback = it->second;
+        calls_.erase(it);
+    }
+    callback->MarkCancelled();
+}
@@ -0,0 +1,219 @@
+/**
+ * @file platform_events.cpp
+ *
+ * @breif Impl of platform_events.h
+ */
+#include "platform_events.h"
+
+#include <string.h>
+
+#include "client_renderer.h"
+
+PlatformEventTable::PlatformEventTable()
+{
+}
+
+PlatformEventId PlatformEventTable::Intern(const CefString& name)
+{
+    PlatformEventId id = Find(name);
+    if (id != kNoPlatformEvent)
+        return id;
+
+    if ((events_.size() + 1) * 2 > slots_.size())
+        Grow();
+    Event event;
+    event.name = name;
+    event.message_name = client_renderer::GenPlatformMsg(name);
+    event.hash = Hash(name.c_str(), name.length());
+    events_.push_back(event);
+    id = static_cast<PlatformEventId>(events_.size());
+
+    const size_t mask = slots_.size() - 1;
+    size_t i = event.hash & mask;
+    while (slots_[i] != kNoPlatformEvent)
+        i = (i + 1) & mask;
+    slots_[i] = id;
+    return id;
+}
+
+PlatformEventId PlatformEventTable::Find(const CharType* name,
+                                         size_t length) const
+{
+    if (slots_.empty())
+        return kNoPlatformEvent;
+    const uint32 hash = Hash(name, length);
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask; slots_[i] != kNoPlatformEvent;
+         i = (i + 1) & mask) {
+        const Event& event = events_[slots_[i] - 1];
+        if (event.hash == hash && event.name.length() == length &&
+            (length == 0 ||
+             memcmp(event.name.c_str(), name,
+                    length * sizeof(CharType)) == 0)) {
+            return slots_[i];
+        }
+    }
+    return kNoPlatformEvent;
+}
+
+PlatformEventId PlatformEventTable::FindMessage(
+    const CefString& message_name) const
+{
+    // "<kPlatformMessage>:<event>", compared in place
+    const char* prefix = client_renderer::kPlatformMessage;
+    const size_t prefix_length = strlen(prefix);
+    const CharType* name = message_name.c_str();
+    const size_t length = message_name.length();
+    if (length <= prefix_length || name[prefix_length] != ':')
+        return kNoPlatformEvent;
+    for (size_t i = 0; i < prefix_length; ++i) {
+        if (name[i] != static_cast<CharType>(prefix[i]))
+            return kNoPlatformEvent;
+    }
+    return Find(name + prefix_length + 1, length - prefix_length - 1);
+}
+
+// static
+uint32 PlatformEventTable::Hash(const CharType* name, size_t length)
+{
+    // FNV-1a over the code units
+    uint32 hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<uint32>(name[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void PlatformEventTable::Grow()
+{
+    std::vector<PlatformEventId> slots(slots_.empty() ? 16 : slots_.size() * 2,
+                                       kNoPlatformEvent);
+    const size_t mask = slots.size() - 1;
+    for (size_t id = 1; id <= events_.size(); ++id) {
+        size_t i = events_[id - 1].hash & mask;
+        while (slots[i] != kNoPlatformEvent)
+            i = (i + 1) & mask;
+        slots[i] = static_cast<PlatformEventId>(id);
+    }
+    slots_.swap(slots);
+}
+
+PlatformEventBus::PlatformEventBus()
+    : last_id_(0)
+{
+}
+
+int PlatformEventBus::Add(PlatformEventId event, int browser_id,
+                          int64 frame_id, const Listener& listener)
+{
+    ContextListeners& context = contexts_[frame_id];
+    if (context.context.get() && !context.context->IsSame(listener.context)) {
+        // Listeners of a context of the frame that was not released
+        for (size_t i = 0; i < context.keys.size(); ++i)
+            Erase(context.keys[i], false);
+        context.keys.clear();
+    }
+    context.context = listener.context;
+
+    ListenerKey key;
+    key.event = event;
+    key.browser_id = browser_id;
+    key.listener_id = ++last_id_;
+    context.keys.push_back(key);
+
+    ListenerList& list = listeners_.Insert(event, browser_id);
+    list.push_back(listener);
+    list.back().id = key.listener_id;
+    list.back().frame_id = frame_id;
+    return key.listener_id;
+}
+
+int PlatformEventBus::Remove(PlatformEventId event, int browser_id,
+                             CefRefPtr<CefV8Context> context,
+                             CefRefPtr<CefV8Value> callback)
+{
+    ListenerList* list = listeners_.Find(event, browser_id);
+    if (!list)
+        return 0;
+    std::vector<int> removed;
+    for (size_t i = 0; i < list->size(); ++i) {
+        const Listener& listener = (*list)[i];
+        if (listener.context->IsSame(context) &&
+            (!callback.get() || listener.callback->IsSame(callback))) {
+            removed.push_back(listener.id);
+        }
+    }
+    for (size_t i = 0; i < removed.size(); ++i)
+        RemoveListener(event, browser_id, removed[i]);
+    return static_cast<int>(removed.size());
+}
+
+bool PlatformEventBus::RemoveListener(PlatformEventId event, int browser_id,
+                                      int listener_id)
+{
+    ListenerKey key;
+    key.event = event;
+    key.browser_id = browser_id;
+    key.listener_id = listener_id;
+    return Erase(key, true);
+}
+
+void PlatformEventBus::RemoveContext(int64 frame_id,
+                                     CefRefPtr<CefV8Context> context)
+{
+    std::unordered_map<int64, ContextListeners>::iterator it =
+        contexts_.find(frame_id);
+    if (it == contexts_.end() || !it->second.context->IsSame(context))
+        return;
+    for (size_t i = 0; i < it->second.keys.size(); ++i)
+        Erase(it->second.keys[i], false);
+    contexts_.erase(it);
+}
+
+const PlatformEventBus::Listener* PlatformEventBus::FindListener(
+    PlatformEventId event, int browser_id, int listener_id)
+{
+    const ListenerList* list = listeners_.Find(event, browser_id);
+    if (!list)
+        return NULL;
+    for (size_t i = 0; i < list->size(); ++i) {
+        if ((*list)[i].id == listener_id)
+            return &(*list)[i];
+    }
+    return NULL;
+}
+
+bool PlatformEventBus::Erase(const ListenerKey& key, bool index_context)
+{
+    ListenerList* list = listeners_.Find(key.event, key.browser_id);
+    if (!list)
+        return false;
+    ListenerList::iterator it = list->begin();
+    while (it != list->end() && it->id != key.listener_id)
+        ++it;
+    if (it == list->end())
+        return false;
+
+    if (index_context) {
+        std::unordered_map<int64, ContextListeners>::iterator context =
+            contexts_.find(it->frame_id);
+        if (context != contexts_.end()) {
+            std::vector<ListenerKey>& keys = context->second.keys;
+            for (size_t i = 0; i < keys.size(); ++i) {
+                if (keys[i].listener_id == key.listener_id) {
+                    keys.erase(keys.begin() + i);
+                    break;
+                }
+            }
+            if (keys.empty())
+                contexts_.erase(context);
+        }
+    }
+
+    // Erasing keeps the order of the others
+    list->erase(it);
+    if (list->empty())
+        listeners_.Erase(key.event, key.browser_id);
+    return true;
+}
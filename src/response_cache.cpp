@@ -0,0 +1,1161 @@
+/**
+ * @file response_cache.cpp
+ *
+ * @breif Impl of response_cache.h
+ */
+#include "response_cache.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <fstream>
+
+#if defined(OS_WIN)
+#include <direct.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <windows.h>
+#define strcasecmp _stricmp
+#else
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+#endif
+
+#include <include/cef_response.h>
+#include <include/cef_runnable.h>
+#include <include/cef_task.h>
+#include <include/cef_urlrequest.h>
+
+#include "asset_archive_format.h"
+#include "sha256.h"
+#include "util.h"
+
+namespace {
+
+// Version 2 names bodies by SHA-256, older indexes are ignored.
+const char kIndexMagic[] = "CEFCACHE 2";
+// Larger responses are passed through without being stored.
+const size_t kMaxBodySize = 64 * 1024 * 1024;
+
+// Response headers describing the bytes on the wire. CefURLRequest hands
+// out decoded bodies, so these do not apply to what is served.
+const char* kDroppedHeaders[] = {
+    "Content-Encoding",
+    "Content-Length",
+    "Transfer-Encoding",
+};
+
+int64 Now()
+{
+    return static_cast<int64>(time(NULL));
+}
+
+std::string ToLower(const std::string& value)
+{
+    std::string lower = value;
+    std::transform(lower.begin(), lower.end(), lower.begin(), tolower);
+    return lower;
+}
+
+std::string Trim(const std::string& value)
+{
+    const size_t begin = value.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+        return std::string();
+    const size_t end = value.find_last_not_of(" \t");
+    return value.substr(begin, end - begin + 1);
+}
+
+// Lower case items of a comma separated header value.
+std::vector<std::string> SplitList(const std::string& value)
+{
+    std::vector<std::string> items;
+    size_t begin = 0;
+    while (begin < value.size()) {
+        size_t end = value.find(',', begin);
+        if (end == std::string::npos)
+            end = value.size();
+        const std::string item = Trim(value.substr(begin, end - begin));
+        if (!item.empty())
+            items.push_back(ToLower(item));
+        begin = end + 1;
+    }
+    return items;
+}
+
+// First value of the header |name|, matched case-insensitively.
+std::string GetHeader(const CefRequest::HeaderMap& headers,
+                      const std::string& name)
+{
+    CefRequest::HeaderMap::const_iterator it = headers.begin();
+    for (; it != headers.end(); ++it) {
+        const std::string key = it->first;
+        if (strcasecmp(key.c_str(), name.c_str()) == 0)
+            return it->second;
+    }
+    return std::string();
+}
+
+// Whether the Cache-Control value |value| has the directive |name|, with
+// its argument, if any, in |argument|.
+bool HasDirective(const std::string& value, const std::string& name,
+                  std::string* argument)
+{
+    const std::vector<std::string> directives = SplitList(value);
+    for (size_t i = 0; i < directives.size(); ++i) {
+        const std::string& directive = directives[i];
+        const size_t equals = directive.find('=');
+        if (Trim(directive.substr(0, equals)) != name)
+            continue;
+        if (argument && equals != std::string::npos) {
+            *argument = Trim(directive.substr(equals + 1));
+            argument->erase(std::remove(argument->begin(), argument->end(),
+                                        '"'),
+                            argument->end());
+        }
+        return true;
+    }
+    return false;
+}
+
+// Seconds since the epoch of an IMF-fixdate like
+// "Sun, 06 Nov 1994 08:49:37 GMT", -1 if it cannot be parsed.
+int64 ParseHttpDate(const std::string& value)
+{
+    static const char kMonths[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char month[4] = { 0 };
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(value.c_str(), "%*3s, %d %3s %d %d:%d:%d", &tm.tm_mday, month,
+               &tm.tm_year, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+        return -1;
+    }
+    const char* found = strstr(kMonths, month);
+    if (!found || strlen(month) != 3 || (found - kMonths) % 3 != 0)
+        return -1;
+    tm.tm_mon = static_cast<int>(found - kMonths) / 3;
+    tm.tm_year -= 1900;
+#if defined(OS_WIN)
+    return static_cast<int64>(_mkgmtime(&tm));
+#else
+    return static_cast<int64>(timegm(&tm));
+#endif
+}
+
+// Expiry of |headers| received at |now|: max-age, then Expires. Returns
+// |now| when the response must be revalidated before every use.
+int64 GetExpiry(const CefResponse::HeaderMap& headers, int64 now)
+{
+    const std::string cache_control = GetHeader(headers, "Cache-Control");
+    if (HasDirective(cache_control, "no-cache", NULL))
+        return now;
+    std::string max_age;
+    if (HasDirective(cache_control, "max-age", &max_age)) {
+        const int64 age = atoi(GetHeader(headers, "Age").c_str());
+        return now + std::max<int64>(0, atoi(max_age.c_str()) - age);
+    }
+    const std::string expires = GetHeader(headers, "Expires");
+    if (!expires.empty())
+        return std::max(now, ParseHttpDate(expires));
+    return now;
+}
+
+std::string Hex(uint64 value)
+{
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx",
+             static_cast<unsigned long long>(value));
+    return hex;
+}
+
+// Key of the variant of a response varying on |vary_names| for a request
+// with |headers|.
+std::string GetVariantKey(const CefRequest::HeaderMap& headers,
+                          const std::vector<std::string>& vary_names)
+{
+    std::string key;
+    for (size_t i = 0; i < vary_names.size(); ++i) {
+        key += vary_names[i];
+        key += '\n';
+        key += GetHeader(headers, vary_names[i]);
+        key += '\n';
+    }
+    return key;
+}
+
+bool MakeDirectory(const std::string& path)
+{
+#if defined(OS_WIN)
+    _mkdir(path.c_str());
+    const DWORD attributes = GetFileAttributesA(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES &&
+        (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    mkdir(path.c_str(), 0755);
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+// Names of the files in the directory |path|.
+std::vector<std::string> ListDirectory(const std::string& path)
+{
+    std::vector<std::string> names;
+#if defined(OS_WIN)
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE)
+        return names;
+    do {
+        if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            names.push_back(data.cFileName);
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR* dir = opendir(path.c_str());
+    if (!dir)
+        return names;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.')
+            names.push_back(entry->d_name);
+    }
+    closedir(dir);
+#endif
+    return names;
+}
+
+// Size and modification time, in seconds since the epoch, of a file.
+bool GetFileInfo(const std::string& path, uint64& size, int64& modified)
+{
+#if defined(OS_WIN)
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+#endif
+    size = static_cast<uint64>(st.st_size);
+    modified = static_cast<int64>(st.st_mtime);
+    return true;
+}
+
+bool FileExists(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    fclose(file);
+    return true;
+}
+
+// Write |data| to |path| through a temporary file, so that readers never
+// see a partial file.
+bool WriteFileAtomic(const std::string& path, const std::string& data)
+{
+    const std::string temp = path + ".tmp";
+    FILE* file = fopen(temp.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = data.empty() ||
+        fwrite(data.data(), 1, data.size(), file) == data.size();
+    ok = fclose(file) == 0 && ok;
+#if defined(OS_WIN)
+    ok = ok && MoveFileExA(temp.c_str(), path.c_str(),
+                           MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    ok = ok && rename(temp.c_str(), path.c_str()) == 0;
+#endif
+    if (!ok)
+        remove(temp.c_str());
+    return ok;
+}
+
+bool ReadWholeFile(const std::string& path, std::string& data)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    data.clear();
+    char buffer[65536];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.append(buffer, count);
+    const bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+}  // namespace
+
+// Answers one request, from the cache when it holds a fresh response and
+// from the network otherwise. Lives on the IO thread, except for the disk
+// lookup done on the FILE thread before any network request is made.
+class ResponseCache::Handler : public CefResourceHandler,
+                               public CefURLRequestClient {
+public:
+    explicit Handler(CefRefPtr<ResponseCache> cache)
+        : cache_(cache),
+          has_cached_(false),
+          serving_cached_(false),
+          headers_ready_(false),
+          complete_(false),
+          canceled_(false),
+          store_(false),
+          offset_(0),
+          status_(0) {}
+
+    virtual bool ProcessRequest(CefRefPtr<CefRequest> request,
+                                CefRefPtr<CefCallback> callback) OVERRIDE
+    {
+        REQUIRE_IO_THREAD();
+        request_ = request;
+        callback_ = callback;
+        Entry entry;
+        Body body;
+        const LookupResult result =
+            cache_->Lookup(request_, false, entry, body);
+        if (result == NEEDS_DISK) {
+            CefPostTask(TID_FILE,
+                        NewCefRunnableMethod(this, &Handler::LookupOnDisk));
+        } else if (result == FOUND && entry.expires > Now()) {
+            cache_->CountHit(true);
+            ServeCached(entry, body);
+        } else {
+            if (result == FOUND) {
+                AutoLock lock_scope(this);
+                cached_ = entry;
+                cached_body_ = body;
+                has_cached_ = true;
+            }
+            StartRequest();
+        }
+        return true;
+    }
+
+    virtual void GetResponseHeaders(CefRefPtr<CefResponse> response,
+                                    int64& response_length,
+                                    CefString& redirectUrl) OVERRIDE
+    {
+        AutoLock lock_scope(this);
+        response->SetStatus(status_);
+        response->SetStatusText(status_text_);
+        response->SetMimeType(mime_type_);
+        response->SetHeaderMap(headers_);
+        response_length = serving_cached_ ?
+            static_cast<int64>(cached_body_->size()) : -1;
+    }
+
+    virtual bool ReadResponse(void* data_out,
+                              int bytes_to_read,
+                              int& bytes_read,
+                              CefRefPtr<CefCallback> callback) OVERRIDE
+    {
+        AutoLock lock_scope(this);
+        bytes_read = 0;
+        const std::string& data = serving_cached_ ? *cached_body_ : body_;
+        if (offset_ < data.size()) {
+            const size_t count = std::min(data.size() - offset_,
+                                          static_cast<size_t>(bytes_to_read));
+            memcpy(data_out, data.data() + offset_, count);
+            offset_ += count;
+            bytes_read = static_cast<int>(count);
+            return true;
+        }
+        if (serving_cached_ || complete_ || canceled_)
+            return false;
+        // Wait for more data from the network.
+        read_callback_ = callback;
+        return true;
+    }
+
+    virtual void Cancel() OVERRIDE
+    {
+        AutoLock lock_scope(this);
+        canceled_ = true;
+        callback_ = NULL;
+        read_callback_ = NULL;
+        if (url_request_.get()) {
+            url_request_->Cancel();
+            url_request_ = NULL;
+        }
+    }
+
+    // CefURLRequestClient methods.
+    virtual void OnRequestComplete(CefRefPtr<CefURLRequest> request) OVERRIDE
+    {
+        CefRefPtr<CefCallback> callback;
+        {
+            AutoLock lock_scope(this);
+            const bool success =
+                request->GetRequestStatus() == UR_SUCCESS;
+            if (!headers_ready_)
+                callback = ReceiveHeaders(request, success);
+            complete_ = true;
+            url_request_ = NULL;
+            if (success && store_) {
+                entry_.body_size = body_.size();
+                CefPostTask(TID_FILE,
+                            NewCefRunnableMethod(cache_.get(),
+                                                 &ResponseCache::Store,
+                                                 request_, entry_,
+                                                 Body(new std::string(body_))));
+            }
+            if (!callback.get())
+                callback.swap(read_callback_);
+        }
+        if (callback.get())
+            callback->Continue();
+    }
+
+    virtual void OnUploadProgress(CefRefPtr<CefURLRequest> request,
+                                  uint64 current,
+                                  uint64 total) OVERRIDE {}
+
+    virtual void OnDownloadProgress(CefRefPtr<CefURLRequest> request,
+                                    uint64 current,
+                                    uint64 total) OVERRIDE {}
+
+    virtual void OnDownloadData(CefRefPtr<CefURLRequest> request,
+                                const void* data,
+                                size_t data_length) OVERRIDE
+    {
+        CefRefPtr<CefCallback> callback;
+        {
+            AutoLock lock_scope(this);
+            if (canceled_)
+                return;
+            if (!headers_ready_)
+                callback = ReceiveHeaders(request, true);
+            if (store_ && body_.size() + data_length > kMaxBodySize)
+                store_ = false;
+            // Only bodies being stored are kept past their reading.
+            if (!store_ && offset_ == body_.size()) {
+                body_.clear();
+                offset_ = 0;
+            }
+            body_.append(static_cast<const char*>(data), data_length);
+            if (!callback.get())
+                callback.swap(read_callback_);
+        }
+        if (callback.get())
+            callback->Continue();
+    }
+
+    virtual bool GetAuthCredentials(bool isProxy,
+                                    const CefString& host,
+                                    int port,
+                                    const CefString& realm,
+                                    const CefString& scheme,
+                                    CefRefPtr<CefAuthCallback> callback)
+                                    OVERRIDE
+    {
+        return false;
+    }
+
+private:
+    void LookupOnDisk()
+    {
+        REQUIRE_FILE_THREAD();
+        Entry entry;
+        Body body;
+        if (cache_->Lookup(request_, true, entry, body) == FOUND) {
+            if (entry.expires > Now()) {
+                cache_->CountHit(false);
+                ServeCached(entry, body);
+                return;
+            }
+            AutoLock lock_scope(this);
+            cached_ = entry;
+            cached_body_ = body;
+            has_cached_ = true;
+        }
+        CefPostTask(TID_IO, NewCefRunnableMethod(this, &Handler::StartRequest));
+    }
+
+    void ServeCached(const Entry& entry, Body body)
+    {
+        CefRefPtr<CefCallback> callback;
+        {
+            AutoLock lock_scope(this);
+            serving_cached_ = true;
+            cached_body_ = body;
+            status_ = entry.status;
+            status_text_ = entry.status_text;
+            mime_type_ = entry.mime_type;
+            headers_ = entry.headers;
+            callback.swap(callback_);
+        }
+        if (callback.get())
+            callback->Continue();
+    }
+
+    // Fetch the response, conditionally when a stale one is cached.
+    void StartRequest()
+    {
+        REQUIRE_IO_THREAD();
+        AutoLock lock_scope(this);
+        if (canceled_)
+            return;
+        CefRequest::HeaderMap headers;
+        request_->GetHeaderMap(headers);
+        if (has_cached_) {
+            if (!cached_.etag.empty())
+                headers.insert(std::make_pair("If-None-Match", cached_.etag));
+            if (!cached_.last_modified.empty()) {
+                headers.insert(std::make_pair("If-Modified-Since",
+                                              cached_.last_modified));
+            }
+        }
+        CefRefPtr<CefRequest> request = CefRequest::Create();
+        request->SetURL(request_->GetURL());
+        request->SetMethod("GET");
+        request->SetHeaderMap(headers);
+        request->SetFlags(UR_FLAG_ALLOW_CACHED_CREDENTIALS);
+        url_request_ = CefURLRequest::Create(request, this);
+    }
+
+    // Take the response headers of |request|. Returns the callback to
+    // continue the request with, called once the lock is released.
+    CefRefPtr<CefCallback> ReceiveHeaders(CefRefPtr<CefURLRequest> request,
+                                          bool success)
+    {
+        headers_ready_ = true;
+        CefRefPtr<CefCallback> callback;
+        callback.swap(callback_);
+        CefRefPtr<CefResponse> response = request->GetResponse();
+        if (!callback.get())
+            return NULL;
+        if (!success || !response.get()) {
+            callback->Cancel();
+            return NULL;
+        }
+
+        CefResponse::HeaderMap headers;
+        response->GetHeaderMap(headers);
+        const int64 now = Now();
+        if (has_cached_ && response->GetStatus() == 304) {
+            cache_->CountRevalidated();
+            CefPostTask(TID_FILE,
+                        NewCefRunnableMethod(cache_.get(),
+                                             &ResponseCache::Refresh,
+                                             request_,
+                                             GetExpiry(headers, now)));
+            serving_cached_ = true;
+            status_ = cached_.status;
+            status_text_ = cached_.status_text;
+            mime_type_ = cached_.mime_type;
+            headers_ = cached_.headers;
+            return callback;
+        }
+
+        cache_->CountMiss();
+        status_ = response->GetStatus();
+        status_text_ = response->GetStatusText();
+        mime_type_ = response->GetMimeType();
+        CefResponse::HeaderMap::const_iterator it = headers.begin();
+        for (; it != headers.end(); ++it) {
+            const std::string name = it->first;
+            bool dropped = false;
+            for (size_t i = 0;
+                 i < sizeof(kDroppedHeaders) / sizeof(kDroppedHeaders[0]);
+                 ++i) {
+                if (strcasecmp(name.c_str(), kDroppedHeaders[i]) == 0)
+                    dropped = true;
+            }
+            if (!dropped)
+                headers_.insert(*it);
+        }
+
+        // Shared between browsers: private responses and those setting
+        // cookies are not kept.
+        const std::string cache_control = GetHeader(headers, "Cache-Control");
+        const std::vector<std::string> vary =
+            SplitList(GetHeader(headers, "Vary"));
+        entry_.etag = GetHeader(headers, "ETag");
+        entry_.last_modified = GetHeader(headers, "Last-Modified");
+        entry_.expires = GetExpiry(headers, now);
+        store_ = status_ == 200 &&
+            !HasDirective(cache_control, "no-store", NULL) &&
+            !HasDirective(cache_control, "private", NULL) &&
+            GetHeader(headers, "Set-Cookie").empty() &&
+            std::find(vary.begin(), vary.end(), "*") == vary.end() &&
+            (entry_.expires > now || !entry_.etag.empty() ||
+             !entry_.last_modified.empty());
+        if (store_) {
+            CefRequest::HeaderMap request_headers;
+            request_->GetHeaderMap(request_headers);
+            for (size_t i = 0; i < vary.size(); ++i) {
+                entry_.vary.push_back(std::make_pair(
+                    vary[i], GetHeader(request_headers, vary[i])));
+            }
+            entry_.status = status_;
+            entry_.status_text = status_text_;
+            entry_.mime_type = mime_type_;
+            entry_.headers = headers_;
+        }
+        return callback;
+    }
+
+    CefRefPtr<ResponseCache> cache_;
+    CefRefPtr<CefRequest> request_;
+    CefRefPtr<CefCallback> callback_;
+    CefRefPtr<CefCallback> read_callback_;
+    CefRefPtr<CefURLRequest> url_request_;
+
+    // Stale entry being revalidated, or entry served.
+    Entry cached_;
+    Body cached_body_;
+    bool has_cached_;
+    bool serving_cached_;
+
+    bool headers_ready_;
+    bool complete_;
+    bool canceled_;
+    // Whether the network response is to be stored, as |entry_|.
+    bool store_;
+    Entry entry_;
+    // Network response body, from |offset_| on not read yet.
+    std::string body_;
+    size_t offset_;
+
+    int status_;
+    std::string status_text_;
+    std::string mime_type_;
+    CefResponse::HeaderMap headers_;
+
+    IMPLEMENT_REFCOUNTING(Handler);
+    IMPLEMENT_LOCKING(Handler);
+};
+
+ResponseCache::ResponseCache()
+    : memory_limit_(0),
+      memory_bytes_(0),
+      disk_limit_(0),
+      disk_bytes_(0)
+{
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+ResponseCache::~ResponseCache()
+{
+}
+
+bool ResponseCache::Open(const std::string& dir, size_t memory_limit,
+                         uint64 disk_limit)
+{
+    if (!MakeDirectory(dir) || !MakeDirectory(dir + "/data") ||
+        !MakeDirectory(dir + "/index")) {
+        return false;
+    }
+    std::vector<std::string> removed;
+    {
+        AutoLock lock_scope(this);
+        dir_ = dir;
+        memory_limit_ = memory_limit;
+        disk_limit_ = disk_limit;
+        LoadStore(removed);
+        EvictStored(removed);
+    }
+    for (size_t i = 0; i < removed.size(); ++i)
+        remove(removed[i].c_str());
+    return true;
+}
+
+CefRefPtr<CefResourceHandler> ResponseCache::CreateResourceHandler(
+    CefRefPtr<CefRequest> request)
+{
+    const std::string url = ToLower(request->GetURL());
+    if (url.compare(0, 7, "http://") != 0 &&
+        url.compare(0, 8, "https://") != 0) {
+        return NULL;
+    }
+
+    CefRequest::HeaderMap headers;
+    request->GetHeaderMap(headers);
+    const std::string cache_control = GetHeader(headers, "Cache-Control");
+    // Reloads, partial and conditional requests of the page go to the
+    // network as they are, and so do credentialed ones: their responses
+    // belong to one user.
+    const bool cacheable = !dir_.empty() &&
+        request->GetMethod() == "GET" &&
+        GetHeader(headers, "Authorization").empty() &&
+        GetHeader(headers, "Cookie").empty() &&
+        !(request->GetFlags() & UR_FLAG_SKIP_CACHE) &&
+        !HasDirective(cache_control, "no-cache", NULL) &&
+        !HasDirective(cache_control, "no-store", NULL) &&
+        !HasDirective(GetHeader(headers, "Pragma"), "no-cache", NULL) &&
+        GetHeader(headers, "Range").empty() &&
+        GetHeader(headers, "If-None-Match").empty() &&
+        GetHeader(headers, "If-Modified-Since").empty();
+    if (!cacheable) {
+        AutoLock lock_scope(this);
+        stats_.bypassed++;
+        return NULL;
+    }
+    return new Handler(this);
+}
+
+ResponseCache::Stats ResponseCache::GetStats()
+{
+    AutoLock lock_scope(this);
+    Stats stats = stats_;
+    const uint64 hits =
+        stats.memory_hits + stats.disk_hits + stats.revalidated;
+    stats.hit_ratio = hits + stats.misses ?
+        static_cast<double>(hits) / (hits + stats.misses) : 0;
+    stats.memory_bytes = memory_bytes_;
+    stats.memory_entries = memory_.size();
+    stats.disk_bytes = disk_bytes_;
+    stats.disk_entries = stored_.size();
+    return stats;
+}
+
+ResponseCache::LookupResult ResponseCache::Lookup(
+    CefRefPtr<CefRequest> request, bool from_disk, Entry& entry, Body& body)
+{
+    const std::string url = request->GetURL();
+    CefRequest::HeaderMap headers;
+    request->GetHeaderMap(headers);
+
+    // Every URL on disk is known since Open, so misses need no disk access.
+    bool known;
+    {
+        AutoLock lock_scope(this);
+        if (!stored_.count(url))
+            return NOT_FOUND;
+        known = index_.count(url) != 0;
+    }
+    if (!known) {
+        if (!from_disk)
+            return NEEDS_DISK;
+        Variants variants;
+        if (!ReadIndex(url, variants))
+            return NOT_FOUND;
+        AutoLock lock_scope(this);
+        if (!stored_.count(url))
+            return NOT_FOUND;
+        index_[url] = variants;
+    }
+
+    {
+        AutoLock lock_scope(this);
+        std::unordered_map<std::string, Variants>::const_iterator variants =
+            index_.find(url);
+        if (variants == index_.end())
+            return NOT_FOUND;
+        std::unordered_map<std::string, Entry>::const_iterator it =
+            variants->second.entries.find(
+                GetVariantKey(headers, variants->second.vary_names));
+        if (it == variants->second.entries.end())
+            return NOT_FOUND;
+        entry = it->second;
+        // Entries in |index_| are on disk, their URL is in |stored_|.
+        disk_lru_.splice(disk_lru_.begin(), disk_lru_,
+                         stored_[url].position);
+        body = GetMemoryBody(entry.body_name);
+        if (body.get())
+            return FOUND;
+        if (!from_disk)
+            return NEEDS_DISK;
+    }
+
+    std::string* data = new std::string();
+    body.reset(data);
+    if (!ReadWholeFile(GetBodyPath(entry.body_name), *data) ||
+        data->size() != entry.body_size) {
+        body.reset();
+        return NOT_FOUND;
+    }
+    AutoLock lock_scope(this);
+    AddMemoryBody(entry.body_name, body);
+    return FOUND;
+}
+
+void ResponseCache::Store(CefRefPtr<CefRequest> request, Entry entry,
+                          Body body)
+{
+    REQUIRE_FILE_THREAD();
+    // Bodies are named by their SHA-256, so that an existing file is the
+    // same body and a response cannot be made to take another's file.
+    entry.body_name = Sha256::HexDigest(body->data(), body->size());
+    const std::string body_path = GetBodyPath(entry.body_name);
+    if (!FileExists(body_path) && !WriteFileAtomic(body_path, *body))
+        return;
+
+    const std::string url = request->GetURL();
+    Variants variants;
+    bool known;
+    {
+        AutoLock lock_scope(this);
+        known = index_.count(url) != 0;
+        if (known)
+            variants = index_[url];
+    }
+    if (!known)
+        ReadIndex(url, variants);
+
+    std::vector<std::string> vary_names;
+    CefRequest::HeaderMap headers;
+    for (size_t i = 0; i < entry.vary.size(); ++i) {
+        vary_names.push_back(entry.vary[i].first);
+        headers.insert(entry.vary[i]);
+    }
+    // Variants stored under other Vary headers cannot be told apart.
+    if (vary_names != variants.vary_names) {
+        variants.vary_names = vary_names;
+        variants.entries.clear();
+    }
+    variants.entries[GetVariantKey(headers, vary_names)] = entry;
+    uint64 index_size;
+    if (!WriteIndex(url, variants, index_size))
+        return;
+
+    std::vector<std::string> removed;
+    {
+        AutoLock lock_scope(this);
+        index_[url] = variants;
+        AddStoredURL(url, variants, index_size, removed);
+        EvictStored(removed);
+        if (stored_.count(url))
+            AddMemoryBody(entry.body_name, body);
+        stats_.stored++;
+    }
+    for (size_t i = 0; i < removed.size(); ++i)
+        remove(removed[i].c_str());
+}
+
+void ResponseCache::Refresh(CefRefPtr<CefRequest> request, int64 expires)
+{
+    REQUIRE_FILE_THREAD();
+    const std::string url = request->GetURL();
+    CefRequest::HeaderMap headers;
+    request->GetHeaderMap(headers);
+    Variants variants;
+    {
+        AutoLock lock_scope(this);
+        if (!index_.count(url))
+            return;
+        Variants& stored = index_[url];
+        std::unordered_map<std::string, Entry>::iterator it =
+            stored.entries.find(GetVariantKey(headers, stored.vary_names));
+        if (it == stored.entries.end())
+            return;
+        it->second.expires = expires;
+        variants = stored;
+    }
+    uint64 index_size;
+    if (!WriteIndex(url, variants, index_size))
+        return;
+    std::vector<std::string> removed;
+    {
+        AutoLock lock_scope(this);
+        if (stored_.count(url))
+            AddStoredURL(url, variants, index_size, removed);
+        EvictStored(removed);
+    }
+    for (size_t i = 0; i < removed.size(); ++i)
+        remove(removed[i].c_str());
+}
+
+void ResponseCache::CountHit(bool from_memory)
+{
+    AutoLock lock_scope(this);
+    if (from_memory)
+        stats_.memory_hits++;
+    else
+        stats_.disk_hits++;
+}
+
+void ResponseCache::CountRevalidated()
+{
+    AutoLock lock_scope(this);
+    stats_.revalidated++;
+}
+
+void ResponseCache::CountMiss()
+{
+    AutoLock lock_scope(this);
+    stats_.misses++;
+}
+
+std::string ResponseCache::GetIndexPath(const std::string& url) const
+{
+    return dir_ + "/index/" + Hex(asset_archive::Hash(url.data(), url.size()));
+}
+
+std::string ResponseCache::GetBodyPath(const std::string& name) const
+{
+    return dir_ + "/data/" + name;
+}
+
+// Index files are text, one field per line:
+//
+//   CEFCACHE 2
+//   <url>
+//   <number of vary names> and the names
+//   <number of entries> and per entry: status, status text, mime type,
+//     etag, last modified, body name, body size, expires, then the number
+//     of vary values and of headers, each followed by name and value lines
+bool ResponseCache::ReadIndex(const std::string& url,
+                              Variants& variants) const
+{
+    std::string read_url;
+    Variants read;
+    // Missing, or another URL with the same hash.
+    if (!ReadIndexFile(GetIndexPath(url), read_url, read) || read_url != url)
+        return false;
+    variants = read;
+    return true;
+}
+
+bool ResponseCache::ReadIndexFile(const std::string& path, std::string& url,
+                                  Variants& variants)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    std::string line;
+    if (!std::getline(file, line) || line != kIndexMagic ||
+        !std::getline(file, url)) {
+        return false;
+    }
+
+    Variants read;
+    size_t count = 0;
+    if (!(file >> count))
+        return false;
+    std::getline(file, line);
+    for (size_t i = 0; i < count && std::getline(file, line); ++i)
+        read.vary_names.push_back(line);
+    if (!(file >> count))
+        return false;
+    std::getline(file, line);
+    for (size_t i = 0; i < count; ++i) {
+        Entry entry;
+        size_t vary_count = 0;
+        size_t header_count = 0;
+        file >> entry.status;
+        std::getline(file, line);
+        std::getline(file, entry.status_text);
+        std::getline(file, entry.mime_type);
+        std::getline(file, entry.etag);
+        std::getline(file, entry.last_modified);
+        std::getline(file, entry.body_name);
+        file >> entry.body_size >> entry.expires >> vary_count >>
+            header_count;
+        std::getline(file, line);
+        std::string name, value;
+        CefRequest::HeaderMap vary_headers;
+        for (size_t j = 0; j < vary_count; ++j) {
+            std::getline(file, name);
+            std::getline(file, value);
+            entry.vary.push_back(std::make_pair(name, value));
+            vary_headers.insert(std::make_pair(name, value));
+        }
+        for (size_t j = 0; j < header_count; ++j) {
+            std::getline(file, name);
+            std::getline(file, value);
+            entry.headers.insert(std::make_pair(name, value));
+        }
+        if (!file)
+            return false;
+        read.entries[GetVariantKey(vary_headers, read.vary_names)] = entry;
+    }
+    variants = read;
+    return true;
+}
+
+bool ResponseCache::WriteIndex(const std::string& url,
+                               const Variants& variants,
+                               uint64& size) const
+{
+    std::string data = std::string(kIndexMagic) + "\n" + url + "\n";
+    char number[32];
+    snprintf(number, sizeof(number), "%u\n",
+             static_cast<unsigned>(variants.vary_names.size()));
+    data += number;
+    for (size_t i = 0; i < variants.vary_names.size(); ++i)
+        data += variants.vary_names[i] + "\n";
+    snprintf(number, sizeof(number), "%u\n",
+             static_cast<unsigned>(variants.entries.size()));
+    data += number;
+
+    std::unordered_map<std::string, Entry>::const_iterator it =
+        variants.entries.begin();
+    for (; it != variants.entries.end(); ++it) {
+        const Entry& entry = it->second;
+        snprintf(number, sizeof(number), "%d\n", entry.status);
+        data += number;
+        data += entry.status_text + "\n" + entry.mime_type + "\n" +
+            entry.etag + "\n" + entry.last_modified + "\n" +
+            entry.body_name + "\n";
+        char numbers[96];
+        snprintf(numbers, sizeof(numbers), "%llu %lld %u %u\n",
+                 static_cast<unsigned long long>(entry.body_size),
+                 static_cast<long long>(entry.expires),
+                 static_cast<unsigned>(entry.vary.size()),
+                 static_cast<unsigned>(entry.headers.size()));
+        data += numbers;
+        for (size_t i = 0; i < entry.vary.size(); ++i)
+            data += entry.vary[i].first + "\n" + entry.vary[i].second + "\n";
+        CefRequest::HeaderMap::const_iterator header = entry.headers.begin();
+        for (; header != entry.headers.end(); ++header) {
+            data += std::string(header->first) + "\n" +
+                std::string(header->second) + "\n";
+        }
+    }
+    size = data.size();
+    return WriteFileAtomic(GetIndexPath(url), data);
+}
+
+ResponseCache::Body ResponseCache::GetMemoryBody(const std::string& name)
+{
+    std::unordered_map<std::string, MemoryBody>::iterator it =
+        memory_.find(name);
+    if (it == memory_.end())
+        return Body();
+    lru_.splice(lru_.begin(), lru_, it->second.position);
+    return it->second.body;
+}
+
+void ResponseCache::AddMemoryBody(const std::string& name, Body body)
+{
+    if (body->size() > memory_limit_ || memory_.count(name))
+        return;
+    lru_.push_front(name);
+    MemoryBody& item = memory_[name];
+    item.body = body;
+    item.position = lru_.begin();
+    memory_bytes_ += body->size();
+    while (memory_bytes_ > memory_limit_) {
+        std::unordered_map<std::string, MemoryBody>::iterator oldest =
+            memory_.find(lru_.back());
+        memory_bytes_ -= oldest->second.body->size();
+        memory_.erase(oldest);
+        lru_.pop_back();
+    }
+}
+
+void ResponseCache::LoadStore(std::vector<std::string>& removed)
+{
+    stored_.clear();
+    bodies_.clear();
+    disk_lru_.clear();
+    index_.clear();
+    disk_bytes_ = 0;
+
+    // URLs by the time their index was written, the oldest first.
+    std::vector<std::pair<int64, std::string> > order;
+    std::unordered_map<std::string, std::pair<Variants, uint64> > found;
+    const std::vector<std::string> index_names =
+        ListDirectory(dir_ + "/index");
+    for (size_t i = 0; i < index_names.size(); ++i) {
+        const std::string path = dir_ + "/index/" + index_names[i];
+        std::string url;
+        Variants variants;
+        uint64 size;
+        int64 modified;
+        // Older versions, leftover temporary files and the like.
+        if (!ReadIndexFile(path, url, variants) ||
+            GetIndexPath(url) != path ||
+            !GetFileInfo(path, size, modified)) {
+            removed.push_back(path);
+            continue;
+        }
+        order.push_back(std::make_pair(modified, url));
+        found[url] = std::make_pair(variants, size);
+    }
+    std::sort(order.begin(), order.end());
+    for (size_t i = 0; i < order.size(); ++i) {
+        const std::pair<Variants, uint64>& item = found[order[i].second];
+        AddStoredURL(order[i].second, item.first, item.second, removed);
+    }
+
+    const std::vector<std::string> body_names = ListDirectory(dir_ + "/data");
+    for (size_t i = 0; i < body_names.size(); ++i) {
+        if (!bodies_.count(body_names[i]))
+            removed.push_back(GetBodyPath(body_names[i]));
+    }
+}
+
+void ResponseCache::AddStoredURL(const std::string& url,
+                                 const Variants& variants,
+                                 uint64 index_size,
+                                 std::vector<std::string>& removed)
+{
+    std::unordered_map<std::string, StoredURL>::iterator it =
+        stored_.find(url);
+    std::vector<std::string> old_names;
+    if (it != stored_.end()) {
+        old_names.swap(it->second.body_names);
+        disk_bytes_ -= it->second.index_size;
+        disk_lru_.splice(disk_lru_.begin(), disk_lru_, it->second.position);
+    } else {
+        disk_lru_.push_front(url);
+        it = stored_.insert(std::make_pair(url, StoredURL())).first;
+        it->second.position = disk_lru_.begin();
+    }
+    it->second.index_size = index_size;
+    disk_bytes_ += index_size;
+
+    // Referenced before the old bodies are released, so that a body kept
+    // by the new entries is not deleted.
+    std::unordered_map<std::string, Entry>::const_iterator entry =
+        variants.entries.begin();
+    for (; entry != variants.entries.end(); ++entry) {
+        const std::string& name = entry->second.body_name;
+        it->second.body_names.push_back(name);
+        StoredBody& body = bodies_[name];
+        if (body.refs++ == 0) {
+            body.size = entry->second.body_size;
+            disk_bytes_ += body.size;
+        }
+    }
+    ReleaseBodies(old_names, removed);
+}
+
+void ResponseCache::RemoveStoredURL(const std::string& url,
+                                    std::vector<std::string>& removed)
+{
+    std::unordered_map<std::string, StoredURL>::iterator it =
+        stored_.find(url);
+    if (it == stored_.end())
+        return;
+    disk_bytes_ -= it->second.index_size;
+    disk_lru_.erase(it->second.position);
+    std::vector<std::string> names;
+    names.swap(it->second.body_names);
+    stored_.erase(it);
+    index_.erase(url);
+    removed.push_back(GetIndexPath(url));
+    ReleaseBodies(names, removed);
+}
+
+void ResponseCache::ReleaseBodies(const std::vector<std::string>& names,
+                                  std::vector<std::string>& removed)
+{
+    for (size_t i = 0; i < names.size(); ++i) {
+        std::unordered_map<std::string, StoredBody>::iterator it =
+            bodies_.find(names[i]);
+        if (it == bodies_.end() || --it->second.refs > 0)
+            continue;
+        disk_bytes_ -= it->second.size;
+        removed.push_back(GetBodyPath(names[i]));
+        bodies_.erase(it);
+    }
+}
+
+void ResponseCache::EvictStored(std::vector<std::string>& removed)
+{
+    while (disk_bytes_ > disk_limit_ && !disk_lru_.empty()) {
+        // Copied, the list node goes away with the URL.
+        const std::string url = disk_lru_.back();
+        RemoveStoredURL(url, removed);
+        stats_.evicted++;
+    }
+}
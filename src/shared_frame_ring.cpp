@@ -0,0 +1,432 @@
+/**
+ * @file shared_frame_ring.cpp
+ *
+ * @breif Impl of shared_frame_ring.h
+ */
+#include "shared_frame_ring.h"
+
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#if defined(OS_WIN)
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+#endif
+
+#include "pixel_util.h"
+
+namespace {
+
+const size_t kSlotAlignment = 64;
+
+size_t AlignUp(size_t value)
+{
+    return (value + kSlotAlignment - 1) & ~(kSlotAlignment - 1);
+}
+
+int64 NowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Accesses to the fields shared with other processes.
+#if defined(_MSC_VER)
+uint32 LoadAcquire(const volatile uint32* ptr)
+{
+    uint32 value = *ptr;
+    _ReadWriteBarrier();
+    return value;
+}
+uint64 LoadAcquire(const volatile uint64* ptr)
+{
+    return _InterlockedCompareExchange64(
+        const_cast<volatile __int64*>(
+            reinterpret_cast<const volatile __int64*>(ptr)), 0, 0);
+}
+void StoreRelease(volatile uint32* ptr, uint32 value)
+{
+    _ReadWriteBarrier();
+    *ptr = value;
+}
+void StoreRelease(volatile uint64* ptr, uint64 value)
+{
+    _InterlockedExchange64(reinterpret_cast<volatile __int64*>(ptr), value);
+}
+void Increment(volatile int32* ptr)
+{
+    _InterlockedIncrement(reinterpret_cast<volatile long*>(ptr));
+}
+#else
+uint32 LoadAcquire(const volatile uint32* ptr)
+{
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+uint64 LoadAcquire(const volatile uint64* ptr)
+{
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+void StoreRelease(volatile uint32* ptr, uint32 value)
+{
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+void StoreRelease(volatile uint64* ptr, uint64 value)
+{
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+void Increment(volatile int32* ptr)
+{
+    __atomic_add_fetch(ptr, 1, __ATOMIC_RELEASE);
+}
+#endif
+
+#if defined(OS_WIN)
+std::wstring GetMappingName(const std::string& name)
+{
+    return L"Local\\" + std::wstring(name.begin(), name.end());
+}
+#else
+std::string GetMappingName(const std::string& name)
+{
+    return "/" + name;
+}
+#endif
+
+}  // namespace
+
+SharedFrameWriter::SharedFrameWriter()
+    : header_(NULL),
+      mapping_size_(0),
+      published_(0)
+#if defined(OS_WIN)
+      , mapping_(NULL)
+#endif
+{
+}
+
+SharedFrameWriter::~SharedFrameWriter()
+{
+    Close();
+}
+
+bool SharedFrameWriter::Create(const std::string& name, int max_width,
+                               int max_height, int slot_count)
+{
+    Close();
+    if (max_width <= 0 || max_height <= 0 || slot_count < 2 ||
+        slot_count > DamageHistory::kSize) {
+        return false;
+    }
+
+    const size_t pixels_offset = AlignUp(sizeof(SharedFrameSlotHeader));
+    const size_t slot_size = AlignUp(pixels_offset +
+        static_cast<size_t>(max_width) * max_height * util::kBytesPerPixel);
+    const size_t size = AlignUp(sizeof(SharedFrameRingHeader)) +
+        slot_size * slot_count;
+
+    void* memory = NULL;
+#if defined(OS_WIN)
+    mapping_ = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                  static_cast<DWORD>(
+                                      static_cast<uint64>(size) >> 32),
+                                  static_cast<DWORD>(size),
+                                  GetMappingName(name).c_str());
+    if (!mapping_)
+        return false;
+    memory = MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, size);
+    if (!memory) {
+        CloseHandle(mapping_);
+        mapping_ = NULL;
+        return false;
+    }
+#else
+    name_ = GetMappingName(name);
+    int fd = shm_open(name_.c_str(), O_CREAT | O_RDWR, 0600);
+    if (fd < 0)
+        return false;
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        shm_unlink(name_.c_str());
+        return false;
+    }
+    memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        shm_unlink(name_.c_str());
+        return false;
+    }
+#endif
+    memset(memory, 0, size);
+
+    header_ = static_cast<SharedFrameRingHeader*>(memory);
+    mapping_size_ = size;
+    header_->version = kSharedFrameVersion;
+    header_->slot_count = slot_count;
+    header_->slot_size = static_cast<uint32>(slot_size);
+    header_->pixels_offset = static_cast<uint32>(pixels_offset);
+    header_->max_width = max_width;
+    header_->max_height = max_height;
+    published_ = 0;
+    slot_sequence_.assign(slot_count, 0);
+    // Readers check the magic last.
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = kSharedFrameMagic;
+    return true;
+}
+
+void SharedFrameWriter::Close()
+{
+    if (!header_)
+        return;
+#if defined(OS_WIN)
+    UnmapViewOfFile(header_);
+    CloseHandle(mapping_);
+    mapping_ = NULL;
+#else
+    munmap(header_, mapping_size_);
+    shm_unlink(name_.c_str());
+#endif
+    header_ = NULL;
+    mapping_size_ = 0;
+}
+
+bool SharedFrameWriter::Publish(const OffScreenSurface& source,
+                                const std::vector<CefRect>& damage)
+{
+    if (!header_ || source.IsEmpty() ||
+        source.width() > static_cast<int>(header_->max_width) ||
+        source.height() > static_cast<int>(header_->max_height)) {
+        return false;
+    }
+
+    const uint64 sequence = ++published_;
+    history_.Record(sequence, damage);
+    const uint32 index = static_cast<uint32>(sequence % header_->slot_count);
+    SharedFrameSlotHeader* slot = GetSlot(index);
+    const CefRect full(0, 0, source.width(), source.height());
+    const int stride = source.width() * util::kBytesPerPixel;
+
+    std::vector<CefRect> rects;
+    if (slot->width != source.width() || slot->height != source.height() ||
+        !history_.Collect(slot_sequence_[index], sequence, rects)) {
+        rects.assign(1, full);
+    }
+
+    const uint32 lock = slot->lock;
+    StoreRelease(&slot->lock, lock + 1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    unsigned char* pixels =
+        reinterpret_cast<unsigned char*>(slot) + header_->pixels_offset;
+    std::vector<CefRect>::const_iterator it = rects.begin();
+    for (; it != rects.end(); ++it)
+        util::CopyRect(pixels, stride, source.data(), source.stride(), *it);
+
+    slot->sequence = sequence;
+    slot->timestamp = NowMicros();
+    slot->width = source.width();
+    slot->height = source.height();
+    slot->stride = stride;
+    if (damage.size() > static_cast<size_t>(kSharedFrameMaxRects)) {
+        // Report the bounding box of the damage.
+        int left = full.width, top = full.height, right = 0, bottom = 0;
+        for (it = damage.begin(); it != damage.end(); ++it) {
+            left = (std::min)(left, it->x);
+            top = (std::min)(top, it->y);
+            right = (std::max)(right, it->x + it->width);
+            bottom = (std::max)(bottom, it->y + it->height);
+        }
+        SharedFrameRect bounds = { left, top, right - left, bottom - top };
+        slot->rects[0] = bounds;
+        slot->rect_count = 1;
+    } else {
+        slot->rect_count = static_cast<uint32>(damage.size());
+        for (size_t i = 0; i < damage.size(); ++i) {
+            SharedFrameRect rect = { damage[i].x, damage[i].y,
+                                     damage[i].width, damage[i].height };
+            slot->rects[i] = rect;
+        }
+    }
+    slot_sequence_[index] = sequence;
+
+    StoreRelease(&slot->lock, lock + 2);
+    StoreRelease(&header_->latest_sequence, sequence);
+    Increment(&header_->doorbell);
+#if defined(__linux__)
+    syscall(SYS_futex, &header_->doorbell, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+    return true;
+}
+
+SharedFrameSlotHeader* SharedFrameWriter::GetSlot(uint32 index)
+{
+    return reinterpret_cast<SharedFrameSlotHeader*>(
+        reinterpret_cast<unsigned char*>(header_) +
+        AlignUp(sizeof(SharedFrameRingHeader)) +
+        static_cast<size_t>(header_->slot_size) * index);
+}
+
+SharedFrameReader::SharedFrameReader()
+    : header_(NULL),
+      mapping_size_(0)
+#if defined(OS_WIN)
+      , mapping_(NULL)
+#endif
+{
+}
+
+SharedFrameReader::~SharedFrameReader()
+{
+    Close();
+}
+
+bool SharedFrameReader::Open(const std::string& name)
+{
+    Close();
+    const void* memory = NULL;
+    size_t size = 0;
+#if defined(OS_WIN)
+    mapping_ = OpenFileMappingW(FILE_MAP_READ, FALSE,
+                                GetMappingName(name).c_str());
+    if (!mapping_)
+        return false;
+    memory = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info;
+    if (memory && VirtualQuery(memory, &info, sizeof(info)))
+        size = info.RegionSize;
+#else
+    int fd = shm_open(GetMappingName(name).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        size = static_cast<size_t>(st.st_size);
+        memory = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED)
+            memory = NULL;
+    }
+    close(fd);
+#endif
+    if (!memory)
+        return false;
+
+    header_ = static_cast<const SharedFrameRingHeader*>(memory);
+    mapping_size_ = size;
+    if (size < sizeof(SharedFrameRingHeader) ||
+        header_->magic != kSharedFrameMagic ||
+        header_->version != kSharedFrameVersion ||
+        size < AlignUp(sizeof(SharedFrameRingHeader)) +
+            static_cast<size_t>(header_->slot_size) * header_->slot_count) {
+        Close();
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
+
+void SharedFrameReader::Close()
+{
+    if (!header_)
+        return;
+#if defined(OS_WIN)
+    UnmapViewOfFile(header_);
+    CloseHandle(mapping_);
+    mapping_ = NULL;
+#else
+    munmap(const_cast<SharedFrameRingHeader*>(header_), mapping_size_);
+#endif
+    header_ = NULL;
+    mapping_size_ = 0;
+}
+
+bool SharedFrameReader::WaitForFrame(uint64 sequence, int timeout_ms)
+{
+    if (!header_)
+        return false;
+    const int64 deadline = NowMicros() + static_cast<int64>(timeout_ms) * 1000;
+    for (;;) {
+        int32 doorbell = header_->doorbell;
+        if (LoadAcquire(&header_->latest_sequence) > sequence)
+            return true;
+        int64 remaining = deadline - NowMicros();
+        if (remaining <= 0)
+            return false;
+#if defined(__linux__)
+        struct timespec timeout;
+        timeout.tv_sec = static_cast<time_t>(remaining / 1000000);
+        timeout.tv_nsec = static_cast<long>(remaining % 1000000) * 1000;
+        if (syscall(SYS_futex, &header_->doorbell, FUTEX_WAIT, doorbell,
+                    &timeout, NULL, 0) != 0 &&
+            errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+            // No futex on this mapping, fall back to polling.
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+#else
+        (void)doorbell;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+    }
+}
+
+bool SharedFrameReader::GetLatestFrame(SharedFrame& frame)
+{
+    if (!header_)
+        return false;
+    const uint64 sequence = LoadAcquire(&header_->latest_sequence);
+    if (sequence == 0)
+        return false;
+    const uint32 index = static_cast<uint32>(sequence % header_->slot_count);
+    const SharedFrameSlotHeader* slot = GetSlot(index);
+
+    const uint32 lock = LoadAcquire(&slot->lock);
+    if (lock & 1)
+        return false;
+    frame.sequence = slot->sequence;
+    frame.timestamp = slot->timestamp;
+    frame.width = slot->width;
+    frame.height = slot->height;
+    frame.stride = slot->stride;
+    frame.pixels = reinterpret_cast<const unsigned char*>(slot) +
+        header_->pixels_offset;
+    frame.lock = lock;
+    frame.slot = index;
+    const uint32 count =
+        (std::min)(slot->rect_count, static_cast<uint32>(kSharedFrameMaxRects));
+    frame.damage.resize(count);
+    for (uint32 i = 0; i < count; ++i) {
+        const SharedFrameRect& rect = slot->rects[i];
+        frame.damage[i].Set(rect.x, rect.y, rect.width, rect.height);
+    }
+    return frame.sequence == sequence && IsValid(frame);
+}
+
+bool SharedFrameReader::IsValid(const SharedFrame& frame) const
+{
+    if (!header_)
+        return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return GetSlot(frame.slot)->lock == frame.lock;
+}
+
+const SharedFrameSlotHeader* SharedFrameReader::GetSlot(uint32 index) const
+{
+    return reinterpret_cast<const SharedFrameSlotHeader*>(
+        reinterpret_cast<const unsigned char*>(header_) +
+        AlignUp(sizeof(SharedFrameRingHeader)) +
+        static_cast<size_t>(header_->slot_size) * index);
+}
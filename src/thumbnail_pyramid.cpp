@@ -0,0 +1,89 @@
+/**
+ * @file thumbnail_pyramid.cpp
+ *
+ * @breif Impl of thumbnail_pyramid.h
+ */
+#include "thumbnail_pyramid.h"
+
+#include <algorithm>
+
+#include "pixel_util.h"
+
+ThumbnailPyramid::ThumbnailPyramid(int levels)
+{
+    for (int i = 0; i < levels; ++i)
+        levels_.push_back(new OffScreenSurface());
+}
+
+ThumbnailPyramid::~ThumbnailPyramid()
+{
+    for (size_t i = 0; i < levels_.size(); ++i)
+        delete levels_[i];
+}
+
+void ThumbnailPyramid::Update(const OffScreenSurface& source,
+                              const std::vector<CefRect>& damage)
+{
+    if (source.IsEmpty())
+        return;
+
+    std::vector<CefRect> rects;
+    std::vector<CefRect>::const_iterator it = damage.begin();
+    for (; it != damage.end(); ++it) {
+        CefRect rect = *it;
+        if (util::ClipRect(rect, source.width(), source.height()))
+            rects.push_back(rect);
+    }
+
+    const OffScreenSurface* above = &source;
+    for (size_t i = 0; i < levels_.size(); ++i) {
+        OffScreenSurface& dest = *levels_[i];
+        if (dest.Resize((above->width() + 1) / 2, (above->height() + 1) / 2))
+            rects.assign(1, CefRect(0, 0, above->width(), above->height()));
+        if (dest.IsEmpty())
+            return;
+        // The reduced rects are the damage of the next level.
+        for (size_t r = 0; r < rects.size(); ++r)
+            rects[r] = ReduceRect(*above, dest, rects[r]);
+        above = &dest;
+    }
+}
+
+void ThumbnailPyramid::Release()
+{
+    for (size_t i = 0; i < levels_.size(); ++i)
+        levels_[i]->Release();
+}
+
+const OffScreenSurface& ThumbnailPyramid::GetLevelFor(int width,
+                                                      int height) const
+{
+    for (size_t i = levels_.size(); i > 0; --i) {
+        const OffScreenSurface& surface = *levels_[i - 1];
+        if (surface.width() >= width && surface.height() >= height)
+            return surface;
+    }
+    return *levels_[0];
+}
+
+// static
+CefRect ThumbnailPyramid::ReduceRect(const OffScreenSurface& source,
+                                     OffScreenSurface& dest,
+                                     const CefRect& rect)
+{
+    const int left = rect.x / 2;
+    const int top = rect.y / 2;
+    const int right =
+        (std::min)((rect.x + rect.width + 1) / 2, dest.width());
+    const int bottom =
+        (std::min)((rect.y + rect.height + 1) / 2, dest.height());
+    const int source_width = (std::min)(right * 2, source.width()) - left * 2;
+    for (int y = top; y < bottom; ++y) {
+        const void* row0 = source.pixel(left * 2, y * 2);
+        // An odd last row pairs with itself.
+        const void* row1 = y * 2 + 1 < source.height()
+            ? source.pixel(left * 2, y * 2 + 1) : row0;
+        util::ReduceRow2x2(dest.pixel(left, y), row0, row1, source_width);
+    }
+    return CefRect(left, top, right - left, bottom - top);
+}
@@ -0,0 +1,161 @@
+/**
+ * @file tile_hash_grid.cpp
+ *
+ * @breif Impl of tile_hash_grid.h
+ */
+#include "tile_hash_grid.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "pixel_util.h"
+
+namespace {
+
+const uint32 kPrime1 = 2654435761U;
+const uint32 kPrime2 = 2246822519U;
+const uint32 kPrime3 = 3266489917U;
+
+inline uint32 Rotl(uint32 value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+inline uint32 Round(uint32 acc, const unsigned char* input)
+{
+    uint32 word;
+    memcpy(&word, input, 4);
+    acc += word * kPrime2;
+    return Rotl(acc, 13) * kPrime1;
+}
+
+}  // namespace
+
+TileHashGrid::TileHashGrid(int tile_size)
+    : tile_size_((std::max)(tile_size, 4)),
+      width_(0),
+      height_(0),
+      columns_(0),
+      rows_(0)
+{
+}
+
+bool TileHashGrid::Update(const OffScreenSurface& surface,
+                          const std::vector<CefRect>& damage,
+                          std::vector<CefRect>& changed)
+{
+    changed.clear();
+    if (surface.IsEmpty())
+        return false;
+    if (surface.width() != width_ || surface.height() != height_) {
+        width_ = surface.width();
+        height_ = surface.height();
+        columns_ = (width_ + tile_size_ - 1) / tile_size_;
+        rows_ = (height_ + tile_size_ - 1) / tile_size_;
+        hashes_.assign(static_cast<size_t>(columns_) * rows_, 0);
+        known_.assign(hashes_.size(), 0);
+    }
+
+    // Hash every touched tile once, overlapping rects share tiles.
+    enum { kUntouched = 0, kSame, kChanged };
+    state_.assign(hashes_.size(), kUntouched);
+    std::vector<CefRect> rects;
+    std::vector<CefRect>::const_iterator it = damage.begin();
+    for (; it != damage.end(); ++it) {
+        CefRect rect = *it;
+        if (!util::ClipRect(rect, width_, height_))
+            continue;
+        rects.push_back(rect);
+        for (int row = rect.y / tile_size_;
+             row <= (rect.y + rect.height - 1) / tile_size_; ++row) {
+            for (int column = rect.x / tile_size_;
+                 column <= (rect.x + rect.width - 1) / tile_size_; ++column) {
+                const size_t index =
+                    static_cast<size_t>(row) * columns_ + column;
+                if (state_[index] != kUntouched)
+                    continue;
+                const uint32 hash = HashTile(surface, column, row);
+                if (known_[index] && hashes_[index] == hash) {
+                    state_[index] = kSame;
+                    continue;
+                }
+                hashes_[index] = hash;
+                known_[index] = 1;
+                state_[index] = kChanged;
+            }
+        }
+    }
+
+    for (it = rects.begin(); it != rects.end(); ++it) {
+        const CefRect& rect = *it;
+        // Bounding box of the changed tiles, in tiles.
+        int left = columns_, top = rows_, right = -1, bottom = -1;
+        for (int row = rect.y / tile_size_;
+             row <= (rect.y + rect.height - 1) / tile_size_; ++row) {
+            for (int column = rect.x / tile_size_;
+                 column <= (rect.x + rect.width - 1) / tile_size_; ++column) {
+                if (state_[static_cast<size_t>(row) * columns_ + column] !=
+                    kChanged) {
+                    continue;
+                }
+                left = (std::min)(left, column);
+                top = (std::min)(top, row);
+                right = (std::max)(right, column);
+                bottom = (std::max)(bottom, row);
+            }
+        }
+        if (right < 0)
+            continue;
+        CefRect tiles(left * tile_size_, top * tile_size_,
+                      (right - left + 1) * tile_size_,
+                      (bottom - top + 1) * tile_size_);
+        changed.push_back(util::IntersectRect(rect, tiles));
+    }
+    return !changed.empty();
+}
+
+void TileHashGrid::Reset()
+{
+    width_ = height_ = columns_ = rows_ = 0;
+    hashes_.clear();
+    known_.clear();
+    state_.clear();
+}
+
+uint32 TileHashGrid::HashTile(const OffScreenSurface& surface, int column,
+                              int row) const
+{
+    const int x = column * tile_size_;
+    const int y = row * tile_size_;
+    const int width = (std::min)(tile_size_, width_ - x);
+    const int height = (std::min)(tile_size_, height_ - y);
+    const size_t row_bytes = static_cast<size_t>(width) * util::kBytesPerPixel;
+
+    // Four independent lanes over 16-byte stripes, like xxHash32. Rows that
+    // are not a multiple of 16 bytes feed their tail words to the first lane.
+    uint32 v1 = kPrime1 + kPrime2;
+    uint32 v2 = kPrime2;
+    uint32 v3 = 0;
+    uint32 v4 = 0 - kPrime1;
+    for (int line = 0; line < height; ++line) {
+        const unsigned char* p =
+            static_cast<const unsigned char*>(surface.pixel(x, y + line));
+        size_t i = 0;
+        for (; i + 16 <= row_bytes; i += 16) {
+            v1 = Round(v1, p + i);
+            v2 = Round(v2, p + i + 4);
+            v3 = Round(v3, p + i + 8);
+            v4 = Round(v4, p + i + 12);
+        }
+        for (; i < row_bytes; i += 4)
+            v1 = Round(v1, p + i);
+    }
+    uint32 hash = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+    hash += static_cast<uint32>(row_bytes * height);
+    hash ^= hash >> 15;
+    hash *= kPrime2;
+    hash ^= hash >> 13;
+    hash *= kPrime3;
+    hash ^= hash >> 16;
+    return hash;
+}
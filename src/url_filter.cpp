@@ -0,0 +1,552 @@
+/**
+ * @file url_filter.cpp
+ *
+ * @breif Impl of url_filter.h
+ */
+#include "url_filter.h"
+
+#include <ctype.h>
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+namespace {
+
+inline unsigned char Lower(char c)
+{
+    return static_cast<unsigned char>(tolower(static_cast<unsigned char>(c)));
+}
+
+// Byte trie compiled into flat arrays. Edges of a node are stored sorted
+// and contiguous, so a node costs three ints plus its edges. With failure
+// links it doubles as an Aho-Corasick automaton.
+class Trie {
+public:
+    Trie() : build_(1) {}
+
+    // Node reached by |key|, added if missing. Build phase only.
+    int Insert(const std::string& key) {
+        int node = 0;
+        for (size_t i = 0; i < key.size(); ++i) {
+            std::map<unsigned char, int>::iterator it =
+                build_[node].find(key[i]);
+            if (it == build_[node].end()) {
+                build_.push_back(std::map<unsigned char, int>());
+                it = build_[node].insert(std::make_pair(
+                    static_cast<unsigned char>(key[i]),
+                    static_cast<int>(build_.size() - 1))).first;
+            }
+            node = it->second;
+        }
+        return node;
+    }
+
+    // Flatten the build tree. Insert must not be called afterwards.
+    void Compile() {
+        edge_begin_.assign(1, 0);
+        for (size_t node = 0; node < build_.size(); ++node) {
+            std::map<unsigned char, int>::const_iterator it =
+                build_[node].begin();
+            for (; it != build_[node].end(); ++it) {
+                edge_label_.push_back(it->first);
+                edge_target_.push_back(it->second);
+            }
+            edge_begin_.push_back(static_cast<int>(edge_label_.size()));
+        }
+        std::vector<std::map<unsigned char, int> >().swap(build_);
+    }
+
+    size_t size() const { return edge_begin_.size() - 1; }
+
+    // Child of |node| on |label|, -1 if none.
+    int Child(int node, unsigned char label) const {
+        const unsigned char* labels = edge_label_.data();
+        const unsigned char* begin = labels + edge_begin_[node];
+        const unsigned char* end = labels + edge_begin_[node + 1];
+        const unsigned char* it = std::lower_bound(begin, end, label);
+        if (it == end || *it != label)
+            return -1;
+        return edge_target_[it - labels];
+    }
+
+    // Children of |node| as [first, last) edge indexes.
+    int FirstEdge(int node) const { return edge_begin_[node]; }
+    int LastEdge(int node) const { return edge_begin_[node + 1]; }
+    unsigned char EdgeLabel(int edge) const { return edge_label_[edge]; }
+    int EdgeTarget(int edge) const { return edge_target_[edge]; }
+
+private:
+    std::vector<std::map<unsigned char, int> > build_;
+    std::vector<int> edge_begin_;
+    std::vector<unsigned char> edge_label_;
+    std::vector<int> edge_target_;
+};
+
+// Progress of the wildcard patterns during one lookup. Patterns waiting for
+// the same segment are chained through |next|.
+struct PatternProgress {
+    int matched;
+    size_t end;
+    int next;
+};
+struct SegmentProgress {
+    // Lookup the fields below belong to, older values are stale.
+    uint64 lookup;
+    // True once the patterns starting with the segment were started.
+    bool started;
+    // First pattern waiting for the segment, -1 if none.
+    int waiting;
+};
+// Kept per thread and grown to the largest rule set seen, so that lookups
+// do not allocate.
+struct MatchScratch {
+    MatchScratch() : lookup(0) {}
+    uint64 lookup;
+    std::vector<PatternProgress> patterns;
+    std::vector<SegmentProgress> segments;
+};
+
+// Host part of |url| as [begin, end), without user info and port.
+void FindHost(const std::string& url, size_t& begin, size_t& end)
+{
+    const size_t scheme = url.find("://");
+    begin = scheme == std::string::npos ? 0 : scheme + 3;
+    end = url.find_first_of("/?#", begin);
+    if (end == std::string::npos)
+        end = url.size();
+    const size_t at = url.rfind('@', end);
+    if (at != std::string::npos && at >= begin)
+        begin = at + 1;
+    const size_t colon = url.find(':', begin);
+    if (colon != std::string::npos && colon < end)
+        end = colon;
+}
+
+}  // namespace
+
+class UrlFilter::RuleSet : public CefBase {
+public:
+    explicit RuleSet(const std::vector<std::string>& lines);
+
+    size_t size() const { return rules_.size(); }
+    int Match(const std::string& url) const;
+    void GetHits(std::vector<RuleHits>& hits) const;
+
+private:
+    // A wildcard rule: literal segments that must appear in order.
+    struct Pattern {
+        int rule;
+        // Ids of its segments start at |pattern_segments_[first_segment]|.
+        int first_segment;
+        int segment_count;
+        bool anchor_start;
+        bool anchor_end;
+    };
+
+    bool AddRule(const std::string& line);
+    void BuildFailureLinks();
+    int MatchHost(const std::string& url) const;
+    int MatchPrefix(const std::string& url) const;
+    int MatchPatterns(const std::string& url) const;
+    // Move pattern |pattern| past its next segment, found at [start, end)
+    // of a URL of |size| bytes, or keep it waiting for a later occurrence.
+    void Advance(int pattern, int segment, size_t start, size_t end,
+                 size_t size, int& best, MatchScratch& scratch) const;
+
+    std::vector<std::string> rules_;
+    std::unique_ptr<std::atomic<uint64>[]> hits_;
+
+    // Reversed host names, rule index per node.
+    Trie hosts_;
+    std::vector<int> host_rule_;
+    // URL prefixes, rule index per node.
+    Trie prefixes_;
+    std::vector<int> prefix_rule_;
+
+    // Aho-Corasick automaton over the pattern segments.
+    Trie segments_;
+    std::vector<Pattern> patterns_;
+    // Per node: failure link, segment ending here, next node on the failure
+    // chain that ends a segment.
+    std::vector<int> fail_;
+    std::vector<int> node_segment_;
+    std::vector<int> dict_link_;
+    std::vector<size_t> segment_length_;
+    // Segment ids of every pattern, see Pattern::first_segment.
+    std::vector<int> pattern_segments_;
+    // Per segment: the patterns starting with it, in rule order.
+    std::vector<std::vector<int> > segment_starts_;
+
+    IMPLEMENT_REFCOUNTING(RuleSet);
+};
+
+UrlFilter::RuleSet::RuleSet(const std::vector<std::string>& lines)
+{
+    std::vector<std::pair<int, std::string> > host_keys;
+    std::vector<std::pair<int, std::string> > prefix_keys;
+    std::vector<std::vector<std::string> > pattern_segments;
+    std::unordered_map<std::string, int> segment_ids;
+
+    for (size_t i = 0; i < lines.size(); ++i) {
+        std::string rule = lines[i];
+        const size_t first = rule.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos)
+            continue;
+        rule = rule.substr(first, rule.find_last_not_of(" \t\r\n") - first + 1);
+        if (rule[0] == '!' || rule[0] == '#')
+            continue;
+        std::string lower(rule.size(), '\0');
+        std::transform(rule.begin(), rule.end(), lower.begin(), Lower);
+        const int index = static_cast<int>(rules_.size());
+
+        if (lower.compare(0, 2, "||") == 0) {
+            std::string host = lower.substr(2);
+            if (!host.empty() && host[host.size() - 1] == '^')
+                host.erase(host.size() - 1);
+            if (host.empty() ||
+                host.find_first_of("/*|^:") != std::string::npos) {
+                continue;
+            }
+            host_keys.push_back(std::make_pair(
+                index, std::string(host.rbegin(), host.rend())));
+        } else if (lower[0] == '|' && lower.find('*') == std::string::npos &&
+                   lower[lower.size() - 1] != '|') {
+            if (lower.size() == 1)
+                continue;
+            prefix_keys.push_back(std::make_pair(index, lower.substr(1)));
+        } else {
+            Pattern pattern;
+            pattern.rule = index;
+            pattern.anchor_start = lower[0] == '|';
+            pattern.anchor_end = lower.size() > 1 &&
+                lower[lower.size() - 1] == '|';
+            const std::string body = lower.substr(
+                pattern.anchor_start ? 1 : 0,
+                lower.size() - pattern.anchor_start - pattern.anchor_end);
+            std::vector<std::string> segments;
+            size_t begin = 0;
+            while (begin <= body.size()) {
+                size_t end = body.find('*', begin);
+                if (end == std::string::npos)
+                    end = body.size();
+                if (end > begin)
+                    segments.push_back(body.substr(begin, end - begin));
+                begin = end + 1;
+            }
+            // A leading or trailing '*' lifts the anchor next to it.
+            if (!body.empty() && body[0] == '*')
+                pattern.anchor_start = false;
+            if (!body.empty() && body[body.size() - 1] == '*')
+                pattern.anchor_end = false;
+            if (segments.empty())
+                continue;
+            pattern.segment_count = static_cast<int>(segments.size());
+            patterns_.push_back(pattern);
+            pattern_segments.push_back(segments);
+        }
+        rules_.push_back(rule);
+    }
+
+    hits_.reset(new std::atomic<uint64>[rules_.size()]);
+    for (size_t i = 0; i < rules_.size(); ++i)
+        hits_[i].store(0, std::memory_order_relaxed);
+
+    for (size_t i = 0; i < host_keys.size(); ++i) {
+        const int node = hosts_.Insert(host_keys[i].second);
+        if (host_rule_.size() <= static_cast<size_t>(node))
+            host_rule_.resize(node + 1, -1);
+        if (host_rule_[node] < 0)
+            host_rule_[node] = host_keys[i].first;
+    }
+    hosts_.Compile();
+    host_rule_.resize(hosts_.size(), -1);
+
+    for (size_t i = 0; i < prefix_keys.size(); ++i) {
+        const int node = prefixes_.Insert(prefix_keys[i].second);
+        if (prefix_rule_.size() <= static_cast<size_t>(node))
+            prefix_rule_.resize(node + 1, -1);
+        if (prefix_rule_[node] < 0)
+            prefix_rule_[node] = prefix_keys[i].first;
+    }
+    prefixes_.Compile();
+    prefix_rule_.resize(prefixes_.size(), -1);
+
+    for (size_t p = 0; p < pattern_segments.size(); ++p) {
+        patterns_[p].first_segment =
+            static_cast<int>(pattern_segments_.size());
+        for (size_t s = 0; s < pattern_segments[p].size(); ++s) {
+            const std::string& text = pattern_segments[p][s];
+            std::pair<std::unordered_map<std::string, int>::iterator, bool>
+                inserted = segment_ids.insert(std::make_pair(
+                    text, static_cast<int>(segment_length_.size())));
+            if (inserted.second) {
+                const int node = segments_.Insert(text);
+                if (node_segment_.size() <= static_cast<size_t>(node))
+                    node_segment_.resize(node + 1, -1);
+                node_segment_[node] = inserted.first->second;
+                segment_length_.push_back(text.size());
+                segment_starts_.push_back(std::vector<int>());
+            }
+            pattern_segments_.push_back(inserted.first->second);
+            if (s == 0) {
+                segment_starts_[inserted.first->second].push_back(
+                    static_cast<int>(p));
+            }
+        }
+    }
+    segments_.Compile();
+    node_segment_.resize(segments_.size(), -1);
+    BuildFailureLinks();
+}
+
+void UrlFilter::RuleSet::BuildFailureLinks()
+{
+    fail_.assign(segments_.size(), 0);
+    dict_link_.assign(segments_.size(), -1);
+    std::deque<int> queue;
+    for (int e = segments_.FirstEdge(0); e < segments_.LastEdge(0); ++e)
+        queue.push_back(segments_.EdgeTarget(e));
+    while (!queue.empty()) {
+        const int node = queue.front();
+        queue.pop_front();
+        for (int e = segments_.FirstEdge(node); e < segments_.LastEdge(node);
+             ++e) {
+            const int child = segments_.EdgeTarget(e);
+            const unsigned char label = segments_.EdgeLabel(e);
+            int fallback = fail_[node];
+            int next = segments_.Child(fallback, label);
+            while (next < 0 && fallback != 0) {
+                fallback = fail_[fallback];
+                next = segments_.Child(fallback, label);
+            }
+            fail_[child] = next >= 0 && next != child ? next : 0;
+            dict_link_[child] = node_segment_[fail_[child]] >= 0 ?
+                fail_[child] : dict_link_[fail_[child]];
+            queue.push_back(child);
+        }
+    }
+}
+
+int UrlFilter::RuleSet::Match(const std::string& url) const
+{
+    int best = -1;
+    int rule = MatchHost(url);
+    if (rule >= 0)
+        best = rule;
+    rule = MatchPrefix(url);
+    if (rule >= 0 && (best < 0 || rule < best))
+        best = rule;
+    rule = MatchPatterns(url);
+    if (rule >= 0 && (best < 0 || rule < best))
+        best = rule;
+    if (best >= 0)
+        hits_[best].fetch_add(1, std::memory_order_relaxed);
+    return best;
+}
+
+int UrlFilter::RuleSet::MatchHost(const std::string& url) const
+{
+    if (hosts_.size() <= 1)
+        return -1;
+    size_t begin, end;
+    FindHost(url, begin, end);
+    int best = -1;
+    int node = 0;
+    // Walk the host from its last character; a rule matches when its name
+    // ends at a label boundary.
+    for (size_t i = end; i > begin; --i) {
+        node = hosts_.Child(node, Lower(url[i - 1]));
+        if (node < 0)
+            break;
+        const int rule = host_rule_[node];
+        if (rule >= 0 && (i - 1 == begin || url[i - 2] == '.') &&
+            (best < 0 || rule < best)) {
+            best = rule;
+        }
+    }
+    return best;
+}
+
+int UrlFilter::RuleSet::MatchPrefix(const std::string& url) const
+{
+    int best = -1;
+    int node = 0;
+    for (size_t i = 0; i < url.size() && prefixes_.size() > 1; ++i) {
+        node = prefixes_.Child(node, Lower(url[i]));
+        if (node < 0)
+            break;
+        const int rule = prefix_rule_[node];
+        if (rule >= 0 && (best < 0 || rule < best))
+            best = rule;
+    }
+    return best;
+}
+
+int UrlFilter::RuleSet::MatchPatterns(const std::string& url) const
+{
+    if (patterns_.empty())
+        return -1;
+    static thread_local MatchScratch scratch;
+    const uint64 lookup = ++scratch.lookup;
+    if (scratch.patterns.size() < patterns_.size())
+        scratch.patterns.resize(patterns_.size());
+    if (scratch.segments.size() < segment_length_.size()) {
+        SegmentProgress none = { 0, false, -1 };
+        scratch.segments.resize(segment_length_.size(), none);
+    }
+
+    int best = -1;
+    int node = 0;
+    for (size_t i = 0; i < url.size(); ++i) {
+        const unsigned char c = Lower(url[i]);
+        int next = segments_.Child(node, c);
+        while (next < 0 && node != 0) {
+            node = fail_[node];
+            next = segments_.Child(node, c);
+        }
+        node = next < 0 ? 0 : next;
+
+        // Every segment ending at |i|, longest first. Taking the earliest
+        // occurrence of each segment in turn finds any in-order match, so
+        // only the patterns waiting for a segment are looked at, and those
+        // starting with it on its first occurrence only.
+        for (int out = node_segment_[node] >= 0 ? node : dict_link_[node];
+             out >= 0; out = dict_link_[out]) {
+            const int segment = node_segment_[out];
+            const size_t start = i + 1 - segment_length_[segment];
+            SegmentProgress& state = scratch.segments[segment];
+            if (state.lookup != lookup) {
+                state.lookup = lookup;
+                state.started = false;
+                state.waiting = -1;
+            }
+            int waiting = state.waiting;
+            state.waiting = -1;
+            if (!state.started) {
+                state.started = true;
+                const std::vector<int>& starts = segment_starts_[segment];
+                for (size_t s = 0; s < starts.size(); ++s) {
+                    // In rule order, nothing after can win any more.
+                    if (best >= 0 && patterns_[starts[s]].rule >= best)
+                        break;
+                    scratch.patterns[starts[s]].matched = 0;
+                    Advance(starts[s], segment, start, i + 1, url.size(),
+                            best, scratch);
+                }
+            }
+            while (waiting >= 0) {
+                const int pattern = waiting;
+                waiting = scratch.patterns[pattern].next;
+                Advance(pattern, segment, start, i + 1, url.size(), best,
+                        scratch);
+            }
+        }
+    }
+    return best;
+}
+
+void UrlFilter::RuleSet::Advance(int pattern, int segment, size_t start,
+                                 size_t end, size_t size, int& best,
+                                 MatchScratch& scratch) const
+{
+    const Pattern& rule = patterns_[pattern];
+    if (best >= 0 && rule.rule >= best)
+        return;
+    PatternProgress& state = scratch.patterns[pattern];
+    // Later occurrences start later still.
+    if (state.matched == 0 && rule.anchor_start && start != 0)
+        return;
+    const bool last = state.matched + 1 == rule.segment_count;
+    if ((state.matched > 0 && start < state.end) ||
+        (last && rule.anchor_end && end != size)) {
+        // Overlaps the previous segment, or does not end the URL.
+        SegmentProgress& waiting = scratch.segments[segment];
+        state.next = waiting.waiting;
+        waiting.waiting = pattern;
+        return;
+    }
+    state.matched++;
+    state.end = end;
+    if (last) {
+        best = rule.rule;
+        return;
+    }
+    // Wait for the next segment, which may be this one again.
+    const int next = pattern_segments_[rule.first_segment + state.matched];
+    SegmentProgress& waiting = scratch.segments[next];
+    if (waiting.lookup != scratch.lookup) {
+        waiting.lookup = scratch.lookup;
+        waiting.started = false;
+        waiting.waiting = -1;
+    }
+    state.next = waiting.waiting;
+    waiting.waiting = pattern;
+}
+
+void UrlFilter::RuleSet::GetHits(std::vector<RuleHits>& hits) const
+{
+    hits.resize(rules_.size());
+    for (size_t i = 0; i < rules_.size(); ++i) {
+        hits[i].rule = rules_[i];
+        hits[i].hits = hits_[i].load(std::memory_order_relaxed);
+    }
+}
+
+UrlFilter::UrlFilter()
+    : rules_(new RuleSet(std::vector<std::string>())),
+      lookups_(0),
+      blocked_(0)
+{
+}
+
+UrlFilter::~UrlFilter()
+{
+}
+
+size_t UrlFilter::Load(const std::vector<std::string>& rules)
+{
+    // Compile outside the lock, lookups go on with the old set meanwhile.
+    CefRefPtr<RuleSet> compiled = new RuleSet(rules);
+    AutoLock lock_scope(this);
+    rules_ = compiled;
+    return compiled->size();
+}
+
+bool UrlFilter::LoadFile(const std::string& path)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+        return false;
+    std::vector<std::string> rules;
+    std::string line;
+    while (std::getline(file, line))
+        rules.push_back(line);
+    Load(rules);
+    return true;
+}
+
+int UrlFilter::Match(const std::string& url)
+{
+    lookups_.fetch_add(1, std::memory_order_relaxed);
+    const int rule = GetRuleSet()->Match(url);
+    if (rule >= 0)
+        blocked_.fetch_add(1, std::memory_order_relaxed);
+    return rule;
+}
+
+std::vector<UrlFilter::RuleHits> UrlFilter::GetHits()
+{
+    std::vector<RuleHits> hits;
+    GetRuleSet()->GetHits(hits);
+    return hits;
+}
+
+CefRefPtr<UrlFilter::RuleSet> UrlFilter::GetRuleSet()
+{
+    AutoLock lock_scope(this);
+    return rules_;
+}
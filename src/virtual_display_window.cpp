@@ -0,0 +1,82 @@
+/**
+ * @file virtual_display_window.cpp
+ *
+ * @breif Impl of virtual_display_window.h
+ */
+#include "virtual_display_window.h"
+
+#include <algorithm>
+
+VirtualDisplayWindow::VirtualDisplayWindow(int width, int height,
+                                           float device_scale_factor)
+    : x_(0),
+      y_(0),
+      width_((std::max)(width, 1)),
+      height_((std::max)(height, 1)),
+      screen_width_(kDefaultScreenWidth),
+      screen_height_(kDefaultScreenHeight),
+      device_scale_factor_(device_scale_factor > 0 ? device_scale_factor
+                                                   : 1.0f),
+      shown_(true),
+      cursor_(NULL)
+{
+}
+
+void VirtualDisplayWindow::SetSize(int width, int height)
+{
+    width_ = (std::max)(width, 1);
+    height_ = (std::max)(height, 1);
+}
+
+void VirtualDisplayWindow::SetPosition(int x, int y)
+{
+    x_ = x;
+    y_ = y;
+}
+
+void VirtualDisplayWindow::SetScreenSize(int width, int height)
+{
+    screen_width_ = (std::max)(width, 1);
+    screen_height_ = (std::max)(height, 1);
+}
+
+void VirtualDisplayWindow::SetDeviceScaleFactor(float device_scale_factor)
+{
+    if (device_scale_factor > 0)
+        device_scale_factor_ = device_scale_factor;
+}
+
+void VirtualDisplayWindow::GetRootScreenRect(CefRect& rect)
+{
+    rect.Set(x_, y_, width_, height_);
+}
+
+void VirtualDisplayWindow::GetViewRect(CefRect& rect)
+{
+    rect.Set(0, 0, width_, height_);
+}
+
+void VirtualDisplayWindow::GetScreenPoint(int viewX, int viewY, int& screenX,
+                                          int& screenY)
+{
+    // Device independent pixels, like the root rect and the screen info.
+    screenX = x_ + viewX;
+    screenY = y_ + viewY;
+}
+
+void VirtualDisplayWindow::SetCursor(CefCursorHandle cursor)
+{
+    cursor_ = cursor;
+}
+
+bool VirtualDisplayWindow::GetScreenInfo(CefScreenInfo& screen_info)
+{
+    screen_info.device_scale_factor = device_scale_factor_;
+    screen_info.depth = 24;
+    screen_info.depth_per_component = 8;
+    screen_info.is_monochrome = false;
+    CefRect screen(0, 0, screen_width_, screen_height_);
+    screen_info.rect = screen;
+    screen_info.available_rect = screen;
+    return true;
+}
@@ -0,0 +1,265 @@
+/**
+ * @file asset_load_bench.cpp
+ *
+ * @breif Load time of bundled files from an archive versus loose files
+ *
+ * Usage: asset_load_bench <directory> <archive> [rounds]
+ *
+ * <archive> is the output of pack_assets for <directory>. Every file is
+ * loaded |rounds| times both ways: looked up in the mapped archive as the
+ * app:// handler does, and opened and read from <directory> as file:// does.
+ * The network stack both go through afterwards is left out. Run it once
+ * after dropping the page cache for cold numbers.
+ *
+ * Every file is first served once through the app:// handler, to a request
+ * accepting gzip and brotli, and checked to come back as the bytes of the
+ * loose file, with no Content-Encoding.
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <include/cef_response.h>
+
+#include "asset_archive.h"
+#include "asset_archive_format.h"
+
+namespace {
+
+int64 NowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Names of the identity entries of |path|, read from its index.
+bool ReadNames(const std::string& path, std::vector<std::string>& names)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    asset_archive::Header header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+        memcmp(header.magic, asset_archive::kMagic,
+               sizeof(asset_archive::kMagic)) == 0;
+    std::vector<asset_archive::Entry> entries(ok ? header.entry_count : 0);
+    std::vector<char> buffer(ok ? static_cast<size_t>(header.names_size) : 0);
+    ok = ok &&
+        fseek(file, static_cast<long>(header.index_offset), SEEK_SET) == 0 &&
+        fread(entries.data(), sizeof(asset_archive::Entry), entries.size(),
+              file) == entries.size() &&
+        fseek(file, static_cast<long>(header.names_offset), SEEK_SET) == 0 &&
+        fread(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    fclose(file);
+    if (!ok)
+        return false;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const asset_archive::Entry& entry = entries[i];
+        if (entry.encoding != asset_archive::ENCODING_IDENTITY ||
+            static_cast<uint64>(entry.name_offset) + entry.name_length >
+                buffer.size()) {
+            continue;
+        }
+        names.push_back(std::string(buffer.data() + entry.name_offset,
+                                    entry.name_length));
+    }
+    return true;
+}
+
+uint64 Checksum(const unsigned char* data, size_t size)
+{
+    uint64 sum = 0;
+    for (size_t i = 0; i < size; ++i)
+        sum += data[i];
+    return sum;
+}
+
+// Load |name| as the file:// handler does: open, read it whole, close.
+bool LoadFile(const std::string& path, std::vector<unsigned char>& buffer,
+              uint64& checksum)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    buffer.clear();
+    unsigned char chunk[65536];
+    size_t count;
+    while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        buffer.insert(buffer.end(), chunk, chunk + count);
+    fclose(file);
+    checksum = buffer.empty() ? 0 : Checksum(&buffer[0], buffer.size());
+    return true;
+}
+
+// The handler answers synchronously, nothing to wait for.
+class NullCallback : public CefCallback {
+public:
+    virtual void Continue() OVERRIDE {}
+    virtual void Cancel() OVERRIDE {}
+
+    IMPLEMENT_REFCOUNTING(NullCallback);
+};
+
+// GET app://bench/<name> through the handler of |archive| into |body|.
+// Returns false unless it is answered with 200 and no Content-Encoding.
+bool Serve(CefRefPtr<AssetArchive> archive, const std::string& name,
+           std::vector<unsigned char>& body)
+{
+    std::string url = std::string(AssetArchive::kScheme) + "://bench/";
+    for (size_t i = 0; i < name.size(); ++i) {
+        const unsigned char c = static_cast<unsigned char>(name[i]);
+        if (isalnum(c) || strchr("/-._~", c)) {
+            url += name[i];
+        } else {
+            char escaped[4];
+            snprintf(escaped, sizeof(escaped), "%%%02X", c);
+            url += escaped;
+        }
+    }
+    CefRefPtr<CefRequest> request = CefRequest::Create();
+    request->SetURL(url);
+    request->SetMethod("GET");
+    CefRequest::HeaderMap headers;
+    headers.insert(std::make_pair("Accept-Encoding", "gzip, deflate, br"));
+    request->SetHeaderMap(headers);
+
+    CefRefPtr<CefResourceHandler> handler =
+        archive->CreateResourceHandler(request);
+    CefRefPtr<CefCallback> callback = new NullCallback();
+    if (!handler.get() || !handler->ProcessRequest(request, callback))
+        return false;
+    CefRefPtr<CefResponse> response = CefResponse::Create();
+    int64 length = 0;
+    CefString redirect_url;
+    handler->GetResponseHeaders(response, length, redirect_url);
+    if (response->GetStatus() != 200 ||
+        !response->GetHeader("Content-Encoding").empty()) {
+        return false;
+    }
+    body.clear();
+    unsigned char chunk[65536];
+    int count = 0;
+    while (handler->ReadResponse(chunk, sizeof(chunk), count, callback) &&
+           count > 0) {
+        body.insert(body.end(), chunk, chunk + count);
+    }
+    return static_cast<int64>(body.size()) == length;
+}
+
+struct Result {
+    Result() : total_us(0), bytes(0), checksum(0) {}
+    int64 total_us;
+    uint64 bytes;
+    uint64 checksum;
+    std::vector<int64> latencies;
+};
+
+int64 Percentile(std::vector<int64>& values, int percent)
+{
+    if (values.empty())
+        return 0;
+    const size_t index = (values.size() - 1) * percent / 100;
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+void Print(const char* label, Result& result)
+{
+    printf("%-8s %8.1f ms, %8.1f MB/s, per file p50 %lld us, p99 %lld us\n",
+           label, result.total_us / 1000.0,
+           result.bytes / static_cast<double>((std::max)(result.total_us,
+                                                         int64(1))),
+           static_cast<long long>(Percentile(result.latencies, 50)),
+           static_cast<long long>(Percentile(result.latencies, 99)));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "usage: %s <directory> <archive> [rounds]\n",
+                argv[0]);
+        return 2;
+    }
+    const std::string root = argv[1];
+    const int rounds = argc == 4 ? (std::max)(atoi(argv[3]), 1) : 10;
+
+    std::vector<std::string> names;
+    if (!ReadNames(argv[2], names) || names.empty()) {
+        fprintf(stderr, "cannot read the index of %s\n", argv[2]);
+        return 1;
+    }
+
+    int64 start = NowMicros();
+    CefRefPtr<AssetArchive> archive = new AssetArchive();
+    if (!archive->Open(argv[2])) {
+        fprintf(stderr, "cannot open %s\n", argv[2]);
+        return 1;
+    }
+    const int64 open_us = NowMicros() - start;
+
+    std::vector<unsigned char> buffer;
+    std::vector<unsigned char> served;
+    for (size_t i = 0; i < names.size(); ++i) {
+        uint64 checksum;
+        if (!LoadFile(root + "/" + names[i], buffer, checksum)) {
+            fprintf(stderr, "cannot read %s/%s\n", root.c_str(),
+                    names[i].c_str());
+            return 1;
+        }
+        if (!Serve(archive, names[i], served) || served != buffer) {
+            fprintf(stderr, "app:// does not serve %s as it is\n",
+                    names[i].c_str());
+            return 1;
+        }
+    }
+
+    Result mapped, loose;
+    for (int round = 0; round < rounds; ++round) {
+        for (size_t i = 0; i < names.size(); ++i) {
+            start = NowMicros();
+            AssetArchive::File file;
+            if (!archive->Find(names[i], file)) {
+                fprintf(stderr, "%s is not in the archive\n",
+                        names[i].c_str());
+                return 1;
+            }
+            mapped.checksum += Checksum(file.data, file.size);
+            int64 elapsed = NowMicros() - start;
+            mapped.total_us += elapsed;
+            mapped.bytes += file.size;
+            mapped.latencies.push_back(elapsed);
+
+            start = NowMicros();
+            uint64 checksum;
+            if (!LoadFile(root + "/" + names[i], buffer, checksum)) {
+                fprintf(stderr, "cannot read %s/%s\n", root.c_str(),
+                        names[i].c_str());
+                return 1;
+            }
+            loose.checksum += checksum;
+            elapsed = NowMicros() - start;
+            loose.total_us += elapsed;
+            loose.bytes += buffer.size();
+            loose.latencies.push_back(elapsed);
+        }
+    }
+
+    printf("%u files, %d rounds, archive opened in %lld us\n",
+           static_cast<unsigned>(names.size()), rounds,
+           static_cast<long long>(open_us));
+    Print("app://", mapped);
+    Print("file://", loose);
+    if (mapped.checksum != loose.checksum) {
+        fprintf(stderr, "the archive does not match %s\n", root.c_str());
+        return 1;
+    }
+    return 0;
+}
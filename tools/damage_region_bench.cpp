@@ -0,0 +1,314 @@
+/**
+ * @file damage_region_bench.cpp
+ *
+ * @breif Dirty rects of OnPaint coalesced by DamageRegion against raw
+ *
+ * Usage: damage_region_bench [trace...]
+ *
+ * Replays dirty-rect traces frame by frame, both ways: the rects of each
+ * paint clipped and copied as they come, as the paint path did before, and
+ * coalesced by DamageRegion first. For each trace it prints the rects per
+ * frame, the overdraw, i.e. the pixels copied beyond the dirty ones, and the
+ * time per frame to coalesce and copy them into a frame buffer.
+ *
+ * A trace has one paint per line: the view width and height followed by
+ * x y width height of each dirty rect, as OnPaint gets them. Lines starting
+ * with # are skipped. Without traces, replays built-in ones of typing,
+ * scrolling, a spinner and a page load.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "damage_region.h"
+
+namespace {
+
+int64 NowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Paint {
+    int width;
+    int height;
+    std::vector<CefRect> rects;
+};
+
+struct Trace {
+    std::string name;
+    std::vector<Paint> paints;
+};
+
+bool ReadTrace(const char* path, Trace& trace)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    trace.name = path;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        Paint paint;
+        if (!(fields >> paint.width >> paint.height) || paint.width <= 0 ||
+            paint.height <= 0) {
+            return false;
+        }
+        CefRect rect;
+        while (fields >> rect.x >> rect.y >> rect.width >> rect.height)
+            paint.rects.push_back(rect);
+        if (!fields.eof())
+            return false;
+        trace.paints.push_back(paint);
+    }
+    return !trace.paints.empty();
+}
+
+const int kViewWidth = 1280;
+const int kViewHeight = 720;
+const int kFrames = 600;
+
+Paint NewPaint()
+{
+    Paint paint;
+    paint.width = kViewWidth;
+    paint.height = kViewHeight;
+    return paint;
+}
+
+// A glyph and the caret after it per keystroke, the line repainted on wraps.
+Trace Typing()
+{
+    Trace trace;
+    trace.name = "typing";
+    int x = 40;
+    int y = 100;
+    for (int i = 0; i < kFrames; ++i) {
+        Paint paint = NewPaint();
+        paint.rects.push_back(CefRect(x, y, 9, 18));
+        paint.rects.push_back(CefRect(x + 8, y, 2, 18));
+        x += 8;
+        if (x > 1200) {
+            paint.rects.push_back(CefRect(40, y, 1170, 20));
+            x = 40;
+            y = y + 20 > 660 ? 100 : y + 20;
+        }
+        trace.paints.push_back(paint);
+    }
+    return trace;
+}
+
+// The exposed strip, the scrollbar over it and a sticky header.
+Trace Scrolling()
+{
+    Trace trace;
+    trace.name = "scroll";
+    for (int i = 0; i < kFrames; ++i) {
+        Paint paint = NewPaint();
+        const int thumb = 60 + i % 500;
+        paint.rects.push_back(CefRect(0, kViewHeight - 48, kViewWidth - 15,
+                                      48));
+        paint.rects.push_back(CefRect(kViewWidth - 15, 0, 15, kViewHeight));
+        paint.rects.push_back(CefRect(kViewWidth - 13, thumb, 11, 120));
+        paint.rects.push_back(CefRect(0, 0, kViewWidth - 15, 64));
+        trace.paints.push_back(paint);
+    }
+    return trace;
+}
+
+// Overlapping dots of a spinner and a progress bar.
+Trace Spinner()
+{
+    Trace trace;
+    trace.name = "spinner";
+    for (int i = 0; i < kFrames; ++i) {
+        Paint paint = NewPaint();
+        static const int kDots[8][2] = {
+            {0, -20}, {14, -14}, {20, 0}, {14, 14},
+            {0, 20}, {-14, 14}, {-20, 0}, {-14, -14},
+        };
+        for (int dot = 0; dot < 3; ++dot) {
+            const int* offset = kDots[(i + dot) % 8];
+            paint.rects.push_back(CefRect(633 + offset[0], 353 + offset[1],
+                                          14, 14));
+        }
+        paint.rects.push_back(CefRect(440, 400, 2 + i % 400, 6));
+        trace.paints.push_back(paint);
+    }
+    return trace;
+}
+
+// Text blocks and images scattered over the page as it lays out.
+Trace PageLoad()
+{
+    Trace trace;
+    trace.name = "load";
+    std::mt19937 random(1);
+    for (int i = 0; i < kFrames; ++i) {
+        Paint paint = NewPaint();
+        const int count = 4 + static_cast<int>(random() % 40);
+        for (int j = 0; j < count; ++j) {
+            const int width = 16 + static_cast<int>(random() % 300);
+            const int height = 12 + static_cast<int>(random() % 120);
+            paint.rects.push_back(CefRect(
+                static_cast<int>(random() % (kViewWidth - 16)),
+                static_cast<int>(random() % (kViewHeight - 12)),
+                width, height));
+        }
+        trace.paints.push_back(paint);
+    }
+    return trace;
+}
+
+bool Clip(CefRect& rect, int width, int height)
+{
+    const int left = (std::max)(rect.x, 0);
+    const int top = (std::max)(rect.y, 0);
+    const int right = (std::min)(rect.x + rect.width, width);
+    const int bottom = (std::min)(rect.y + rect.height, height);
+    if (right <= left || bottom <= top)
+        return false;
+    rect.Set(left, top, right - left, bottom - top);
+    return true;
+}
+
+// Copies |rects| of |src| into |dst|, both BGRA of |width| pixels a row.
+// Returns the pixels copied.
+int64 Copy(const std::vector<CefRect>& rects, const std::vector<char>& src,
+           std::vector<char>& dst, int width)
+{
+    int64 pixels = 0;
+    std::vector<CefRect>::const_iterator it = rects.begin();
+    for (; it != rects.end(); ++it) {
+        for (int y = it->y; y < it->y + it->height; ++y) {
+            const size_t offset = (static_cast<size_t>(y) * width + it->x) * 4;
+            memcpy(&dst[offset], &src[offset], it->width * 4);
+        }
+        pixels += static_cast<int64>(it->width) * it->height;
+    }
+    return pixels;
+}
+
+struct Result {
+    Result() : rects(0), copied(0), best_us(0) {}
+    int64 rects;
+    int64 copied;
+    int64 best_us;
+};
+
+// Replays |trace| |rounds| times, coalesced through DamageRegion or not.
+Result Replay(const Trace& trace, bool coalesce, int rounds)
+{
+    Result result;
+    std::vector<char> src;
+    std::vector<char> dst;
+    std::vector<CefRect> damage;
+    DamageRegion region;
+    for (int round = 0; round < rounds; ++round) {
+        int64 rects = 0;
+        int64 copied = 0;
+        const int64 start = NowMicros();
+        for (size_t i = 0; i < trace.paints.size(); ++i) {
+            const Paint& paint = trace.paints[i];
+            const size_t size = static_cast<size_t>(paint.width) *
+                paint.height * 4;
+            if (src.size() != size) {
+                src.assign(size, 1);
+                dst.assign(size, 0);
+            }
+            if (coalesce) {
+                region.SetBounds(paint.width, paint.height);
+                region.Clear();
+                region.Add(paint.rects);
+                damage = region.rects();
+            } else {
+                damage.clear();
+                for (size_t j = 0; j < paint.rects.size(); ++j) {
+                    CefRect rect = paint.rects[j];
+                    if (Clip(rect, paint.width, paint.height))
+                        damage.push_back(rect);
+                }
+            }
+            rects += damage.size();
+            copied += Copy(damage, src, dst, paint.width);
+        }
+        const int64 elapsed = NowMicros() - start;
+        if (round == 0 || elapsed < result.best_us)
+            result.best_us = elapsed;
+        result.rects = rects;
+        result.copied = copied;
+    }
+    return result;
+}
+
+// Pixels that are dirty in |trace|, overlaps counted once.
+int64 DirtyArea(const Trace& trace)
+{
+    int64 area = 0;
+    for (size_t i = 0; i < trace.paints.size(); ++i) {
+        const Paint& paint = trace.paints[i];
+        std::vector<CefRect> rects;
+        for (size_t j = 0; j < paint.rects.size(); ++j) {
+            CefRect rect = paint.rects[j];
+            if (Clip(rect, paint.width, paint.height))
+                rects.push_back(rect);
+        }
+        area += DamageRegion::CoveredArea(rects);
+    }
+    return area;
+}
+
+void Print(const char* label, const Result& result, const Trace& trace,
+           int64 dirty)
+{
+    const double frames = static_cast<double>(trace.paints.size());
+    printf("  %-9s %7.1f rects/frame, overdraw %6.1f%%, %8.2f us/frame\n",
+           label, result.rects / frames,
+           dirty ? (result.copied - dirty) * 100.0 / dirty : 0.0,
+           result.best_us / frames);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    std::vector<Trace> traces;
+    for (int i = 1; i < argc; ++i) {
+        Trace trace;
+        if (!ReadTrace(argv[i], trace)) {
+            fprintf(stderr, "cannot read trace %s\n", argv[i]);
+            fprintf(stderr, "usage: %s [trace...]\n", argv[0]);
+            return 2;
+        }
+        traces.push_back(trace);
+    }
+    if (traces.empty()) {
+        traces.push_back(Typing());
+        traces.push_back(Scrolling());
+        traces.push_back(Spinner());
+        traces.push_back(PageLoad());
+    }
+
+    const int rounds = 5;
+    for (size_t i = 0; i < traces.size(); ++i) {
+        const Trace& trace = traces[i];
+        const int64 dirty = DirtyArea(trace);
+        printf("%s: %u frames, %.0f dirty pixels/frame\n", trace.name.c_str(),
+               static_cast<unsigned>(trace.paints.size()),
+               static_cast<double>(dirty) / trace.paints.size());
+        Print("raw", Replay(trace, false, rounds), trace, dirty);
+        Print("coalesced", Replay(trace, true, rounds), trace, dirty);
+    }
+    return 0;
+}
@@ -0,0 +1,270 @@
+/**
+ * @file emit_batch_bench.cpp
+ *
+ * @breif platform.emit from a page to the browser process, batched or not
+ *
+ * Usage: emit_batch_bench [events per_task]
+ *
+ * Loads a page in a hidden offscreen browser that emits |events| events,
+ * |per_task| of them per task, first one process message per emit, then
+ * with platform.setBatching(true). Each event carries the time it was
+ * emitted, so the browser process measures how many arrive per second and
+ * how long they took to arrive. Needs the CEF runtime next to the binary,
+ * which also runs as the renderer process.
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <include/cef_app.h>
+#include <include/cef_browser.h>
+
+#include "client_app.h"
+#include "client_handler_impl.h"
+#include "client_renderer.h"
+
+namespace {
+
+const char kEvent[] = "emit_batch_bench";
+const char kDoneEvent[] = "emit_batch_bench_done";
+
+// The page clock, milliseconds since the epoch.
+double NowMillis()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() /
+        1000.0;
+}
+
+double Percentile(std::vector<double>& values, int percent)
+{
+    if (values.empty())
+        return 0;
+    const size_t index = (values.size() - 1) * percent / 100;
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+double GetNumber(CefRefPtr<CefListValue> list, int index)
+{
+    if (list->GetType(index) == VTYPE_INT)
+        return list->GetInt(index);
+    return list->GetType(index) == VTYPE_DOUBLE ? list->GetDouble(index) : 0;
+}
+
+// Events of one run, mode 0 unbatched and 1 batched.
+struct Run {
+    Run() : first_sent(0), last_received(0), done(false) {}
+    double first_sent;
+    double last_received;
+    std::vector<double> latencies;
+    bool done;
+};
+
+class BenchDelegate : public ClientHandlerImpl::MessageDelegate {
+public:
+    BenchDelegate()
+        : event_message_(client_renderer::GenPlatformMsg(kEvent)),
+          done_message_(client_renderer::GenPlatformMsg(kDoneEvent)) {}
+
+    virtual bool OnProcessMessageReceived(
+        CefRefPtr<CefBrowser> browser,
+        CefProcessId source_process,
+        CefRefPtr<CefProcessMessage> message) OVERRIDE
+    {
+        // emit(kEvent, mode, index, sent) and emit(kDoneEvent, mode)
+        const std::string name = message->GetName();
+        CefRefPtr<CefListValue> args = message->GetArgumentList();
+        if (name == event_message_ && args->GetSize() == 4) {
+            const double now = NowMillis();
+            Run& run = runs_[GetNumber(args, 1) != 0];
+            const double sent = GetNumber(args, 3);
+            if (run.latencies.empty())
+                run.first_sent = sent;
+            run.last_received = now;
+            run.latencies.push_back(now - sent);
+            return true;
+        }
+        if (name == done_message_ && args->GetSize() == 2) {
+            runs_[GetNumber(args, 1) != 0].done = true;
+            return true;
+        }
+        return false;
+    }
+
+    bool done() const { return runs_[0].done && runs_[1].done; }
+    Run& run(int mode) { return runs_[mode]; }
+
+private:
+    const std::string event_message_;
+    const std::string done_message_;
+    Run runs_[2];
+
+    IMPLEMENT_REFCOUNTING(BenchDelegate);
+};
+
+// Paints nowhere, the page only needs a size.
+class NullRenderHandler : public ClientHandlerImpl::RenderHandler {
+public:
+    virtual bool GetViewRect(CefRefPtr<CefBrowser> browser,
+                             CefRect& rect) OVERRIDE
+    {
+        rect.Set(0, 0, 640, 480);
+        return true;
+    }
+    virtual void OnPaint(CefRefPtr<CefBrowser> browser,
+                         PaintElementType type,
+                         const RectList& dirtyRects,
+                         const void* buffer,
+                         int width,
+                         int height) OVERRIDE {}
+    virtual void OnBeforeClose(CefRefPtr<CefBrowser> browser) OVERRIDE {}
+
+    IMPLEMENT_REFCOUNTING(NullRenderHandler);
+};
+
+CefRefPtr<ClientHandlerImpl> g_handler;
+
+std::string MakePageURL(int events, int per_task)
+{
+    char script[2048];
+    snprintf(script, sizeof(script),
+             "<script>"
+             "function now() {"
+             "  return performance.timing.navigationStart + performance.now();"
+             "}"
+             "function run(mode, next) {"
+             "  platform.setBatching(mode == 1, 0);"
+             "  var sent = 0;"
+             "  function step() {"
+             "    for (var i = 0; i < %d && sent < %d; ++i, ++sent)"
+             "      platform.emit('%s', mode, sent, now());"
+             "    if (sent < %d) {"
+             "      setTimeout(step, 0);"
+             "      return;"
+             "    }"
+             "    platform.emit('%s', mode);"
+             "    platform.flush();"
+             "    setTimeout(next, 500);"
+             "  }"
+             "  setTimeout(step, 500);"
+             "}"
+             "run(0, function() { run(1, function() {}); });"
+             "</script>",
+             per_task, events, kEvent, events, kDoneEvent);
+    std::string url = "data:text/html,";
+    for (const char* c = script; *c; ++c) {
+        if (isalnum(static_cast<unsigned char>(*c))) {
+            url += *c;
+        } else {
+            char escaped[4];
+            snprintf(escaped, sizeof(escaped), "%%%02X",
+                     static_cast<unsigned char>(*c));
+            url += escaped;
+        }
+    }
+    return url;
+}
+
+void Print(const char* label, Run& run)
+{
+    const double elapsed =
+        (std::max)(run.last_received - run.first_sent, 0.001);
+    printf("%-10s %6u events, %9.0f events/s, latency p50 %.2f ms, "
+           "p99 %.2f ms\n",
+           label, static_cast<unsigned>(run.latencies.size()),
+           run.latencies.size() * 1000.0 / elapsed,
+           Percentile(run.latencies, 50), Percentile(run.latencies, 99));
+}
+
+// Pump the UI thread until |done| returns true. Returns false on timeout.
+template <typename Done>
+bool RunUntil(Done done, int timeout_s)
+{
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(timeout_s);
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        CefDoMessageLoopWork();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+}  // namespace
+
+// Asked by ClientApp for the load and view handlers of the client.
+CefRefPtr<ClientHandler> GetClientHandler()
+{
+    return g_handler.get();
+}
+
+int main(int argc, char* argv[])
+{
+#if defined(OS_WIN)
+    CefMainArgs main_args(GetModuleHandle(NULL));
+#else
+    CefMainArgs main_args(argc, argv);
+#endif
+    CefRefPtr<ClientApp> app(new ClientApp);
+    const int exit_code = CefExecuteProcess(main_args, app.get(), NULL);
+    if (exit_code >= 0)
+        return exit_code;
+
+    if (argc != 1 && argc != 3) {
+        fprintf(stderr, "usage: %s [events per_task]\n", argv[0]);
+        return 2;
+    }
+    const int events = argc == 3 ? atoi(argv[1]) : 20000;
+    const int per_task = argc == 3 ? atoi(argv[2]) : 100;
+    if (events <= 0 || per_task <= 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    CefSettings settings;
+    settings.no_sandbox = true;
+    if (!CefInitialize(main_args, settings, app.get(), NULL)) {
+        fprintf(stderr, "cannot initialize CEF\n");
+        return 1;
+    }
+
+    CefRefPtr<BenchDelegate> delegate = new BenchDelegate();
+    g_handler = new ClientHandlerImpl();
+    g_handler->SetOSRHandler(new NullRenderHandler());
+    ClientHandlerImpl::MessageDelegateSet delegates;
+    delegates.insert(delegate.get());
+    g_handler->SetMessageDelegates(delegates);
+
+    CefWindowInfo window_info;
+    window_info.SetAsOffScreen(NULL);
+    CefBrowserSettings browser_settings;
+    CefBrowserHost::CreateBrowser(window_info, g_handler.get(),
+                                  MakePageURL(events, per_task),
+                                  browser_settings, NULL);
+    const bool finished = RunUntil([&]() { return delegate->done(); }, 120);
+
+    g_handler->CloseAllBrowsers(true);
+    RunUntil([]() { return ClientHandlerImpl::GetTotalBrowserCount() == 0; },
+             10);
+    g_handler = NULL;
+    CefShutdown();
+
+    if (!finished) {
+        fprintf(stderr, "timed out, %u and %u events received\n",
+                static_cast<unsigned>(delegate->run(0).latencies.size()),
+                static_cast<unsigned>(delegate->run(1).latencies.size()));
+        return 1;
+    }
+    printf("%d events, %d per task\n", events, per_task);
+    Print("unbatched", delegate->run(0));
+    Print("batched", delegate->run(1));
+    return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file frame_ring_bench.cpp
+ *
+ * @breif Throughput of the shared-memory frame ring, writer to reader
+ *
+ * Usage: frame_ring_bench [width height frames damage_percent]
+ *
+ * A writer publishes |frames| frames as fast as it can, each with a damaged
+ * band of |damage_percent| of the rows, while a reader maps the ring
+ * read-only, waits on the doorbell and checksums the damage of every frame it
+ * gets in place. Needs no window and no browser, so it runs headless.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "offscreen_surface.h"
+#include "pixel_util.h"
+#include "shared_frame_ring.h"
+
+namespace {
+
+int64 NowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct ReaderStats {
+    ReaderStats() : frames(0), torn(0), checksum(0) {}
+    uint64 frames;
+    uint64 torn;
+    uint64 checksum;
+    // Publish to read latencies in microseconds.
+    std::vector<int64> latencies;
+};
+
+void RunReader(const std::string& name, const std::atomic<bool>* done,
+               ReaderStats* stats)
+{
+    SharedFrameReader reader;
+    while (!reader.Open(name)) {
+        if (done->load())
+            return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    uint64 last = 0;
+    SharedFrame frame;
+    while (!done->load()) {
+        if (!reader.WaitForFrame(last, 100))
+            continue;
+        if (!reader.GetLatestFrame(frame))
+            continue;
+        const int64 latency = NowMicros() - frame.timestamp;
+        // Read the damage in place, as a compositor uploading it would.
+        uint64 sum = 0;
+        for (size_t i = 0; i < frame.damage.size(); ++i) {
+            const CefRect& rect = frame.damage[i];
+            for (int y = rect.y; y < rect.y + rect.height; ++y) {
+                const uint32* row = reinterpret_cast<const uint32*>(
+                    static_cast<const unsigned char*>(frame.pixels) +
+                    static_cast<size_t>(y) * frame.stride);
+                for (int x = rect.x; x < rect.x + rect.width; ++x)
+                    sum += row[x];
+            }
+        }
+        if (!reader.IsValid(frame)) {
+            ++stats->torn;
+            continue;
+        }
+        last = frame.sequence;
+        ++stats->frames;
+        stats->checksum += sum;
+        stats->latencies.push_back(latency);
+    }
+}
+
+int64 Percentile(std::vector<int64>& values, int percent)
+{
+    if (values.empty())
+        return 0;
+    const size_t index = (values.size() - 1) * percent / 100;
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc != 1 && argc != 5) {
+        fprintf(stderr,
+                "usage: %s [width height frames damage_percent]\n", argv[0]);
+        return 2;
+    }
+    const int width = argc == 5 ? atoi(argv[1]) : 1920;
+    const int height = argc == 5 ? atoi(argv[2]) : 1080;
+    const int frames = argc == 5 ? atoi(argv[3]) : 2000;
+    const int damage_percent = argc == 5 ? atoi(argv[4]) : 10;
+    if (width <= 0 || height <= 0 || frames <= 0 || damage_percent <= 0 ||
+        damage_percent > 100) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "frame_ring_bench_%lld",
+             static_cast<long long>(NowMicros()));
+    SharedFrameWriter writer;
+    if (!writer.Create(name, width, height)) {
+        fprintf(stderr, "cannot create the ring %s\n", name);
+        return 1;
+    }
+    OffScreenSurface surface;
+    surface.Resize(width, height);
+    memset(surface.data(), 0, surface.size());
+
+    std::atomic<bool> done(false);
+    ReaderStats stats;
+    std::thread reader(&RunReader, std::string(name), &done, &stats);
+
+    // A band of rows moving down the surface, like a scrolling page.
+    const int band = (std::max)(1, height * damage_percent / 100);
+    std::vector<CefRect> damage(1);
+    uint64 bytes = 0;
+    const int64 start = NowMicros();
+    for (int i = 0; i < frames; ++i) {
+        const int top = (i * band) % height;
+        damage[0].Set(0, top, width, (std::min)(band, height - top));
+        for (int y = damage[0].y; y < damage[0].y + damage[0].height; ++y) {
+            memset(surface.pixel(0, y), i & 0xff,
+                   static_cast<size_t>(width) * util::kBytesPerPixel);
+        }
+        if (!writer.Publish(surface, damage)) {
+            fprintf(stderr, "publish failed\n");
+            break;
+        }
+        bytes += static_cast<uint64>(damage[0].width) * damage[0].height *
+            util::kBytesPerPixel;
+    }
+    const int64 elapsed = (std::max)(NowMicros() - start, int64(1));
+    // Let the reader catch the last frame.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    done.store(true);
+    reader.join();
+    writer.Close();
+
+    printf("%dx%d, %d frames, %d%% damage\n", width, height, frames,
+           damage_percent);
+    printf("writer: %.0f frames/s, %.1f MB/s of damage\n",
+           frames * 1e6 / elapsed, bytes / static_cast<double>(elapsed));
+    printf("reader: %llu frames read, %llu torn, %llu skipped\n",
+           static_cast<unsigned long long>(stats.frames),
+           static_cast<unsigned long long>(stats.torn),
+           static_cast<unsigned long long>(
+               frames > static_cast<int>(stats.frames) ?
+                   frames - stats.frames : 0));
+    printf("latency: p50 %lld us, p99 %lld us\n",
+           static_cast<long long>(Percentile(stats.latencies, 50)),
+           static_cast<long long>(Percentile(stats.latencies, 99)));
+    return stats.frames > 0 ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+/**
+ * @file pack_assets.cpp
+ *
+ * @breif Pack a directory into an archive served by AssetArchive
+ *
+ * Usage: pack_assets <directory> <archive>
+ *
+ * Every file becomes an entry named by its path relative to <directory>.
+ * Files are stored as they are, "x.gz" included: app:// responses cannot
+ * be content-coded, so no compressed variants are made.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#if defined(OS_WIN)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "asset_archive_format.h"
+
+namespace {
+
+struct Input {
+    std::string name;
+    std::string path;
+    asset_archive::Encoding encoding;
+
+    bool operator<(const Input& other) const {
+        if (name != other.name)
+            return name < other.name;
+        return encoding < other.encoding;
+    }
+};
+
+// Append the files below |dir| to |files|, named relative to the root.
+bool ListFiles(const std::string& dir, const std::string& prefix,
+               std::vector<std::string>& files)
+{
+#if defined(OS_WIN)
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE)
+        return false;
+    do {
+        const std::string name = data.cFileName;
+        if (name == "." || name == "..")
+            continue;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if (!ListFiles(dir + "\\" + name, prefix + name + "/", files)) {
+                FindClose(find);
+                return false;
+            }
+        } else {
+            files.push_back(prefix + name);
+        }
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR* handle = opendir(dir.c_str());
+    if (!handle)
+        return false;
+    while (struct dirent* item = readdir(handle)) {
+        const std::string name = item->d_name;
+        if (name == "." || name == "..")
+            continue;
+        const std::string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode)) {
+            if (!ListFiles(path, prefix + name + "/", files)) {
+                closedir(handle);
+                return false;
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            files.push_back(prefix + name);
+        }
+    }
+    closedir(handle);
+#endif
+    return true;
+}
+
+bool ReadFile(const std::string& path, std::vector<char>& data)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    data.clear();
+    char buffer[65536];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.insert(data.end(), buffer, buffer + count);
+    const bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+bool Pad(FILE* file, uint64_t& offset, uint64_t alignment)
+{
+    static const char zeros[16] = { 0 };
+    const uint64_t padding = (alignment - offset % alignment) % alignment;
+    offset += padding;
+    return fwrite(zeros, 1, static_cast<size_t>(padding), file) == padding;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <directory> <archive>\n", argv[0]);
+        return 2;
+    }
+    const std::string root = argv[1];
+
+    std::vector<std::string> files;
+    if (!ListFiles(root, std::string(), files)) {
+        fprintf(stderr, "cannot list %s\n", root.c_str());
+        return 1;
+    }
+    std::vector<Input> inputs;
+    for (size_t i = 0; i < files.size(); ++i) {
+        Input input;
+        input.name = files[i];
+        input.path = root + "/" + files[i];
+        input.encoding = asset_archive::ENCODING_IDENTITY;
+        inputs.push_back(input);
+    }
+    std::sort(inputs.begin(), inputs.end());
+
+    FILE* out = fopen(argv[2], "wb");
+    if (!out) {
+        fprintf(stderr, "cannot create %s\n", argv[2]);
+        return 1;
+    }
+    asset_archive::Header header;
+    memset(&header, 0, sizeof(header));
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    uint64_t offset = sizeof(header);
+
+    std::vector<asset_archive::Entry> entries;
+    std::string names_blob;
+    std::vector<char> data;
+    for (size_t i = 0; ok && i < inputs.size(); ++i) {
+        if (!ReadFile(inputs[i].path, data)) {
+            fprintf(stderr, "cannot read %s\n", inputs[i].path.c_str());
+            ok = false;
+            break;
+        }
+        ok = Pad(out, offset, asset_archive::kDataAlignment);
+        asset_archive::Entry entry;
+        memset(&entry, 0, sizeof(entry));
+        // Variants share the name of their file.
+        if (i == 0 || inputs[i].name != inputs[i - 1].name) {
+            entry.name_offset = static_cast<uint32_t>(names_blob.size());
+            names_blob += inputs[i].name;
+        } else {
+            entry.name_offset = entries.back().name_offset;
+        }
+        entry.name_length = static_cast<uint32_t>(inputs[i].name.size());
+        entry.data_offset = offset;
+        entry.data_size = data.size();
+        entry.hash = asset_archive::Hash(data.data(), data.size());
+        entry.encoding = inputs[i].encoding;
+        entries.push_back(entry);
+        if (!data.empty())
+            ok = ok && fwrite(data.data(), 1, data.size(), out) == data.size();
+        offset += data.size();
+    }
+
+    ok = ok && Pad(out, offset, 8);
+    header.index_offset = offset;
+    if (ok && !entries.empty()) {
+        ok = fwrite(entries.data(), sizeof(asset_archive::Entry),
+                    entries.size(), out) == entries.size();
+    }
+    offset += entries.size() * sizeof(asset_archive::Entry);
+    header.names_offset = offset;
+    header.names_size = names_blob.size();
+    if (ok && !names_blob.empty())
+        ok = fwrite(names_blob.data(), 1, names_blob.size(), out) ==
+            names_blob.size();
+
+    memcpy(header.magic, asset_archive::kMagic, sizeof(header.magic));
+    header.version = asset_archive::kVersion;
+    header.entry_count = static_cast<uint32_t>(entries.size());
+    ok = ok && fseek(out, 0, SEEK_SET) == 0 &&
+        fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = fclose(out) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "cannot write %s\n", argv[2]);
+        remove(argv[2]);
+        return 1;
+    }
+    printf("%u entries, %llu bytes\n", header.entry_count,
+           static_cast<unsigned long long>(offset + names_blob.size()));
+    return 0;
+}
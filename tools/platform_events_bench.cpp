@@ -0,0 +1,141 @@
+/**
+ * @file platform_events_bench.cpp
+ *
+ * @breif Dispatch cost of platform messages to their bindings
+ *
+ * Usage: platform_events_bench [events browsers lookups]
+ *
+ * Binds |events| events in each of |browsers| browsers, then dispatches
+ * |lookups| incoming platform messages in a random order, both ways: the
+ * message name matched in PlatformEventTable and the binding found in
+ * PlatformBindingMap, as the renderer does, and the event name cut out of
+ * the message name and looked up in a std::map keyed by name and browser,
+ * as it did before. Runs no browser and no V8, only CEF strings.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "client_renderer.h"
+#include "platform_events.h"
+
+namespace {
+
+int64 NowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Message {
+    CefString name;
+    int browser_id;
+};
+
+// Nanoseconds per message of |dispatch| over |messages|, the best of
+// |rounds|. |sum| collects the bound values so that nothing is left out.
+template <typename Dispatch>
+double Measure(const std::vector<Message>& messages, int rounds,
+               Dispatch dispatch, uint64& sum)
+{
+    double best = 0;
+    for (int round = 0; round < rounds; ++round) {
+        const int64 start = NowMicros();
+        for (size_t i = 0; i < messages.size(); ++i)
+            sum += dispatch(messages[i]);
+        const double elapsed = (NowMicros() - start) * 1000.0 /
+            messages.size();
+        if (round == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc != 1 && argc != 4) {
+        fprintf(stderr, "usage: %s [events browsers lookups]\n", argv[0]);
+        return 2;
+    }
+    const int events = argc == 4 ? atoi(argv[1]) : 200;
+    const int browsers = argc == 4 ? atoi(argv[2]) : 8;
+    const int lookups = argc == 4 ? atoi(argv[3]) : 1000000;
+    if (events <= 0 || browsers <= 0 || lookups <= 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    std::vector<std::string> names;
+    for (int i = 0; i < events; ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "app.state.event%d", i);
+        names.push_back(name);
+    }
+
+    PlatformEventTable table;
+    PlatformBindingMap<int> bindings;
+    std::map<std::pair<std::string, int>, int> by_name;
+    int64 start = NowMicros();
+    for (int i = 0; i < events; ++i) {
+        const PlatformEventId event = table.Intern(names[i]);
+        for (int browser_id = 1; browser_id <= browsers; ++browser_id)
+            bindings.Insert(event, browser_id) = i;
+    }
+    const int64 intern_us = NowMicros() - start;
+    for (int i = 0; i < events; ++i) {
+        for (int browser_id = 1; browser_id <= browsers; ++browser_id)
+            by_name[std::make_pair(names[i], browser_id)] = i;
+    }
+
+    // Messages as they come in, in a random order.
+    std::mt19937 random(1);
+    std::vector<Message> messages(lookups);
+    for (int i = 0; i < lookups; ++i) {
+        const int event = static_cast<int>(random() % events);
+        messages[i].name = client_renderer::GenPlatformMsg(names[event]);
+        messages[i].browser_id = 1 + static_cast<int>(random() % browsers);
+    }
+
+    const size_t prefix_length =
+        std::string(client_renderer::kPlatformMessage).size() + 1;
+    const int rounds = 5;
+    uint64 interned_sum = 0;
+    const double interned_ns = Measure(
+        messages, rounds,
+        [&](const Message& message) {
+            const PlatformEventId event = table.FindMessage(message.name);
+            const int* value = bindings.Find(event, message.browser_id);
+            return value ? *value : 0;
+        },
+        interned_sum);
+    uint64 by_name_sum = 0;
+    const double by_name_ns = Measure(
+        messages, rounds,
+        [&](const Message& message) {
+            const std::string name = message.name.ToString();
+            std::map<std::pair<std::string, int>, int>::const_iterator it =
+                by_name.find(std::make_pair(name.substr(prefix_length),
+                                            message.browser_id));
+            return it != by_name.end() ? it->second : 0;
+        },
+        by_name_sum);
+
+    printf("%d events, %d browsers, interned in %lld us\n", events, browsers,
+           static_cast<long long>(intern_us));
+    printf("interned  %8.1f ns per message\n", interned_ns);
+    printf("by name   %8.1f ns per message\n", by_name_ns);
+    if (interned_sum != by_name_sum) {
+        fprintf(stderr, "the lookups disagree\n");
+        return 1;
+    }
+    return 0;
+}
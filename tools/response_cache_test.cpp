@@ -0,0 +1,514 @@
+/**
+ * @file response_cache_test.cpp
+ *
+ * @breif ResponseCache against a loopback HTTP server
+ *
+ * Usage: response_cache_test
+ *
+ * Serves a few resources on 127.0.0.1 and fetches them through the cache
+ * the way the resource loader drives a CefResourceHandler. Checks misses,
+ * memory and disk hits, revalidation with 304, Vary, that private and
+ * credentialed responses are not kept, and eviction down to the disk
+ * budget, against the requests the server saw. CEF runs in single process
+ * mode without a browser, so it runs headless. Returns 0 when every check
+ * passes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#if defined(OS_WIN)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+typedef SOCKET Socket;
+#define closesocket_ closesocket
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int Socket;
+const Socket INVALID_SOCKET = -1;
+#define closesocket_ close
+#endif
+
+#include <include/cef_app.h>
+#include <include/cef_response.h>
+#include <include/cef_runnable.h>
+#include <include/cef_task.h>
+
+#include "response_cache.h"
+
+namespace {
+
+int64 NowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// HTTP/1.1 server on a loopback port, one request per connection.
+//
+//   /fresh    fresh for a minute
+//   /stale    must be revalidated, answers 304 to its ETag
+//   /vary     varies on Accept-Language, which it echoes
+//   /private  fresh for a minute, but private
+//   /big/<n>  fresh for a minute, 4 KB of its own
+class LoopbackServer {
+public:
+    LoopbackServer() : socket_(INVALID_SOCKET), port_(0), stopped_(false) {}
+
+    bool Start()
+    {
+        socket_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (socket_ == INVALID_SOCKET)
+            return false;
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (bind(socket_, reinterpret_cast<sockaddr*>(&address),
+                 sizeof(address)) != 0 ||
+            listen(socket_, 16) != 0 ||
+            getsockname(socket_, reinterpret_cast<sockaddr*>(&address),
+                        &length) != 0) {
+            return false;
+        }
+        port_ = ntohs(address.sin_port);
+        thread_ = std::thread(&LoopbackServer::Run, this);
+        return true;
+    }
+
+    void Stop()
+    {
+        if (!thread_.joinable())
+            return;
+        stopped_.store(true);
+        // Wake up accept with a connection of our own.
+        Socket wake = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<unsigned short>(port_));
+        connect(wake, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        thread_.join();
+        closesocket_(wake);
+        closesocket_(socket_);
+    }
+
+    std::string GetURL(const std::string& path) const
+    {
+        char url[64];
+        snprintf(url, sizeof(url), "http://127.0.0.1:%d", port_);
+        return url + path;
+    }
+
+    // Requests of |path| received, and those answered with 304.
+    int GetCount(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        return counts_[path];
+    }
+    int GetNotModifiedCount()
+    {
+        return GetCount("304");
+    }
+
+private:
+    void Run()
+    {
+        while (!stopped_.load()) {
+            Socket client = accept(socket_, NULL, NULL);
+            if (client == INVALID_SOCKET)
+                continue;
+            if (!stopped_.load())
+                Serve(client);
+            closesocket_(client);
+        }
+    }
+
+    void Serve(Socket client)
+    {
+        std::string request;
+        char buffer[4096];
+        while (request.find("\r\n\r\n") == std::string::npos) {
+            const int count = recv(client, buffer, sizeof(buffer), 0);
+            if (count <= 0)
+                return;
+            request.append(buffer, count);
+        }
+        const size_t path_begin = request.find(' ') + 1;
+        const std::string path =
+            request.substr(path_begin, request.find(' ', path_begin) -
+                                           path_begin);
+
+        std::string status = "200 OK";
+        std::string headers;
+        std::string body;
+        if (path == "/fresh") {
+            headers = "Cache-Control: max-age=60\r\nETag: \"f1\"\r\n";
+            body = "fresh";
+        } else if (path == "/stale") {
+            headers = "Cache-Control: no-cache\r\nETag: \"s1\"\r\n";
+            if (GetHeader(request, "If-None-Match") == "\"s1\"")
+                status = "304 Not Modified";
+            else
+                body = "stale";
+        } else if (path == "/vary") {
+            headers = "Cache-Control: max-age=60\r\n"
+                "Vary: Accept-Language\r\n";
+            body = "lang=" + GetHeader(request, "Accept-Language");
+        } else if (path == "/private") {
+            headers = "Cache-Control: private, max-age=60\r\n";
+            body = "private";
+        } else if (path.compare(0, 5, "/big/") == 0) {
+            headers = "Cache-Control: max-age=60\r\n";
+            body = path + std::string(4096, '.');
+        } else {
+            status = "404 Not Found";
+        }
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            counts_[path]++;
+            if (status[0] == '3')
+                counts_["304"]++;
+        }
+
+        char length[64];
+        snprintf(length, sizeof(length), "Content-Length: %u\r\n",
+                 static_cast<unsigned>(body.size()));
+        const std::string response = "HTTP/1.1 " + status + "\r\n" +
+            "Content-Type: text/plain\r\n" + headers + length +
+            "Connection: close\r\n\r\n" + body;
+        send(client, response.data(), static_cast<int>(response.size()), 0);
+    }
+
+    // Value of the request header |name|, matched as sent by Chromium.
+    static std::string GetHeader(const std::string& request,
+                                 const std::string& name)
+    {
+        const size_t begin = request.find("\r\n" + name + ": ");
+        if (begin == std::string::npos)
+            return std::string();
+        const size_t value = begin + name.size() + 4;
+        return request.substr(value, request.find("\r\n", value) - value);
+    }
+
+    Socket socket_;
+    int port_;
+    std::atomic<bool> stopped_;
+    std::thread thread_;
+    std::mutex lock_;
+    std::map<std::string, int> counts_;
+};
+
+// One request through a cache handler, driven on the IO thread as the
+// resource loader does: ProcessRequest, then the headers and the body once
+// the handler continues.
+class Fetch : public CefCallback {
+public:
+    Fetch(CefRefPtr<ResponseCache> cache, CefRefPtr<CefRequest> request)
+        : cache_(cache),
+          request_(request),
+          bypassed_(false),
+          headers_read_(false),
+          status_(0),
+          done_(false) {}
+
+    void Start()
+    {
+        handler_ = cache_->CreateResourceHandler(request_);
+        if (!handler_.get()) {
+            bypassed_ = true;
+            done_.store(true);
+        } else if (!handler_->ProcessRequest(request_, this)) {
+            handler_ = NULL;
+            done_.store(true);
+        }
+    }
+
+    virtual void Continue() OVERRIDE
+    {
+        CefPostTask(TID_IO, NewCefRunnableMethod(this, &Fetch::Read));
+    }
+
+    virtual void Cancel() OVERRIDE
+    {
+        done_.store(true);
+    }
+
+    const std::atomic<bool>& done() const { return done_; }
+    bool bypassed() const { return bypassed_; }
+    int status() const { return status_; }
+    const std::string& body() const { return body_; }
+
+private:
+    void Read()
+    {
+        if (!headers_read_) {
+            headers_read_ = true;
+            CefRefPtr<CefResponse> response = CefResponse::Create();
+            int64 length = 0;
+            CefString redirect;
+            handler_->GetResponseHeaders(response, length, redirect);
+            status_ = response->GetStatus();
+        }
+        for (;;) {
+            char buffer[4096];
+            int count = 0;
+            if (!handler_->ReadResponse(buffer, sizeof(buffer), count, this)) {
+                handler_ = NULL;
+                done_.store(true);
+                return;
+            }
+            // Zero bytes: the handler continues once it has more.
+            if (count == 0)
+                return;
+            body_.append(buffer, count);
+        }
+    }
+
+    CefRefPtr<ResponseCache> cache_;
+    CefRefPtr<CefRequest> request_;
+    CefRefPtr<CefResourceHandler> handler_;
+    bool bypassed_;
+    bool headers_read_;
+    int status_;
+    std::string body_;
+    std::atomic<bool> done_;
+
+    IMPLEMENT_REFCOUNTING(Fetch);
+};
+
+void Signal(std::atomic<bool>* flag)
+{
+    flag->store(true);
+}
+
+// Pump the UI thread until |flag| is set. Returns false on timeout.
+bool WaitFor(const std::atomic<bool>& flag)
+{
+    const int64 deadline = NowMicros() + 10 * 1000 * 1000;
+    while (!flag.load()) {
+        if (NowMicros() > deadline)
+            return false;
+        CefDoMessageLoopWork();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+struct Result {
+    Result() : bypassed(false), status(0) {}
+    bool bypassed;
+    int status;
+    std::string body;
+};
+
+// GET |url| through |cache|, with a header |name| set to |value| if given.
+// Waits for what the cache stores on the FILE thread too, so that the next
+// fetch sees it.
+Result Get(CefRefPtr<ResponseCache> cache, const std::string& url,
+           const std::string& name = std::string(),
+           const std::string& value = std::string())
+{
+    CefRefPtr<CefRequest> request = CefRequest::Create();
+    request->SetURL(url);
+    request->SetMethod("GET");
+    if (!name.empty()) {
+        CefRequest::HeaderMap headers;
+        headers.insert(std::make_pair(name, value));
+        request->SetHeaderMap(headers);
+    }
+    CefRefPtr<Fetch> fetch = new Fetch(cache, request);
+    CefPostTask(TID_IO, NewCefRunnableMethod(fetch.get(), &Fetch::Start));
+    Result result;
+    if (!WaitFor(fetch->done())) {
+        fprintf(stderr, "%s timed out\n", url.c_str());
+        return result;
+    }
+    std::atomic<bool> stored(false);
+    CefPostTask(TID_FILE, NewCefRunnableFunction(&Signal, &stored));
+    WaitFor(stored);
+    result.bypassed = fetch->bypassed();
+    result.status = fetch->status();
+    result.body = fetch->body();
+    return result;
+}
+
+int failures = 0;
+
+void Check(bool ok, const char* what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+void RunChecks(LoopbackServer& server, const std::string& dir)
+{
+    CefRefPtr<ResponseCache> cache = new ResponseCache();
+    Check(cache->Open(dir, 1024 * 1024, 1024 * 1024), "open the cache");
+
+    const std::string fresh = server.GetURL("/fresh");
+    Result result = Get(cache, fresh);
+    Check(result.status == 200 && result.body == "fresh" &&
+          server.GetCount("/fresh") == 1, "miss goes to the network");
+    result = Get(cache, fresh);
+    Check(result.status == 200 && result.body == "fresh" &&
+          server.GetCount("/fresh") == 1, "fresh response served again");
+    ResponseCache::Stats stats = cache->GetStats();
+    Check(stats.misses == 1 && stats.memory_hits == 1 && stats.stored == 1,
+          "counted as a miss, a store and a memory hit");
+
+    // A cache without anything in memory reads the same store.
+    CefRefPtr<ResponseCache> reopened = new ResponseCache();
+    reopened->Open(dir, 1024 * 1024, 1024 * 1024);
+    result = Get(reopened, fresh);
+    Check(result.body == "fresh" && server.GetCount("/fresh") == 1 &&
+          reopened->GetStats().disk_hits == 1, "fresh response read from disk");
+
+    const std::string stale = server.GetURL("/stale");
+    result = Get(cache, stale);
+    Check(result.body == "stale" && server.GetCount("/stale") == 1,
+          "response to revalidate stored");
+    result = Get(cache, stale);
+    Check(result.status == 200 && result.body == "stale" &&
+          server.GetCount("/stale") == 2 && server.GetNotModifiedCount() == 1 &&
+          cache->GetStats().revalidated == 1,
+          "stale response revalidated with a 304");
+
+    const std::string vary = server.GetURL("/vary");
+    result = Get(cache, vary, "Accept-Language", "en");
+    Check(result.body == "lang=en" && server.GetCount("/vary") == 1,
+          "first variant fetched");
+    result = Get(cache, vary, "Accept-Language", "de");
+    Check(result.body == "lang=de" && server.GetCount("/vary") == 2,
+          "other variant fetched");
+    result = Get(cache, vary, "Accept-Language", "en");
+    Check(result.body == "lang=en" && server.GetCount("/vary") == 2,
+          "first variant served");
+    result = Get(cache, vary, "Accept-Language", "de");
+    Check(result.body == "lang=de" && server.GetCount("/vary") == 2,
+          "other variant served");
+
+    stats = cache->GetStats();
+    result = Get(cache, server.GetURL("/private"));
+    Check(result.body == "private" && cache->GetStats().stored == stats.stored,
+          "private response not stored");
+    result = Get(cache, server.GetURL("/private"));
+    Check(result.body == "private" &&
+          cache->GetStats().memory_hits == stats.memory_hits &&
+          cache->GetStats().misses == stats.misses + 2,
+          "private response not served from the cache");
+
+    const uint64 bypassed = cache->GetStats().bypassed;
+    result = Get(cache, fresh, "Authorization", "Basic dXNlcjpwYXNz");
+    Check(result.bypassed, "request with Authorization bypassed");
+    result = Get(cache, fresh, "Cookie", "session=1");
+    Check(result.bypassed, "request with Cookie bypassed");
+    result = Get(cache, fresh, "Cache-Control", "no-cache");
+    Check(result.bypassed && cache->GetStats().bypassed == bypassed + 3,
+          "request with no-cache bypassed");
+}
+
+// A cache with room on disk for two of the /big responses.
+void RunEvictionChecks(LoopbackServer& server, const std::string& dir)
+{
+    const uint64 disk_limit = 10000;
+    CefRefPtr<ResponseCache> cache = new ResponseCache();
+    Check(cache->Open(dir, 1024 * 1024, disk_limit), "open a small cache");
+
+    const std::string first = server.GetURL("/big/1");
+    const std::string second = server.GetURL("/big/2");
+    const std::string third = server.GetURL("/big/3");
+    Get(cache, first);
+    Get(cache, second);
+    // Used again, so the second is now the least recently used.
+    Get(cache, first);
+    Get(cache, third);
+    ResponseCache::Stats stats = cache->GetStats();
+    Check(stats.evicted == 1 && stats.disk_entries == 2 &&
+          stats.disk_bytes <= disk_limit,
+          "least recently used URL evicted to fit the disk budget");
+
+    // A cache without anything in memory only finds what is left on disk.
+    CefRefPtr<ResponseCache> reopened = new ResponseCache();
+    reopened->Open(dir, 1024 * 1024, disk_limit);
+    Result result = Get(reopened, first);
+    Check(result.body == "/big/1" + std::string(4096, '.') &&
+          server.GetCount("/big/1") == 1 &&
+          reopened->GetStats().disk_hits == 1, "recently used URL kept");
+    Get(reopened, second);
+    Check(server.GetCount("/big/2") == 2, "evicted URL fetched again");
+
+    // Files no index refers to are deleted when the cache is opened.
+    const std::string orphan = dir + "/data/" + std::string(64, '0');
+    FILE* file = fopen(orphan.c_str(), "wb");
+    if (file)
+        fclose(file);
+    reopened = new ResponseCache();
+    reopened->Open(dir, 1024 * 1024, disk_limit);
+    file = fopen(orphan.c_str(), "rb");
+    if (file)
+        fclose(file);
+    Check(!file && reopened->GetStats().disk_entries == 2,
+          "orphaned body file deleted");
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+#if defined(OS_WIN)
+    CefMainArgs main_args(GetModuleHandle(NULL));
+#else
+    CefMainArgs main_args(argc, argv);
+#endif
+    const int exit_code = CefExecuteProcess(main_args, NULL, NULL);
+    if (exit_code >= 0)
+        return exit_code;
+
+#if defined(OS_WIN)
+    WSADATA wsa_data;
+    WSAStartup(MAKEWORD(2, 2), &wsa_data);
+    const char* temp = getenv("TEMP");
+#else
+    const char* temp = getenv("TMPDIR");
+#endif
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s/response_cache_test_%lld",
+             temp ? temp : "/tmp", static_cast<long long>(NowMicros()));
+
+    LoopbackServer server;
+    if (!server.Start()) {
+        fprintf(stderr, "cannot listen on the loopback interface\n");
+        return 1;
+    }
+
+    CefSettings settings;
+    settings.single_process = true;
+    settings.no_sandbox = true;
+    if (!CefInitialize(main_args, settings, NULL, NULL)) {
+        fprintf(stderr, "cannot initialize CEF\n");
+        server.Stop();
+        return 1;
+    }
+    RunChecks(server, dir);
+    RunEvictionChecks(server, std::string(dir) + "_small");
+    CefShutdown();
+    server.Stop();
+
+    printf("%s, cache left in %s\n", failures ? "FAILED" : "passed", dir);
+    return failures ? 1 : 0;
+}